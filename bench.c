@@ -0,0 +1,360 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+// Note: umem-cache-bench is a closed-loop load generator for a server built
+// without RAFT, see README.rst -> BENCHMARK. Every client thread connects to
+// every server thread, and sends each request to the thread that owns the key,
+// waiting for the response before sending the next one. The requests of a
+// client thread only depend on the arguments, so a run can be reproduced, only
+// their interleaving on the server differs.
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "client.h"
+#include "config.h"
+
+enum dist {
+	DIST_UNIFORM,
+	DIST_ZIPF,
+	DIST_HOTSPOT,
+};
+
+enum op {
+	OP_GET,
+	OP_SET,
+	OP_DEL,
+	OP_NR,
+};
+
+/**
+ * worker - A client thread
+ * @fds: connections to every server thread
+ * @rand: state of the random numbers
+ * @lat: latency of each measured request (in nanoseconds)
+ * @nr: number of @lat
+ * @gets: number of measured GETs
+ * @hits: number of measured GETs that hit
+ * @closed: number of connections closed by the server, see request()
+ */
+struct worker {
+	pthread_t tid;
+	int *fds;
+	uint64_t rand;
+	uint64_t *lat;
+	uint64_t nr;
+	uint64_t gets;
+	uint64_t hits;
+	uint64_t closed;
+};
+
+static uint32_t thread_nr = CONFIG_THREAD_NR;
+static uint32_t client_nr = 4;
+static uint64_t request_nr = 100000;
+static uint64_t warmup_nr = 0;
+static uint64_t key_nr = 100000;
+static enum dist dist = DIST_ZIPF;
+static double zipf_alpha = 0.99;
+static double hot_keys = 0.2;
+static double hot_requests = 0.8;
+static uint64_t val_min = 100;
+static uint64_t val_max = 100;
+static uint32_t mix[OP_NR] = {90, 9, 1};
+static uint64_t seed = 1;
+static int port;
+
+/* zipf_cdf[i] is the probability of keys [0, i] */
+static double *zipf_cdf;
+static pthread_barrier_t barrier;
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "umem-cache-bench: %s\n", msg);
+	exit(1);
+}
+
+static void usage()
+{
+	die("usage: umem-cache-bench [-t thread-nr] [-c client-nr] [-n request-nr] "
+	    "[-w warmup-nr] [-k key-nr] [-d uniform|zipf[:alpha]|hotspot[:keys:requests]] "
+	    "[-v size[-size]] [-m get:set:del] [-s seed] {{port}}");
+}
+
+/**
+ * splitmix64 - Get the next random number of @state
+ */
+static uint64_t splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * rand_double - Get a random number of @state in [0, 1)
+ */
+static double rand_double(uint64_t *state)
+{
+	return (splitmix64(state) >> 11) * 0x1p-53;
+}
+
+static void zipf_init()
+{
+	zipf_cdf = malloc(key_nr * sizeof(*zipf_cdf));
+	if (zipf_cdf == NULL)
+		die("out of memory");
+
+	double sum = 0;
+	for (uint64_t i = 0; i < key_nr; i++) {
+		sum += 1 / pow(i + 1, zipf_alpha);
+		zipf_cdf[i] = sum;
+	}
+	for (uint64_t i = 0; i < key_nr; i++)
+		zipf_cdf[i] /= sum;
+}
+
+/**
+ * next_key - Get the next key of @w, key i is the i'th most popular one
+ */
+static uint64_t next_key(struct worker *w)
+{
+	switch (dist) {
+	case DIST_ZIPF:;
+		double u = rand_double(&w->rand);
+		uint64_t lo = 0, hi = key_nr - 1;
+		while (lo < hi) {
+			uint64_t mid = lo + (hi - lo) / 2;
+			if (zipf_cdf[mid] > u)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		return lo;
+	case DIST_HOTSPOT:;
+		uint64_t hot = key_nr * hot_keys;
+		if (hot == 0)
+			hot = 1;
+		if (rand_double(&w->rand) < hot_requests || hot == key_nr)
+			return splitmix64(&w->rand) % hot;
+		return hot + splitmix64(&w->rand) % (key_nr - hot);
+	default:
+		return splitmix64(&w->rand) % key_nr;
+	}
+}
+
+/**
+ * next_op - Get the next request type of @w
+ */
+static enum op next_op(struct worker *w)
+{
+	uint64_t r = splitmix64(&w->rand) % (mix[OP_GET] + mix[OP_SET] +
+								mix[OP_DEL]);
+	if (r < mix[OP_GET])
+		return OP_GET;
+	return r < mix[OP_GET] + mix[OP_SET] ? OP_SET : OP_DEL;
+}
+
+/**
+ * val_size - Get the value size of key @i, which never changes
+ */
+static uint64_t val_size(uint64_t i)
+{
+	uint64_t state = seed ^ (i * 0xD1B54A32D192ED03ULL);
+	return val_min + splitmix64(&state) % (val_max - val_min + 1);
+}
+
+/**
+ * request - Send the next request of @w, and wait for the response
+ * @measured: the request is measured
+ * 
+ * Note: a CMD-SET closes the connection filling the key, which is only seen
+ * by the next request of the connection, so a closed connection is counted
+ * and replaced, and the request failed is not measured.
+ */
+static void request(struct worker *w, bool measured)
+{
+	unsigned char key[1 + CONFIG_KEY_SIZE_MAX];
+	uint64_t k = next_key(w);
+	enum op op = next_op(w);
+	key[0] = sprintf((char *)key + 1, "bench:%lu", k);
+	uint32_t id = client_thread(key, thread_nr);
+	int fd = w->fds[id];
+
+	uint64_t start = client_now_ns();
+	enum client_res res;
+	switch (op) {
+	case OP_GET:
+		res = client_get_or_set(fd, key, val_size(k));
+		break;
+	case OP_SET:
+		res = client_set(fd, key, val_size(k)) ? CLIENT_MISS :
+							CLIENT_ERROR;
+		break;
+	default:
+		res = client_del(fd, key) ? CLIENT_MISS : CLIENT_ERROR;
+		break;
+	}
+	if (res == CLIENT_ERROR) {
+		close(fd);
+		w->fds[id] = client_connect(port, id);
+		if (w->fds[id] == -1)
+			die("failed to connect");
+		w->closed++;
+		return;
+	}
+
+	if (measured) {
+		w->lat[w->nr++] = client_now_ns() - start;
+		if (op == OP_GET) {
+			w->gets++;
+			w->hits += res == CLIENT_HIT;
+		}
+	}
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	for (uint64_t i = 0; i < warmup_nr; i++)
+		request(w, false);
+	pthread_barrier_wait(&barrier);
+	for (uint64_t i = 0; i < request_nr; i++)
+		request(w, true);
+	return NULL;
+}
+
+static void parse_dist(char *arg)
+{
+	char *params = strchr(arg, ':');
+	if (params)
+		*params++ = '\0';
+
+	if (strcmp(arg, "uniform") == 0 && params == NULL) {
+		dist = DIST_UNIFORM;
+	} else if (strcmp(arg, "zipf") == 0) {
+		dist = DIST_ZIPF;
+		if (params && sscanf(params, "%lf", &zipf_alpha) != 1)
+			usage();
+	} else if (strcmp(arg, "hotspot") == 0) {
+		dist = DIST_HOTSPOT;
+		if (params && sscanf(params, "%lf:%lf", &hot_keys,
+							&hot_requests) != 2)
+			usage();
+	} else {
+		usage();
+	}
+	if (zipf_alpha < 0 || hot_keys <= 0 || hot_keys > 1 ||
+	    hot_requests < 0 || hot_requests > 1)
+		usage();
+}
+
+static void parse_args(int argc, char *argv[])
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "t:c:n:w:k:d:v:m:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			thread_nr = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			client_nr = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			request_nr = strtoull(optarg, NULL, 10);
+			break;
+		case 'w':
+			warmup_nr = strtoull(optarg, NULL, 10);
+			break;
+		case 'k':
+			key_nr = strtoull(optarg, NULL, 10);
+			break;
+		case 'd':
+			parse_dist(optarg);
+			break;
+		case 'v':
+			switch (sscanf(optarg, "%lu-%lu", &val_min, &val_max)) {
+			case 1:
+				val_max = val_min;
+				break;
+			case 2:
+				break;
+			default:
+				usage();
+			}
+			break;
+		case 'm':
+			if (sscanf(optarg, "%u:%u:%u", &mix[OP_GET],
+					&mix[OP_SET], &mix[OP_DEL]) != 3)
+				usage();
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 1 || thread_nr == 0 || client_nr == 0 ||
+	    key_nr == 0 || val_min > val_max ||
+	    mix[OP_GET] + mix[OP_SET] + mix[OP_DEL] == 0)
+		usage();
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	port = atoi(argv[optind]);
+	if (dist == DIST_ZIPF)
+		zipf_init();
+
+	struct worker *workers = calloc(client_nr, sizeof(*workers));
+	uint64_t *lat = malloc(client_nr * request_nr * sizeof(*lat) ?: 1);
+	int *fds = malloc(client_nr * thread_nr * sizeof(*fds));
+	if (workers == NULL || lat == NULL || fds == NULL)
+		die("out of memory");
+
+	for (uint32_t i = 0; i < client_nr; i++) {
+		struct worker *w = &workers[i];
+		w->fds = fds + i * thread_nr;
+		w->rand = seed ^ ((i + 1) * 0x2545F4914F6CDD1DULL);
+		w->lat = lat + i * request_nr;
+		for (uint32_t id = 0; id < thread_nr; id++) {
+			w->fds[id] = client_connect(port, id);
+			if (w->fds[id] == -1)
+				die("failed to connect");
+		}
+	}
+
+	pthread_barrier_init(&barrier, NULL, client_nr + 1);
+	for (uint32_t i = 0; i < client_nr; i++)
+		if (pthread_create(&workers[i].tid, NULL, worker_run,
+							&workers[i]) != 0)
+			die("failed to create threads");
+	pthread_barrier_wait(&barrier);
+	uint64_t start = client_now_ns();
+
+	uint64_t gets = 0, hits = 0, closed = 0;
+	for (uint32_t i = 0; i < client_nr; i++)
+		pthread_join(workers[i].tid, NULL);
+	uint64_t elapsed = client_now_ns() - start;
+
+	uint64_t nr = 0;
+	for (uint32_t i = 0; i < client_nr; i++) {
+		struct worker *w = &workers[i];
+		memmove(lat + nr, w->lat, w->nr * sizeof(*lat));
+		nr += w->nr;
+		gets += w->gets;
+		hits += w->hits;
+		closed += w->closed;
+	}
+	printf("requests:    %lu in %.3f s, %.0f ops/s, %lu failed by racing SETs\n",
+	       nr, elapsed / 1e9, nr / (elapsed / 1e9), closed);
+	printf("hit ratio:   %.4f of %lu GETs\n",
+	       gets ? (double)hits / gets : 0, gets);
+	client_print_latency(lat, nr);
+	return 0;
+}
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <time.h>
+#include "client.h"
+#include "conn.h"
+#include "murmur_hash3.h"
+
+#define CLIENT_BUFFER_SIZE	65536
+
+/* values sent by the tools are zeros, values received are dropped here */
+static unsigned char zeros[CLIENT_BUFFER_SIZE];
+static __thread unsigned char sink[CLIENT_BUFFER_SIZE];
+
+/**
+ * client_now_ns - Get the monotonic time (in nanoseconds)
+ */
+uint64_t client_now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * client_thread - Get the thread that owns @key, see README.rst -> KEY DISPATCH
+ */
+uint32_t client_thread(const unsigned char *key, uint32_t thread_nr)
+{
+	uint64_t out[2];
+	MurmurHash3_x64_128(key + 1, key[0], 74, out);
+	return ((unsigned __int128)le64toh(out[0]) * thread_nr) >> 64;
+}
+
+static bool send_full(int fd, const void *buf, uint64_t n)
+{
+	while (n > 0) {
+		ssize_t ret = send(fd, buf, n, MSG_NOSIGNAL);
+		if (ret <= 0)
+			return false;
+		buf += ret;
+		n -= ret;
+	}
+	return true;
+}
+
+static bool recv_full(int fd, void *buf, uint64_t n)
+{
+	while (n > 0) {
+		ssize_t ret = recv(fd, buf, n, 0);
+		if (ret <= 0)
+			return false;
+		buf += ret;
+		n -= ret;
+	}
+	return true;
+}
+
+/**
+ * send_value - Send a value of @size bytes
+ */
+static bool send_value(int fd, uint64_t size)
+{
+	uint64_t le = htole64(size);
+	if (!send_full(fd, &le, sizeof(le)))
+		return false;
+
+	while (size > 0) {
+		uint64_t n = size < CLIENT_BUFFER_SIZE ? size : CLIENT_BUFFER_SIZE;
+		if (!send_full(fd, zeros, n))
+			return false;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+ * recv_value - Receive and drop a value of @size bytes
+ */
+static bool recv_value(int fd, uint64_t size)
+{
+	while (size > 0) {
+		uint64_t n = size < CLIENT_BUFFER_SIZE ? size : CLIENT_BUFFER_SIZE;
+		if (!recv_full(fd, sink, n))
+			return false;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+ * send_cmd - Send =CMD= of @cmd and @key
+ */
+static bool send_cmd(int fd, enum cache_cmd cmd, const unsigned char *key)
+{
+	unsigned char buf[CMD_SIZE_MAX];
+	buf[0] = cmd;
+	memcpy(buf + 1, key, CLIENT_KEY_SIZE(key));
+	return send_full(fd, buf, 1 + CLIENT_KEY_SIZE(key));
+}
+
+/**
+ * client_connect - Connect to thread @thread_id of the server listening on
+ * @port of localhost, see README.rst -> CONNECT
+ * 
+ * @return: socket fd on success, or -1 on failure
+ */
+int client_connect(int port, uint32_t thread_id)
+{
+	int fd = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+	if (fd == -1)
+		return -1;
+
+	struct sockaddr_in6 addr = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(port),
+		.sin6_addr = in6addr_loopback,
+	};
+	int opt = 1;
+	uint32_t req[2] = {0, htole32(thread_id)};
+	uint8_t error;
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt))	 ||
+	    connect(fd, (struct sockaddr *)&addr, sizeof(addr))		 ||
+	    !send_full(fd, req, sizeof(req))				 ||
+	    !recv_full(fd, &error, sizeof(error))			 ||
+	    error != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * client_get_or_set - Run CMD-GET-OR-SET of @key, the value is dropped
+ * @fill_size: size of the value to set if it misses
+ */
+enum client_res client_get_or_set(int fd, const unsigned char *key,
+							uint64_t fill_size)
+{
+	struct {
+		uint64_t size;
+		uint8_t miss;
+	} __attribute__((packed)) res;
+
+	if (!send_cmd(fd, CACHE_CMD_GET_OR_SET, key) ||
+	    !recv_full(fd, &res, sizeof(res)))
+		return CLIENT_ERROR;
+
+	if (res.miss == 1)
+		return send_value(fd, fill_size) ? CLIENT_MISS : CLIENT_ERROR;
+	return recv_value(fd, le64toh(res.size)) ? CLIENT_HIT : CLIENT_ERROR;
+}
+
+/**
+ * client_set - Run CMD-SET of @key with a value of @val_size bytes
+ */
+bool client_set(int fd, const unsigned char *key, uint64_t val_size)
+{
+	uint8_t error;
+	return send_cmd(fd, CACHE_CMD_SET, key) && send_value(fd, val_size) &&
+	       recv_full(fd, &error, sizeof(error)) && error == 0;
+}
+
+/**
+ * client_del - Run CMD-DEL of @key
+ */
+bool client_del(int fd, const unsigned char *key)
+{
+	uint8_t error;
+	return send_cmd(fd, CACHE_CMD_DEL, key) &&
+	       recv_full(fd, &error, sizeof(error)) && error == 0;
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+	return (*x > *y) - (*x < *y);
+}
+
+/**
+ * client_print_latency - Print the percentiles of @nr latencies @lat (in
+ * nanoseconds), @lat is sorted in place
+ */
+void client_print_latency(uint64_t *lat, uint64_t nr)
+{
+	if (nr == 0)
+		return;
+
+	qsort(lat, nr, sizeof(*lat), u64_cmp);
+	printf("latency(us): p50 %.1f, p90 %.1f, p99 %.1f, p999 %.1f, max %.1f\n",
+	       lat[nr * 50 / 100] / 1e3, lat[nr * 90 / 100] / 1e3,
+	       lat[nr * 99 / 100] / 1e3, lat[nr * 999 / 1000] / 1e3,
+	       lat[nr - 1] / 1e3);
+}
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_CLIENT_H
+#define __UMEM_CACHE_CLIENT_H
+
+// Note: a minimal blocking client of the CACHE PROTOCOL for the tools, it
+// speaks to a server built without RAFT, see README.rst
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* a key is ([key-size] [key]), as in =CMD= */
+#define CLIENT_KEY_SIZE(key)	(1 + (key)[0])
+
+enum client_res {
+	CLIENT_ERROR = -1,
+	CLIENT_MISS,
+	CLIENT_HIT,
+};
+
+uint64_t client_now_ns();
+uint32_t client_thread(const unsigned char *key, uint32_t thread_nr);
+int client_connect(int port, uint32_t thread_id);
+enum client_res client_get_or_set(int fd, const unsigned char *key,
+							uint64_t fill_size);
+bool client_set(int fd, const unsigned char *key, uint64_t val_size);
+bool client_del(int fd, const unsigned char *key);
+void client_print_latency(uint64_t *lat, uint64_t nr);
+
+#endif
@@ -30,6 +30,54 @@
 #define CONFIG_TCP_TIMEOUT 3000
 #endif
 
+/* values of at least this size are sent with zero copy (in bytes) */
+#ifndef CONFIG_ZEROCOPY_THRESHOLD
+#define CONFIG_ZEROCOPY_THRESHOLD (64 << 10)
+#endif
+
+/* number of virtual shards the keys are split into, see CONFIG_SHARD */
+#ifndef CONFIG_SHARD_NR
+#define CONFIG_SHARD_NR 256
+#endif
+
+/* shards are balanced between threads every this milliseconds */
+#ifndef CONFIG_SHARD_BALANCE_INTERVAL
+#define CONFIG_SHARD_BALANCE_INTERVAL 1000
+#endif
+
+/* a shard is moved if the busiest thread does this percent more commands than
+the idlest thread */
+#ifndef CONFIG_SHARD_SKEW
+#define CONFIG_SHARD_SKEW 50
+#endif
+
+/* number of hot keys can be replicated at the same time, see CONFIG_REPLICA */
+#ifndef CONFIG_REPLICA_NR
+#define CONFIG_REPLICA_NR 16
+#endif
+
+/* values larger than this are not replicated (in bytes) */
+#ifndef CONFIG_REPLICA_VAL_MAX
+#define CONFIG_REPLICA_VAL_MAX (64 << 10)
+#endif
+
+/* number of namespace slots, namespaces hashed to the same slot are flushed
+together, see CONFIG_NAMESPACE */
+#ifndef CONFIG_NAMESPACE_NR
+#define CONFIG_NAMESPACE_NR 1024
+#endif
+
+/* the namespace of a key is the bytes before the first of this byte */
+#ifndef CONFIG_NAMESPACE_SEP
+#define CONFIG_NAMESPACE_SEP ':'
+#endif
+
+/* number of records a thread keeps in its trace file, power of 2, see
+CONFIG_TRACE */
+#ifndef CONFIG_TRACE_NR
+#define CONFIG_TRACE_NR (1 << 20)
+#endif
+
 /***************************** CONFIGURABLE END *******************************/
 
 /* (in bytes) */
@@ -43,5 +91,35 @@ static_assert(CONFIG_THREAD_NR > 0 && CONFIG_THREAD_NR <= INT32_MAX);
 static_assert(CONFIG_MAX_CONN > 0 && CONFIG_MAX_CONN <= INT32_MAX);
 static_assert(CONFIG_MEM_LIMIT > 0 && CONFIG_MEM_LIMIT <= INT64_MAX);
 static_assert(CONFIG_TCP_TIMEOUT > 0 && CONFIG_TCP_TIMEOUT <= UINT32_MAX);
+static_assert(CONFIG_ZEROCOPY_THRESHOLD > 0);
+static_assert(CONFIG_SHARD_NR > 0 && CONFIG_SHARD_NR <= UINT16_MAX + 1);
+/* the initial shard map is the same as dispatching keys to threads */
+static_assert(CONFIG_SHARD_NR % CONFIG_THREAD_NR == 0);
+static_assert(CONFIG_SHARD_BALANCE_INTERVAL > 0);
+static_assert(CONFIG_REPLICA_NR > 0);
+static_assert(CONFIG_NAMESPACE_NR > 0 && CONFIG_NAMESPACE_NR < UINT32_MAX);
+static_assert(CONFIG_NAMESPACE_SEP >= 0 && CONFIG_NAMESPACE_SEP <= UINT8_MAX);
+static_assert(CONFIG_TRACE_NR > 0 &&
+	      (CONFIG_TRACE_NR & (CONFIG_TRACE_NR - 1)) == 0);
+
+/* thread listeners don't do the tls handshake */
+#if defined(CONFIG_THREAD_PORT) && defined(CONFIG_KERNEL_TLS)
+#error "THREAD_PORT conflicts with TLS"
+#endif
+
+/* kernel tls encrypts into its own buffers, there is nothing to zero copy */
+#if defined(CONFIG_ZEROCOPY) && defined(CONFIG_KERNEL_TLS)
+#error "ZEROCOPY conflicts with TLS"
+#endif
+
+/* a thread may receive commands of shards it no longer owns */
+#if defined(CONFIG_SHARD) && !defined(CONFIG_ROUTE)
+#error "SHARD requires ROUTE"
+#endif
+
+/* only routed commands look for replicas */
+#if defined(CONFIG_REPLICA) && !defined(CONFIG_ROUTE)
+#error "REPLICA requires ROUTE"
+#endif
 
 #endif
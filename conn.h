@@ -5,11 +5,31 @@
 #define __UMEM_CACHE_CONN_H
 
 #include <sys/epoll.h>
+#include <sys/socket.h>
 #include "kv.h"
+#include "fixed_mem_cache.h"
+#include "latency.h"
 
 enum cache_cmd {
 	CACHE_CMD_GET_OR_SET,
 	CACHE_CMD_DEL,
+	CACHE_CMD_SHARD_MAP,
+	CACHE_CMD_SET,
+	CACHE_CMD_BULK_LOAD,
+	CACHE_CMD_INCR,
+	CACHE_CMD_DECR,
+	CACHE_CMD_ADD,
+	CACHE_CMD_FLUSH,
+	CACHE_CMD_GET_RANGE,
+	CACHE_CMD_GET_IF_CHANGED,
+	CACHE_CMD_SUBSCRIBE,
+	CACHE_CMD_MUX,
+	CACHE_CMD_STATS,
+	CACHE_CMD_LATENCY,
+	CACHE_CMD_LATENCY_RESET,
+	CACHE_CMD_TOP_KEYS,
+	CACHE_CMD_MRC,
+	CACHE_CMD_SMALL_RATIO,
 } __attribute__((__packed__));
 
 static_assert(sizeof(enum cache_cmd) == 1);
@@ -18,41 +38,196 @@ static_assert(sizeof(enum cache_cmd) == 1);
 #define CMD_SIZE_MIN	(1 + 1)
 #define GET_RES_SIZE	(8 + 1)
 #define SET_REQ_SIZE	8
+#define GET_RANGE_REQ_SIZE	(8 + 8)
+#define ETAG_SIZE	8
+#define GET_ETAG_RES_SIZE	(ETAG_SIZE + GET_RES_SIZE)
+
+/* [value-size] of a value sent in chunks, see README.rst -> CHUNKED VALUE */
+#define SET_CHUNKED	UINT64_MAX
+
+/* request of counter commands, see README.rst -> CMD-INCR */
+#define COUNTER_REQ_SIZE	(8 + 1)
+#define COUNTER_SIZE		8
+
+enum counter_error {
+	COUNTER_OK,
+	COUNTER_MISS,
+	COUNTER_NOT_COUNTER,
+};
+
+/* [hit] of GET response when the key is replicated, see CONFIG_REPLICA */
+#define GET_RES_REPLICATED	2
+/* [hit] of CMD-GET-IF-CHANGED response when the etag matches */
+#define GET_RES_NOT_MODIFIED	3
+/* [hit] of CMD-MUX response when the thread does not own the key, see
+CONFIG_SHARD */
+#define GET_RES_NOT_OWNED	4
+
+/* request and response of CMD-MUX, see README.rst -> CMD-MUX */
+#define MUX_ID_SIZE	4
+#define MUX_RES_SIZE	(MUX_ID_SIZE + GET_RES_SIZE)
+
+/* events of CMD-SUBSCRIBE, see README.rst -> CMD-SUBSCRIBE */
+enum sub_event {
+	SUB_EVENT_CHANGED,
+	SUB_EVENT_RESYNC,
+} __attribute__((__packed__));
 
 /* see README.rst -> CACHE PROTOCOL */
 enum conn_state {
 	CONN_STATE_IN_CMD		= (0 << 3) + EPOLLIN,
 	CONN_STATE_GET_BLOCKED		= (1 << 3) + 0,
-	CONN_STATE_OUT_SUCCESS		= (2 << 3) + EPOLLOUT,
-	CONN_STATE_GET_OUT_HIT		= (3 << 3) + EPOLLOUT,
+	CONN_STATE_ROUTE_BLOCKED	= (2 << 3) + 0,
+	CONN_STATE_OUT_SUCCESS		= (3 << 3) + EPOLLOUT,
+	CONN_STATE_GET_OUT_HIT		= (4 << 3) + EPOLLOUT,
+	CONN_STATE_OUT_SHARD_MAP	= (5 << 3) + EPOLLOUT,
+	CONN_STATE_BULK_IN		= (6 << 3) + EPOLLIN,
+	CONN_STATE_COUNTER_IN		= (7 << 3) + EPOLLIN,
+	CONN_STATE_RETRY_BLOCKED	= (8 << 3) + 0,
+	CONN_STATE_RETRY		= (9 << 3) + EPOLLOUT,
+	CONN_STATE_OUT_BUFFER		= (10 << 3) + EPOLLOUT,
+	CONN_STATE_GET_RANGE_IN		= (11 << 3) + EPOLLIN,
+#ifdef CONFIG_ETAG
+	CONN_STATE_ETAG_IN		= (12 << 3) + EPOLLIN,
+	CONN_STATE_GET_OUT_ETAG		= (13 << 3) + EPOLLOUT,
+	CONN_STATE_OUT_ETAG		= (14 << 3) + EPOLLOUT,
+#endif
+	CONN_STATE_SUB_IDLE		= (15 << 3) + 0,
+	CONN_STATE_SUB_OUT		= (16 << 3) + EPOLLOUT,
+#ifndef CONFIG_IO_URING
+	CONN_STATE_MUX			= (17 << 3) + EPOLLIN + EPOLLOUT,
+	CONN_STATE_MUX_BLOCKED		= (18 << 3) + 0,
+	CONN_STATE_MUX_DONE		= (19 << 3) + 0,
+#endif
+
+#ifndef CONFIG_RAFT
+	CONN_STATE_OUT_STATS		= (20 << 3) + EPOLLOUT,
+#ifdef CONFIG_LATENCY
+	CONN_STATE_OUT_LATENCY		= (21 << 3) + EPOLLOUT,
+#endif
+	CONN_STATE_OUT_TOP_KEYS		= (22 << 3) + EPOLLOUT,
+#ifdef CONFIG_MRC
+	CONN_STATE_OUT_MRC		= (23 << 3) + EPOLLOUT,
+#endif
+#endif
 
-	CONN_STATE_FREE			= (4 << 3) + EPOLLIN,
+	CONN_STATE_FREE			= (24 << 3) + EPOLLIN,
 	/* Note: following states holds a kv lock */
 
-	CONN_STATE_GET_OUT_MISS		= (5 << 3) + EPOLLOUT,
-	CONN_STATE_SET_IN_VALUE_SIZE	= (6 << 3) + EPOLLIN,
-	CONN_STATE_SET_IN_VALUE		= (7 << 3) + EPOLLIN,
+	CONN_STATE_GET_OUT_MISS		= (25 << 3) + EPOLLOUT,
+	CONN_STATE_SET_IN_VALUE_SIZE	= (26 << 3) + EPOLLIN,
+	CONN_STATE_SET_IN_VALUE		= (27 << 3) + EPOLLIN,
+	CONN_STATE_BULK_IN_VALUE	= (28 << 3) + EPOLLIN,
+	CONN_STATE_CHUNK_IN_SIZE	= (29 << 3) + EPOLLIN,
+	CONN_STATE_CHUNK_IN		= (30 << 3) + EPOLLIN,
 } __attribute__((__packed__));
 
+/* size of (struct bulk) (in pages) */
+#define BULK_PAGE	16
+
+/**
+ * bulk - Buffer of the records read by CMD-BULK-LOAD
+ * @head: the next record to load
+ * @tail: end of the bytes read
+ * @data: the records, see README.rst -> CMD-BULK-LOAD
+ */
+struct bulk {
+	uint32_t head;
+	uint32_t tail;
+	unsigned char data[];
+};
+
+#define BULK_DATA_SIZE	((BULK_PAGE << PAGE_SHIFT) - sizeof(struct bulk))
+
+/* size of (struct chunk) (in pages) */
+#define CHUNK_PAGE	16
+
+/**
+ * chunk - Buffer of a value sent in chunks, see README.rst -> CHUNKED VALUE
+ * @next: the next chunk, the last chunk links to the first one
+ * @n: number of bytes in @data
+ * @data: bytes of the value
+ */
+struct chunk {
+	struct chunk *next;
+	uint64_t n;
+	unsigned char data[];
+};
+
+#define CHUNK_DATA_SIZE	((CHUNK_PAGE << PAGE_SHIFT) - sizeof(struct chunk))
+
+/* size of (struct sub) (in pages) */
+#define SUB_PAGE	16
+
+/**
+ * sub - Events not sent to a subscriber yet, see README.rst -> CMD-SUBSCRIBE
+ * @node: resides in (struct thread->subscribers)
+ * @conn: the subscriber
+ * @head: the next byte to send
+ * @tail: end of the events
+ * @resync: events are dropped, SUB_EVENT_RESYNC is appended once there is room
+ * @data: the events
+ */
+struct sub {
+	struct list_head node;
+	struct conn *conn;
+	uint32_t head;
+	uint32_t tail;
+	bool resync;
+	unsigned char data[];
+};
+
+#define SUB_DATA_SIZE	((SUB_PAGE << PAGE_SHIFT) - sizeof(struct sub))
+
 /**
  * conn - Structure describes connection
+ * @etag: etag of CMD-GET-IF-CHANGED, it is sent right before @buffer, see
+ * CONFIG_ETAG
+ * @route: commands are routed to the thread that owns the key, see
+ * CONFIG_ROUTE
+ * @set: the value is of CMD-SET, which is replied, see CONN_STATE_SET_IN_VALUE
  * @fd: connection bound socket file descriptor
  * @kv_borrower: borrows kv for operation
  * @clock: resides in (struct thread->clock_probation) when clock is called and
  * may move to (struct thread->clock_death) later
  * @unio: number of bytes not read() or write()
+ * @offset: offset of the first byte of the value to send, see CMD-GET-RANGE
+ * @length: number of bytes of the value to send
+ * @zc_borrower: holds the kv that zero copy sends refer to
+ * @zc_sent: number of zero copy sends
+ * @zc_done: number of zero copy sends that no longer refer to the kv
+ * @msg: message of the io_uring request in flight
+ * @iov: io vector of @msg
+ * @res: result of the completed io_uring request, valid if @res_ready
+ * @inflight: an io_uring request is in flight
+ * @bulk: records of CMD-BULK-LOAD not loaded yet
+ * @chunk: the last chunk of the value being read in chunks
+ * @sub: events to send, the conn is a subscriber if it is not NULL
+ * @mux: the multiplexed connection of CONN_STATE_MUX, or the one the request
+ * belongs to
+ * @mux_id: request-id of the request, see CONN_STATE_MUX_BLOCKED
+ * @epoch: flush epoch the key is locked at, see CONFIG_NAMESPACE
+ * @lat_start: when the command timed by @lat started (in nanoseconds)
+ * @lat_stall: when the response stopped being taken by the socket, 0 if it is
+ * not stalled, see LAT_WRITE
+ * @lat: the histogram the command is timed for, or LAT_NONE
  * @hash_node: resides in (struct thread->hash_table) before malloc kv
  * @key: key received from client
  */
 struct conn {
+#ifdef CONFIG_ETAG
+	uint64_t etag;
+#endif
 	union {
 		unsigned char buffer[GET_RES_SIZE];
 		struct {
 			uint64_t size;
-			bool miss;
+			uint8_t miss;
 
 			enum conn_state state;
 			bool clock_called;
+			bool route;
+			bool set;
 			int fd;
 		};
 	};
@@ -60,14 +235,89 @@ struct conn {
 	struct hlist_node clock;
 	struct list_head interest;
 	uint64_t unio;
+	uint64_t offset;
+	uint64_t length;
+#ifdef CONFIG_ZEROCOPY
+	struct kv_borrower zc_borrower;
+	uint32_t zc_sent;
+	uint32_t zc_done;
+#endif
+#ifdef CONFIG_IO_URING
+	struct msghdr msg;
+	struct iovec iov[4];
+	int32_t res;
+	bool res_ready;
+	bool inflight;
+#endif
+	struct bulk *bulk;
+	struct chunk *chunk;
+	struct sub *sub;
+#ifndef CONFIG_IO_URING
+	struct mux *mux;
+	uint32_t mux_id;
+#endif
+#ifdef CONFIG_NAMESPACE
+	uint32_t epoch;
+#endif
+#ifdef CONFIG_LATENCY
+	uint64_t lat_start;
+	uint64_t lat_stall;
+	enum lat_hist lat;
+#endif
 	struct hlist_node hash_node;
 	unsigned char key[1 + CONFIG_KEY_SIZE_MAX];
 } __attribute__((aligned(8)));
 /* alignment is required by loop_forever */
 
+#ifdef CONFIG_ETAG
+/* CONN_STATE_GET_OUT_ETAG sends @etag and @buffer together */
+static_assert(offsetof(struct conn, buffer) - offsetof(struct conn, etag) ==
+		sizeof(uint64_t));
+#endif
+
+/* CONN_STATE_GET_RANGE_IN reads the request into @offset and @length */
+static_assert(offsetof(struct conn, length) - offsetof(struct conn, offset) ==
+		sizeof(uint64_t));
+
 /* this offset is required for hash table to locate the key, also kind of
 required by CONN_STATE_IN_CMD */
 static_assert(offsetof(struct conn, key) - offsetof(struct conn, hash_node) ==
 		sizeof(struct hlist_node));
 
+#ifndef CONFIG_IO_URING
+/* number of requests a multiplexed connection runs at the same time */
+#define MUX_REQ_MAX	64
+
+/**
+ * mux - A multiplexed connection, see README.rst -> CMD-MUX
+ * @conn: the connection, NULL if it is closed while some requests are blocked
+ * @done: requests to respond in order, the first one is being sent
+ * @req_nr: number of requests not responded, blocked ones included
+ * @head: the next byte of @data to run
+ * @tail: end of the bytes read
+ * @req_cache: allocates @reqs
+ * @reqs: the requests not responded, a request is a conn that never does IO,
+ * so it can wait for a locked key like other conns
+ * @data: the requests read
+ */
+struct mux {
+	struct conn *conn;
+	struct list_head done;
+	uint32_t req_nr;
+	uint32_t head;
+	uint32_t tail;
+	struct fixed_mem_cache req_cache;
+	struct conn reqs[MUX_REQ_MAX];
+	unsigned char data[];
+};
+
+/* at least this many bytes of (struct mux->data), requests read ahead with a
+SET must fit, see SET_EXTRA_BUFFER */
+#define MUX_DATA_MIN	(16 << 10)
+/* size of (struct mux) (in pages), it follows the size of (struct conn) */
+#define MUX_PAGE	((sizeof(struct mux) + MUX_DATA_MIN + (1 << PAGE_SHIFT) - 1) \
+								>> PAGE_SHIFT)
+#define MUX_DATA_SIZE	((MUX_PAGE << PAGE_SHIFT) - sizeof(struct mux))
+#endif
+
 #endif
@@ -8,6 +8,7 @@
 #include "hash_table.h"
 #include "murmur_hash3.h"
 #include "config.h"
+#include "probe.h"
 
 static_assert(sizeof(((struct hash_table *)0)->buckets) == 8);
 #define MIN_PAGE		(1 + BUCKET_GHOST / 2)
@@ -74,7 +75,7 @@ static void hash(const unsigned char *key, uint64_t *hkey, uint32_t *fingerprint
 /**
  * key_hash - Compute hash of @key using MurmurHash3 algorithm
  */
-static uint64_t key_hash(const unsigned char *key)
+uint64_t key_hash(const unsigned char *key)
 {
 	uint64_t hkey;
 	uint32_t fingerprint;
@@ -91,12 +92,10 @@ static bool key_equal(const unsigned char *a, const unsigned char *b)
 }
 
 /**
- * hash_bucket - Get the hash bucket that @key resides
+ * hash_bucket - Get the hash bucket that the key of hash @hkey resides
  */
-static struct hlist_head *hash_bucket(
-		const struct hash_table *ht, const unsigned char *key)
+static struct hlist_head *hash_bucket(const struct hash_table *ht, uint64_t hkey)
 {
-	uint64_t hkey = key_hash(key);
 	if (under_migrating(ht)) {
 		struct hlist_head *old_bucket;
 		old_bucket = &ht->old_buckets[hkey & ht->old_mask];
@@ -142,6 +141,8 @@ static void evacuate(struct hash_table *ht, uint64_t i, struct memory *m)
 			ht->migrated++;
 
 		if (ht->migrated > ht->old_mask) {
+			probe(hash_resize_finish, ht, ht->old_mask + 1,
+								ht->mask + 1);
 			memory_free(m, ht->old_buckets, MASK_TO_PAGE(ht->old_mask));
 			ht->old_buckets = NULL;
 		}
@@ -149,17 +150,17 @@ static void evacuate(struct hash_table *ht, uint64_t i, struct memory *m)
 }
 
 /**
- * hash_get - Get the hash node of @key from @ht
+ * __hash_get - Get the hash node of @key from @ht, @hkey is key_hash(@key)
  * 
  * @return: the hash node or NULL if @key not exist
  */
-struct hlist_node *hash_get(
-	struct hash_table *ht, const unsigned char *key, struct memory *m)
+struct hlist_node *__hash_get(struct hash_table *ht, const unsigned char *key,
+					uint64_t hkey, struct memory *m)
 {
 	if (under_migrating(ht))
 		evacuate(ht, ht->migrated, m);
 
-	struct hlist_head *bucket = hash_bucket(ht, key);
+	struct hlist_head *bucket = hash_bucket(ht, hkey);
 	struct hlist_node *node;
 	hlist_for_each(node, bucket) {
 		if (key_equal(node_to_key(node), key))
@@ -168,6 +169,17 @@ struct hlist_node *hash_get(
 	return NULL;
 }
 
+/**
+ * hash_get - Get the hash node of @key from @ht
+ * 
+ * @return: the hash node or NULL if @key not exist
+ */
+struct hlist_node *hash_get(
+	struct hash_table *ht, const unsigned char *key, struct memory *m)
+{
+	return __hash_get(ht, key, key_hash(key), m);
+}
+
 /**
  * should_grow - Check if the number of buckets should be increased
  */
@@ -247,6 +259,32 @@ void hash_resize(struct hash_table *ht, uint64_t page, void *new)
 	ht->ghost = (void *)((char *)new + GHOST_OFFSET(page));
 	for (uint64_t i = 0; i <= ht->mask; i++)
 		hlist_head_init(&ht->buckets[i]);
+	probe(hash_resize_start, ht, ht->old_mask + 1, ht->mask + 1);
+}
+
+/**
+ * hash_bucket_at - Get the @i'th bucket of @ht for walking through the keys
+ * 
+ * @return: the bucket, or NULL if @i is out of range or @ht is under migrating
+ */
+struct hlist_head *hash_bucket_at(struct hash_table *ht, uint64_t i)
+{
+	if (under_migrating(ht) || i > ht->mask)
+		return NULL;
+	return &ht->buckets[i];
+}
+
+/**
+ * hash_migrate - Evacuate the next old bucket of @ht if it is under migrating
+ * @m: where memory allocated from
+ * 
+ * Note: a migration only moves on with lookups and adds, walkers that can not
+ * wait for them call this
+ */
+void hash_migrate(struct hash_table *ht, struct memory *m)
+{
+	if (under_migrating(ht))
+		evacuate(ht, ht->migrated, m);
 }
 
 bool hash_ghost(const struct hash_table *ht, const unsigned char *key)
@@ -35,12 +35,17 @@ struct hash_table {
 };
 
 bool hash_table_init(struct hash_table *ht, struct memory *m);
+uint64_t key_hash(const unsigned char *key);
+struct hlist_node *__hash_get(struct hash_table *ht, const unsigned char *key,
+					uint64_t hkey, struct memory *m);
 struct hlist_node *hash_get(
 	      struct hash_table *ht, const unsigned char *key, struct memory *m);
 void hash_add(struct hash_table *ht, const unsigned char *key, struct memory *m);
 void hash_del(struct hash_table *ht, const unsigned char *key);
 uint64_t hash_resize_page(struct hash_table *ht);
 void hash_resize(struct hash_table *ht, uint64_t page, void *new);
+struct hlist_head *hash_bucket_at(struct hash_table *ht, uint64_t i);
+void hash_migrate(struct hash_table *ht, struct memory *m);
 bool hash_ghost(const struct hash_table *ht, const unsigned char *key);
 
 #endif
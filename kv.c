@@ -8,6 +8,7 @@ void kv_init(struct kv *kv, const unsigned char *key, uint64_t val_size)
 {
 	hlist_head_init(&kv->borrower_list);
 	kv->enabled = false;
+	kv->replicated = 0;
 	kv->val_size = val_size;
 	memcpy(KV_KEY(kv), key, KEY_SIZE(key));
 }
@@ -75,6 +76,24 @@ int kv_val_to_iovec(struct kv *kv, uint64_t i, struct iovec *iov)
 	return 1;
 }
 
+/**
+ * kv_val_range_to_iovec - Map @n bytes of (@kv->val) to @iov for IO
+ * @i: offset to the beginning of the value
+ */
+int kv_val_range_to_iovec(struct kv *kv, uint64_t i, uint64_t n,
+							struct iovec *iov)
+{
+	int iov_len = kv_val_to_iovec(kv, i, iov);
+	for (int k = 0; k < iov_len; k++) {
+		if (iov[k].iov_len >= n) {
+			iov[k].iov_len = n;
+			return k + 1;
+		}
+		n -= iov[k].iov_len;
+	}
+	return iov_len;
+}
+
 /**
  * kv_copy_val - Copy value from @buffer at most @n bytes
  * 
@@ -98,3 +117,19 @@ int kv_copy_val(struct kv *kv, unsigned char *buffer, uint64_t n)
 	}
 	return n;
 }
+
+/**
+ * kv_copy_val_at - Copy @n bytes from @buffer to (@kv->val) at offset @i
+ * 
+ * Note: caller should make sure the value has enough space
+ */
+void kv_copy_val_at(struct kv *kv, uint64_t i, const unsigned char *buffer,
+								uint64_t n)
+{
+	struct iovec iov[2];
+	int iov_len = kv_val_range_to_iovec(kv, i, n, iov);
+	for (int k = 0; k < iov_len; k++) {
+		memcpy(iov[k].iov_base, buffer, iov[k].iov_len);
+		buffer += iov[k].iov_len;
+	}
+}
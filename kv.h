@@ -26,7 +26,11 @@ struct kv_borrower {
  * @soo: it has a trick involved, see kv_malloc() and kv_is_concat()
  * @borrower_list: the list of kv_borrower
  * @lru: kv is on lru and is ready to serve command GET if enabled
+ * @replicated: the value is replicated to other threads, see CONFIG_REPLICA
  * @val_size: value size
+ * @epoch: flush epoch the key is locked at, see CONFIG_NAMESPACE
+ * @ns: namespace of the key, see CONFIG_NAMESPACE
+ * @etag: changes whenever the value changes, see CONFIG_ETAG
  * @hash_node: resides in a hash_table if enabled
  * @data: data of key and value
  */
@@ -39,7 +43,15 @@ struct kv {
 	};
 
 	uint64_t on_s_lru : 1;
-	uint64_t val_size : 63;
+	uint64_t replicated : 1;
+	uint64_t val_size : 62;
+#ifdef CONFIG_NAMESPACE
+	uint32_t epoch;
+	uint32_t ns;
+#endif
+#ifdef CONFIG_ETAG
+	uint64_t etag;
+#endif
 
 	struct hlist_node hash_node;
 	unsigned char data[];
@@ -64,6 +76,10 @@ bool kv_is_concat(struct kv *kv);
 void kv_borrower_init(struct kv_borrower *borrower);
 bool kv_no_borrower(struct kv *kv);
 int kv_val_to_iovec(struct kv *kv, uint64_t i, struct iovec *iov);
+int kv_val_range_to_iovec(struct kv *kv, uint64_t i, uint64_t n,
+							struct iovec *iov);
 int kv_copy_val(struct kv *kv, unsigned char *buffer, uint64_t n);
+void kv_copy_val_at(struct kv *kv, uint64_t i, const unsigned char *buffer,
+								uint64_t n);
 
 #endif
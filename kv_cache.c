@@ -1,8 +1,11 @@
 // SPDX-License-Identifier: GPL-2.0-only
 // Copyright (C) 2024-2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
 
+#include <stdio.h>
 #include <string.h>
 #include "kv_cache.h"
+#include "rwonce.h"
+#include "probe.h"
 
 struct slab_obj {
 	uint64_t read_only;
@@ -44,6 +47,10 @@ void kv_cache_init(struct kv_cache *cache, uint16_t obj_size)
 	cache->obj_size = ALIGN_DOWN(slab_size / cache->slab_objects, 8);
 	cache->free_objects = 0;
 	cache->next_free_soo.x = 0;
+	cache->slab_nr = 0;
+#ifdef CONFIG_IO_URING
+	cache->pinned = false;
+#endif
 }
 
 /**
@@ -65,6 +72,8 @@ static bool add_slab(struct kv_cache *cache, struct memory *m)
 			cache->next_free_soo = soo_make(slab, curr);
 		}
 		cache->free_objects = cache->slab_objects;
+		WRITE_ONCE(cache->slab_nr, cache->slab_nr + 1);
+		probe(slab_add, cache->obj_size, cache->slab_nr);
 	}
 	return slab;
 }
@@ -169,18 +178,96 @@ static void __clean_free_list(struct kv_cache *cache, void *rm_slab)
 	}
 }
 
+#ifdef CONFIG_IO_URING
+/* number of slabs reclaimable_slab() checks at most */
+#define RECLAIM_SCAN_SLAB	16
+
 /**
- * reclaim_slab - Reclaim one slab from @cache
+ * obj_pinned - Check if @obj is borrowed, io_uring may be reading or writing
+ * it asynchronously, so it can't be migrated
  */
-static void reclaim_slab(struct kv_cache *cache, struct memory *m)
+static bool obj_pinned(void *obj)
 {
-	void *rm_slab = soo_slab(__pop_free_soo(cache));
-	__clear_slab(cache, rm_slab);
-	__clean_free_list(cache, rm_slab);
+	struct kv *kv = obj;
+	if ((void *)(*(unsigned long *)obj & ~7) != obj) {
+		struct concat_val *val = obj;
+		/* @soo_ptr points to (struct kv)->soo, see kv_malloc() */
+		kv = (struct kv *)val->soo_ptr;
+	}
+	return !hlist_empty(&kv->borrower_list);
+}
+
+static bool slab_pinned(struct kv_cache *cache, void *slab)
+{
+	struct slab_obj *curr, *temp;
+	slab_obj_for_each(cache, slab, curr, temp) {
+		if (!is_free_obj(curr) && obj_pinned(curr))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * reclaimable_slab - Find a slab with free objects and no pinned object
+ * @pinned: a slab known to have pinned objects
+ * 
+ * @return: the slab, or NULL if there is none in the first RECLAIM_SCAN_SLAB
+ * slabs of the free list
+ * 
+ * Note: the free list is not grouped by slab, slabs checked are remembered so
+ * that each of them is checked once.
+ */
+static void *reclaimable_slab(struct kv_cache *cache, void *pinned)
+{
+	void *checked[RECLAIM_SCAN_SLAB] = { pinned };
+	int n = 1;
+	struct slab_obj_offset soo;
+	for (soo = cache->next_free_soo; soo.x != 0; soo = free_soo_next(soo)) {
+		void *slab = soo_slab(soo);
+		int i = 0;
+		while (i < n && checked[i] != slab)
+			i++;
+		if (i < n)
+			continue;
+
+		if (!slab_pinned(cache, slab))
+			return slab;
+		checked[n++] = slab;
+		if (n == RECLAIM_SCAN_SLAB)
+			break;
+	}
+	return NULL;
+}
+#endif
+
+/**
+ * reclaim_slab - Reclaim @slab from @cache, or another slab if @slab has pinned
+ * objects (only if build with IO_URING)
+ * 
+ * Note: once no slab can be reclaimed for pinned objects, the free list is not
+ * scanned again until a slab is reclaimed, only the slabs of objects freed or
+ * unpinned since are tried, see kv_cache_unpin().
+ */
+static void reclaim_slab(struct kv_cache *cache, struct memory *m, void *slab)
+{
+#ifdef CONFIG_IO_URING
+	if (slab_pinned(cache, slab)) {
+		slab = cache->pinned ? NULL : reclaimable_slab(cache, slab);
+		if (slab == NULL) {
+			cache->pinned = true;
+			return;
+		}
+	}
+	cache->pinned = false;
+#endif
+	__clear_slab(cache, slab);
+	__clean_free_list(cache, slab);
 
-	memory_free(m, rm_slab, cache->slab_page);
-	assert(cache->free_objects == (cache->slab_objects << 1));
-	cache->free_objects = cache->slab_objects;
+	memory_free(m, slab, cache->slab_page);
+	assert(cache->free_objects >= ((uint32_t)cache->slab_objects << 1));
+	cache->free_objects -= cache->slab_objects;
+	WRITE_ONCE(cache->slab_nr, cache->slab_nr - 1);
+	probe(slab_reclaim, cache->obj_size, cache->slab_nr);
 }
 
 /**
@@ -227,6 +314,102 @@ void kv_cache_free(
 	free_obj_init(SOO_OBJ(soo), cache->next_free_soo);
 	cache->next_free_soo = soo;
 	cache->free_objects++;
-	if (cache->free_objects >= (cache->slab_objects << 1))
-		reclaim_slab(cache, m);
+	if (cache->free_objects >= ((uint32_t)cache->slab_objects << 1))
+		reclaim_slab(cache, m, soo_slab(soo));
+}
+
+#ifdef CONFIG_IO_URING
+/**
+ * kv_cache_unpin - The object of @soo is no longer borrowed, reclaim its slab
+ * if @cache is waiting for pinned slabs
+ */
+void kv_cache_unpin(
+	struct kv_cache *cache, struct slab_obj_offset soo, struct memory *m)
+{
+	if (cache->free_objects >= ((uint32_t)cache->slab_objects << 1))
+		reclaim_slab(cache, m, soo_slab(soo));
+}
+#endif
+
+#define SIZE_TO_IDX_IDX(size)	(((size) + 7 - KV_CACHE_OBJ_SIZE_MIN) >> 3)
+#define KV_CACHE_IDX_LEN	(SIZE_TO_IDX_IDX(KV_CACHE_OBJ_SIZE_MAX) + 1)
+static const unsigned char kv_cache_idx[KV_CACHE_IDX_LEN] = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 
+	18, 19, 20, 21, 22, 23, 24, 25, 25, 26, 26, 27, 27, 28, 28, 29, 29, 30, 
+	30, 30, 31, 31, 31, 32, 32, 33, 33, 34, 34, 35, 35, 35, 36, 36, 37, 37, 
+	37, 38, 38, 38, 38, 39, 39, 39, 39, 40, 40, 40, 40, 41, 41, 41, 41, 41, 
+	42, 42, 42, 42, 42, 43, 43, 43, 44, 44, 44, 44, 45, 45, 45, 45, 46, 46, 
+	46, 46, 47, 47, 47, 47, 48, 48, 48, 48, 48, 49, 49, 49, 49, 49, 50, 50, 
+	50, 50, 50, 50, 51, 51, 51, 51, 51, 51, 51, 52, 52, 52, 52, 52, 52, 52, 
+	52, 53, 53, 53, 53, 53, 53, 53, 53, 54, 54, 54, 54, 54, 55, 55, 55, 55, 
+	55, 56, 56, 56, 56, 56, 57, 57, 57, 57, 57, 57, 58, 58, 58, 58, 58, 58, 
+	59, 59, 59, 59, 59, 59, 59, 60, 60, 60, 60, 60, 60, 60, 60, 61, 61, 61, 
+	61, 61, 61, 61, 61, 62, 62, 62, 62, 62, 62, 62, 62, 62, 63, 63, 63, 63, 
+	63, 63, 63, 63, 63, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 65, 65, 
+	65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 66, 66, 66, 66, 66, 66, 66, 66, 
+	66, 66, 66, 66, 66, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 
+	67, 67, 67, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 
+	68, 68, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 
+	69, 69, 69, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 
+	70, 70, 70, 70, 70, 70, 70, 70, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 
+	71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 72, 72, 
+	72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 
+	72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 73, 73, 73, 73, 73, 73, 73, 
+	73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 
+	73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 74, 74, 74, 74, 74, 74, 
+	74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 
+	74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 
+	74, 74, 74, 74, };
+
+#ifdef DEBUG
+void kv_cache_idx_generate_print()
+{
+	struct kv_cache cache;
+	kv_cache_init(&cache, KV_CACHE_OBJ_SIZE_MIN);
+	int i = 0;
+	printf("{\n\t 0, ");
+	for (unsigned int size = KV_CACHE_OBJ_SIZE_MIN + 8;
+				size <= KV_CACHE_OBJ_SIZE_MAX; size += 8) {
+		if (cache.obj_size < size) {
+			struct kv_cache temp;
+			kv_cache_init(&temp, size);
+			i++;
+			cache = temp;
+		}
+
+		if (SIZE_TO_IDX_IDX(size) % 18 == 0)
+			printf("\n\t%2d, ", i);
+		else
+			printf("%2d, ", i);
+	}
+	printf("}\n\n");
+}
+#endif
+
+void kv_cache_list_init(struct kv_cache kv_cache_list[KV_CACHE_LEN])
+{
+	assert(KV_CACHE_LEN == kv_cache_idx[KV_CACHE_IDX_LEN - 1] + 1);
+
+	kv_cache_init(&kv_cache_list[0], KV_CACHE_OBJ_SIZE_MIN);
+	for (unsigned int i = 1; i < KV_CACHE_IDX_LEN; i++) {
+		if (kv_cache_idx[i] != kv_cache_idx[i - 1]) {
+			uint16_t size = KV_CACHE_OBJ_SIZE_MIN + 8 * i;
+			kv_cache_init(&kv_cache_list[kv_cache_idx[i]], size);
+		}
+	}
+	assert(kv_cache_list[KV_CACHE_LEN - 1].obj_size == KV_CACHE_OBJ_SIZE_MAX);
+}
+
+/**
+ * kv_cache_list_get - Get the kv_cache of @kv_cache_list that manages memory
+ * for objects of size @size bytes
+ */
+struct kv_cache *
+kv_cache_list_get(struct kv_cache kv_cache_list[KV_CACHE_LEN], uint64_t size)
+{
+	struct kv_cache *cache;
+	cache = &kv_cache_list[kv_cache_idx[SIZE_TO_IDX_IDX(size)]];
+	assert(cache->obj_size >= size);
+	assert(cache == kv_cache_list || (cache - 1)->obj_size < size);
+	return cache;
 }
@@ -10,6 +10,9 @@
 #define KV_CACHE_OBJ_SIZE_MIN	(8 + 8)
 #define KV_CACHE_OBJ_SIZE_MAX	SLAB_OBJ_SIZE_MAX
 
+/* number of kv_caches of a thread, see kv_cache_list_init() */
+#define KV_CACHE_LEN	75
+
 /**
  * kv_cache - Manage memory for (struct kv) and (struct concat_val)
  * @slab_page: the number of pages the underlay slab requires
@@ -17,6 +20,8 @@
  * @slab_objects: the number of objects the underlay slab can allocate
  * @free_objects: the number of free objects
  * @next_free_soo: the information of next free object
+ * @slab_nr: the number of slabs, be aware of CACHE_CMD_STATS will read it
+ * @pinned: no slab could be reclaimed for pinned objects, see reclaim_slab()
  * 
  * Note: objects allocated from (struct kv_cache) always 8 bytes aligned
  */
@@ -24,8 +29,12 @@ struct kv_cache {
 	uint16_t slab_page;
 	uint16_t obj_size;
 	uint16_t slab_objects;
-	uint16_t free_objects;
+	uint32_t free_objects;
 	struct slab_obj_offset next_free_soo;
+	uint32_t slab_nr;
+#ifdef CONFIG_IO_URING
+	bool pinned;
+#endif
 };
 
 /* make sure uint16_t will not overflow */
@@ -39,5 +48,15 @@ bool kv_cache_malloc_concat_val(
 struct kv_cache *cache, struct memory *m, struct slab_obj_offset *soo_ptr);
 void kv_cache_free(
 	struct kv_cache *cache, struct slab_obj_offset soo, struct memory *m);
+#ifdef CONFIG_IO_URING
+void kv_cache_unpin(
+	struct kv_cache *cache, struct slab_obj_offset soo, struct memory *m);
+#endif
+void kv_cache_list_init(struct kv_cache kv_cache_list[KV_CACHE_LEN]);
+struct kv_cache *
+kv_cache_list_get(struct kv_cache kv_cache_list[KV_CACHE_LEN], uint64_t size);
+#ifdef DEBUG
+void kv_cache_idx_generate_print();
+#endif
 
 #endif
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_LATENCY_H
+#define __UMEM_CACHE_LATENCY_H
+
+#ifdef CONFIG_LATENCY
+
+#include <stdint.h>
+#include "config.h"
+
+/* histograms of a thread, see README.rst -> CMD-LATENCY for the meanings */
+enum lat_hist {
+	LAT_GET_HIT,
+	LAT_GET_MISS,
+	LAT_GET_BLOCKED,
+	LAT_DEL,
+	LAT_EVICT,
+	LAT_WRITE,
+	LAT_NR,
+} __attribute__((__packed__));
+
+/* the conn is not timed, see (struct conn->lat) */
+#define LAT_NONE	LAT_NR
+
+/* every power of 2 nanoseconds is split into (1 << LAT_SUB_BITS) buckets */
+#define LAT_SUB_BITS	3
+/* latencies of at least (1 << LAT_EXP_MAX) nanoseconds share the last bucket */
+#define LAT_EXP_MAX	36
+#define LAT_BUCKET_NR	((LAT_EXP_MAX - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+/**
+ * latency - Log-linear histograms of a thread, only written by the thread
+ * itself, other threads read them with READ_ONCE()
+ */
+struct latency {
+	uint64_t n[LAT_NR][LAT_BUCKET_NR];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/**
+ * lat_bucket - Get the bucket of latency @ns (in nanoseconds)
+ * 
+ * Latencies below (1 << LAT_SUB_BITS) have a bucket each, the others are
+ * bucketed by the highest LAT_SUB_BITS + 1 bits, so the error of a bucket is
+ * at most 1 / (1 << LAT_SUB_BITS) of the latency.
+ */
+static inline uint32_t lat_bucket(uint64_t ns)
+{
+	if (ns < (1 << LAT_SUB_BITS))
+		return ns;
+	if (ns >= (1ULL << LAT_EXP_MAX))
+		return LAT_BUCKET_NR - 1;
+
+	uint32_t shift = 63 - __builtin_clzll(ns) - LAT_SUB_BITS;
+	return ((shift + 1) << LAT_SUB_BITS) + (ns >> shift) -
+							(1 << LAT_SUB_BITS);
+}
+
+#endif
+
+#endif
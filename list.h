@@ -50,6 +50,14 @@ static inline void list_add(struct list_head *head, struct list_head *new)
 	__list_add(new, head, head->next);
 }
 
+/**
+ * list_add_tail - Add @new before @head
+ */
+static inline void list_add_tail(struct list_head *head, struct list_head *new)
+{
+	__list_add(new, head->prev, head);
+}
+
 /*
  * __list_del - Delete the node between @prev and @next
  */
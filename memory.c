@@ -6,6 +6,7 @@
 #include <assert.h>
 #include "memory.h"
 #include "config.h"
+#include "rwonce.h"
 
 /**
  * memory_init - Initialize @m with @page pages
@@ -55,7 +56,7 @@ void *memory_malloc(struct memory *m, uint64_t page)
 
 	void *ptr = sys_malloc(page);
 	if (ptr)
-		m->free_pages -= page;
+		WRITE_ONCE(m->free_pages, m->free_pages - page);
 	return ptr;
 }
 
@@ -67,5 +68,5 @@ void *memory_malloc(struct memory *m, uint64_t page)
 void memory_free(struct memory *m, void *ptr, uint64_t page)
 {
 	sys_free(ptr, page);
-	m->free_pages += page;
+	WRITE_ONCE(m->free_pages, m->free_pages + page);
 }
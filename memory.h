@@ -8,7 +8,8 @@
 
 /**
  * memory - Memory manager
- * @free_pages: the number of free pages
+ * @free_pages: the number of free pages, be aware of CACHE_CMD_STATS will read
+ * it
  */
 struct memory {
 	uint64_t free_pages;
@@ -0,0 +1,362 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+// Note: umem-cache-microbench runs the hash table, the kv caches and the kv
+// value mapping of the server in isolation, built with the same flags as the
+// server, see README.rst -> BENCHMARK. Every benchmark reports nanoseconds and
+// cache misses per operation, the cache misses are counted by perf_event_open()
+// and are not reported if it is not permitted.
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hash_table.h"
+#include "kv_cache.h"
+#include "config.h"
+
+/* the memory limit of the benchmarks (in pages) */
+#define MICROBENCH_PAGE		(1ULL << 22)
+/* number of kvs kv_val_to_iovec() runs on */
+#define MICROBENCH_KV_NR	1024
+
+/**
+ * entry - A key in the hash table, the key must follow the node
+ */
+struct entry {
+	struct hlist_node node;
+	unsigned char key[1 + 23];
+};
+
+static_assert(offsetof(struct entry, key) == sizeof(struct hlist_node));
+
+static const uint16_t obj_sizes[] = {
+	KV_CACHE_OBJ_SIZE_MIN, 64, 128, 256, 512, 1024, 2048,
+	KV_CACHE_OBJ_SIZE_MAX,
+};
+#define OBJ_SIZE_NR	(sizeof(obj_sizes) / sizeof(obj_sizes[0]))
+
+static uint64_t key_nr = 1000000;
+static uint64_t rand_state = 1;
+static struct memory memory;
+static int perf_fd = -1;
+
+static uint64_t bench_start;
+static uint64_t misses_start;
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "umem-cache-microbench: %s\n", msg);
+	exit(1);
+}
+
+/**
+ * next_rand - Get the next random number, see splitmix64
+ */
+static uint64_t next_rand()
+{
+	uint64_t z = (rand_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static uint64_t now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void perf_init()
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CACHE_MISSES,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+	};
+	perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t perf_misses()
+{
+	uint64_t n = 0;
+	if (perf_fd != -1 && read(perf_fd, &n, sizeof(n)) != sizeof(n))
+		n = 0;
+	return n;
+}
+
+static void bench_begin()
+{
+	misses_start = perf_misses();
+	bench_start = now_ns();
+}
+
+/**
+ * bench_end - Report the benchmark @name of @n operations
+ */
+static void bench_end(const char *name, uint64_t n)
+{
+	uint64_t ns = now_ns() - bench_start;
+	uint64_t misses = perf_misses() - misses_start;
+	printf("%-24s %10lu %10.1f", name, n, (double)ns / n);
+	if (perf_fd != -1)
+		printf(" %12.2f", (double)misses / n);
+	printf("\n");
+}
+
+/**
+ * shuffle - Shuffle @n entries of @a
+ */
+static void shuffle(struct entry **a, uint64_t n)
+{
+	for (uint64_t i = n - 1; i > 0; i--) {
+		uint64_t j = next_rand() % (i + 1);
+		struct entry *temp = a[i];
+		a[i] = a[j];
+		a[j] = temp;
+	}
+}
+
+/**
+ * hash_maybe_resize - Resize @ht the way the server does after a change
+ */
+static void hash_maybe_resize(struct hash_table *ht)
+{
+	uint64_t page = hash_resize_page(ht);
+	if (page > 0) {
+		void *new = memory_malloc(&memory, page);
+		if (new)
+			hash_resize(ht, page, new);
+	}
+}
+
+/**
+ * bench_hash_table - Benchmark the hash table with @key_nr keys in it, and as
+ * many keys that are not
+ */
+static void bench_hash_table()
+{
+	struct entry *entries = malloc(2 * key_nr * sizeof(*entries));
+	struct entry **in = malloc(key_nr * sizeof(*in));
+	struct entry **out = malloc(key_nr * sizeof(*out));
+	struct hash_table ht;
+	if (entries == NULL || in == NULL || out == NULL ||
+	    !hash_table_init(&ht, &memory))
+		die("out of memory");
+
+	for (uint64_t i = 0; i < 2 * key_nr; i++)
+		entries[i].key[0] = sprintf((char *)entries[i].key + 1,
+							"key:%lu", i);
+	for (uint64_t i = 0; i < key_nr; i++) {
+		in[i] = &entries[i];
+		out[i] = &entries[key_nr + i];
+	}
+	shuffle(in, key_nr);
+
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++) {
+		hash_add(&ht, in[i]->key, &memory);
+		hash_maybe_resize(&ht);
+	}
+	bench_end("hash-add-grow", key_nr);
+
+	shuffle(in, key_nr);
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++)
+		if (hash_get(&ht, in[i]->key, &memory) != &in[i]->node)
+			die("hash_get() missed");
+	bench_end("hash-get-hit", key_nr);
+
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++)
+		if (hash_get(&ht, out[i]->key, &memory) != NULL)
+			die("hash_get() hit");
+	bench_end("hash-get-miss", key_nr);
+
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++) {
+		uint64_t j = next_rand() % key_nr;
+		hash_del(&ht, in[j]->key);
+		hash_add(&ht, out[i]->key, &memory);
+		struct entry *temp = in[j];
+		in[j] = out[i];
+		out[i] = temp;
+	}
+	bench_end("hash-del-add-churn", key_nr);
+
+	bench_begin();
+	uint64_t ghosts = 0;
+	for (uint64_t i = 0; i < key_nr; i++)
+		ghosts += hash_ghost(&ht, out[i]->key);
+	bench_end("hash-ghost", key_nr);
+	if (ghosts > key_nr)
+		die("hash_ghost() broken");
+
+	shuffle(in, key_nr);
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++) {
+		hash_del(&ht, in[i]->key);
+		hash_maybe_resize(&ht);
+	}
+	bench_end("hash-del-shrink", key_nr);
+
+	free(entries);
+	free(in);
+	free(out);
+}
+
+/**
+ * bench_kv_cache - Benchmark the kv caches with @key_nr objects of mixed sizes
+ * 
+ * The objects are allocated as concat values of @kvs, so that they can be
+ * migrated when a slab is reclaimed.
+ */
+static void bench_kv_cache()
+{
+	struct kv_cache caches[OBJ_SIZE_NR];
+	struct kv *kvs = malloc(key_nr * sizeof(*kvs));
+	uint8_t *cache_of = malloc(key_nr);
+	if (kvs == NULL || cache_of == NULL)
+		die("out of memory");
+	for (uint64_t i = 0; i < key_nr; i++)
+		hlist_head_init(&kvs[i].borrower_list);
+	for (uint64_t i = 0; i < OBJ_SIZE_NR; i++)
+		kv_cache_init(&caches[i], obj_sizes[i]);
+
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++) {
+		cache_of[i] = next_rand() % OBJ_SIZE_NR;
+		if (!kv_cache_malloc_concat_val(&caches[cache_of[i]], &memory,
+								&kvs[i].soo))
+			die("out of memory");
+	}
+	bench_end("kv-cache-malloc", key_nr);
+
+	/* frees leave holes, a slab is reclaimed when a cache has two of
+	them free, which migrates the objects left in it */
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++) {
+		uint64_t j = next_rand() % key_nr;
+		kv_cache_free(&caches[cache_of[j]], kvs[j].soo, &memory);
+		cache_of[j] = next_rand() % OBJ_SIZE_NR;
+		if (!kv_cache_malloc_concat_val(&caches[cache_of[j]], &memory,
+								&kvs[j].soo))
+			die("out of memory");
+	}
+	bench_end("kv-cache-free-malloc", key_nr);
+
+	uint64_t *order = malloc(key_nr * sizeof(*order));
+	if (order == NULL)
+		die("out of memory");
+	for (uint64_t i = 0; i < key_nr; i++)
+		order[i] = i;
+	for (uint64_t i = key_nr - 1; i > 0; i--) {
+		uint64_t j = next_rand() % (i + 1);
+		uint64_t temp = order[i];
+		order[i] = order[j];
+		order[j] = temp;
+	}
+
+	bench_begin();
+	for (uint64_t i = 0; i < key_nr; i++) {
+		uint64_t j = order[i];
+		kv_cache_free(&caches[cache_of[j]], kvs[j].soo, &memory);
+	}
+	bench_end("kv-cache-free-migrate", key_nr);
+
+	free(order);
+	free(kvs);
+	free(cache_of);
+}
+
+/**
+ * kv_alloc - Allocate a kv of @key and a value of @val_size bytes the way the
+ * server does, from @caches or pages
+ */
+static struct kv *kv_alloc(struct kv_cache *caches, const unsigned char *key,
+							uint64_t val_size)
+{
+	uint64_t size = sizeof(struct kv) + KEY_SIZE(key) + val_size;
+	struct kv *kv;
+	if (size <= KV_CACHE_OBJ_SIZE_MAX) {
+		kv = kv_cache_malloc_kv(&caches[OBJ_SIZE_NR - 1], &memory);
+	} else {
+		unsigned int overflow = size & PAGE_MASK;
+		if (overflow == 0 || overflow + 8 > KV_CACHE_OBJ_SIZE_MAX) {
+			kv = memory_malloc(&memory, (size + PAGE_MASK) >> PAGE_SHIFT);
+			if (kv)
+				kv->soo = SOO_MAKE(kv, 0);
+		} else {
+			kv = memory_malloc(&memory, size >> PAGE_SHIFT);
+			if (kv && !kv_cache_malloc_concat_val(
+				&caches[OBJ_SIZE_NR - 1], &memory, &kv->soo))
+				kv = NULL;
+		}
+	}
+	if (kv == NULL)
+		die("out of memory");
+	kv_init(kv, key, val_size);
+	return kv;
+}
+
+/**
+ * bench_kv_val_to_iovec - Benchmark mapping values of small, paged and
+ * concatenated kvs to iovecs at random offsets
+ */
+static void bench_kv_val_to_iovec()
+{
+	struct kv_cache caches[OBJ_SIZE_NR];
+	struct kv *kvs[MICROBENCH_KV_NR];
+	unsigned char key[] = "\x04key!";
+	for (uint64_t i = 0; i < OBJ_SIZE_NR; i++)
+		kv_cache_init(&caches[i], obj_sizes[i]);
+	for (int i = 0; i < MICROBENCH_KV_NR; i++)
+		kvs[i] = kv_alloc(caches, key, 1 + next_rand() % (3 << PAGE_SHIFT));
+
+	bench_begin();
+	uint64_t bytes = 0;
+	for (uint64_t i = 0; i < key_nr; i++) {
+		struct kv *kv = kvs[i % MICROBENCH_KV_NR];
+		struct iovec iov[2];
+		int n = kv_val_to_iovec(kv, next_rand() % kv->val_size, iov);
+		for (int k = 0; k < n; k++)
+			bytes += iov[k].iov_len;
+	}
+	bench_end("kv-val-to-iovec", key_nr);
+	if (bytes == 0)
+		die("kv_val_to_iovec() broken");
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			key_nr = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			rand_state = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			die("usage: umem-cache-microbench [-n key-nr] [-s seed]");
+		}
+	}
+	if (key_nr < 2)
+		die("usage: umem-cache-microbench [-n key-nr] [-s seed]");
+
+	memory_init(&memory, MICROBENCH_PAGE);
+	perf_init();
+	printf("%-24s %10s %10s%s\n", "benchmark", "ops", "ns/op",
+	       perf_fd != -1 ? "    misses/op" : "");
+	bench_hash_table();
+	bench_kv_cache();
+	bench_kv_val_to_iovec();
+	return 0;
+}
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+// Note: this is the fixed-size variant of SHARDS (Waldspurger et al., FAST'15),
+// a key is sampled by its hash so that all GETs of a sampled key are seen, the
+// sampled keys run through a miniature LRU cache, and a reuse distance is
+// scaled up by the sampling rate. When there are too many sampled keys, the
+// sampling rate is halved and the keys that are no longer sampled are dropped.
+
+#include <stdbool.h>
+#include <string.h>
+#include "mrc.h"
+#include "rwonce.h"
+
+#define MRC_SLOT_MASK	(MRC_SLOT_NR - 1)
+
+static_assert((MRC_SLOT_NR & MRC_SLOT_MASK) == 0);
+static_assert(MRC_OBJ_MAX < MRC_SLOT_NR && MRC_OBJ_MAX < MRC_TIME_MAX);
+
+/**
+ * sampled - Check if the key of @hash is sampled by @mrc
+ */
+static bool sampled(const struct mrc *mrc, uint64_t hash)
+{
+	return hash >> (64 - mrc->shift) == 0;
+}
+
+/**
+ * tree_add - Add @delta to the size accessed at @time
+ */
+static void tree_add(struct mrc *mrc, uint32_t time, uint64_t delta)
+{
+	for (; time <= MRC_TIME_MAX; time += time & -time)
+		mrc->tree[time] += delta;
+}
+
+/**
+ * tree_sum - Sum up the sizes accessed at or before @time
+ */
+static uint64_t tree_sum(const struct mrc *mrc, uint32_t time)
+{
+	uint64_t sum = 0;
+	for (; time > 0; time -= time & -time)
+		sum += mrc->tree[time];
+	return sum;
+}
+
+/**
+ * obj_find - Find the slot of @hash
+ * 
+ * @return: the slot of @hash, or the empty slot to insert @hash
+ */
+static uint32_t obj_find(const struct mrc *mrc, uint64_t hash)
+{
+	uint32_t i = hash & MRC_SLOT_MASK;
+	while (mrc->objs[i].time != 0 && mrc->objs[i].hash != hash)
+		i = (i + 1) & MRC_SLOT_MASK;
+	return i;
+}
+
+/**
+ * obj_del - Delete the key in slot @i, the keys after it are shifted back so
+ * that no tombstone is required
+ */
+static void obj_del(struct mrc *mrc, uint32_t i)
+{
+	struct mrc_obj *obj = &mrc->objs[i];
+	tree_add(mrc, obj->time, -obj->size);
+	mrc->time_obj[obj->time] = -1;
+	mrc->total -= obj->size;
+	mrc->nr--;
+
+	uint32_t j = i;
+	for (;;) {
+		j = (j + 1) & MRC_SLOT_MASK;
+		struct mrc_obj *next = &mrc->objs[j];
+		if (next->time == 0)
+			break;
+
+		/* move it back unless its home slot is in (i, j] */
+		uint32_t home = next->hash & MRC_SLOT_MASK;
+		if (((j - home) & MRC_SLOT_MASK) >= ((j - i) & MRC_SLOT_MASK)) {
+			mrc->objs[i] = *next;
+			mrc->time_obj[next->time] = i;
+			i = j;
+		}
+	}
+	mrc->objs[i].time = 0;
+}
+
+/**
+ * downsample - Halve the sampling rate until there is room for a key
+ */
+static void downsample(struct mrc *mrc)
+{
+	while (mrc->nr >= MRC_OBJ_MAX && mrc->shift < 63) {
+		mrc->shift++;
+		for (uint32_t time = 1; time <= mrc->now; time++) {
+			int32_t i = mrc->time_obj[time];
+			if (i >= 0 && !sampled(mrc, mrc->objs[i].hash))
+				obj_del(mrc, i);
+		}
+	}
+}
+
+/**
+ * compact - Renumber the access times of the keys from 1 without changing
+ * their order, and rebuild the Fenwick tree
+ */
+static void compact(struct mrc *mrc)
+{
+	uint32_t now = 0;
+	memset(mrc->tree, 0, sizeof(mrc->tree));
+	for (uint32_t time = 1; time <= mrc->now; time++) {
+		int32_t i = mrc->time_obj[time];
+		if (i < 0)
+			continue;
+		mrc->time_obj[++now] = i;
+		mrc->objs[i].time = now;
+		mrc->tree[now] = mrc->objs[i].size;
+	}
+	for (uint32_t time = now + 1; time <= mrc->now; time++)
+		mrc->time_obj[time] = -1;
+	mrc->now = now;
+
+	for (uint32_t time = 1; time <= MRC_TIME_MAX; time++) {
+		uint32_t parent = time + (time & -time);
+		if (parent <= MRC_TIME_MAX)
+			mrc->tree[parent] += mrc->tree[time];
+	}
+}
+
+/**
+ * obj_access - Access the sampled key of @hash in slot @i, which is inserted
+ * if it is not there
+ * @size: size of the kv, 0 if it is unknown
+ */
+static void obj_access(struct mrc *mrc, uint32_t i, uint64_t hash, uint64_t size)
+{
+	struct mrc_obj *obj = &mrc->objs[i];
+	if (obj->time == 0) {
+		if (mrc->nr >= MRC_OBJ_MAX) {
+			downsample(mrc);
+			if (!sampled(mrc, hash) || mrc->nr >= MRC_OBJ_MAX)
+				return;
+			obj = &mrc->objs[obj_find(mrc, hash)];
+		}
+		obj->hash = hash;
+		obj->size = 0;
+		mrc->nr++;
+	}
+
+	if (mrc->now == MRC_TIME_MAX)
+		compact(mrc);
+	if (obj->time != 0) {
+		tree_add(mrc, obj->time, -obj->size);
+		mrc->time_obj[obj->time] = -1;
+	}
+	if (size != 0) {
+		mrc->total += size - obj->size;
+		obj->size = size;
+	}
+	obj->time = ++mrc->now;
+	mrc->time_obj[obj->time] = obj - mrc->objs;
+	tree_add(mrc, obj->time, obj->size);
+}
+
+/**
+ * decay - Halve the counters, so that the curve follows the recent workload
+ */
+static void decay(struct mrc *mrc)
+{
+	mrc->sampled = 0;
+	WRITE_ONCE(mrc->refs, mrc->refs / 2);
+	for (int i = 0; i < MRC_POINT_NR; i++)
+		WRITE_ONCE(mrc->hits[i], mrc->hits[i] / 2);
+}
+
+void mrc_init(struct mrc *mrc)
+{
+	memset(mrc, 0, sizeof(*mrc));
+	memset(mrc->time_obj, -1, sizeof(mrc->time_obj));
+	mrc->shift = MRC_SHIFT_MIN;
+}
+
+/**
+ * mrc_get - Count a GET of the key of @hash
+ * @size: size of the kv, 0 if the GET misses
+ * 
+ * Note: a reuse of a key hits in a cache of at least its reuse distance, which
+ * is the sum of the sizes of the keys accessed since its last access, itself
+ * included.
+ */
+void mrc_get(struct mrc *mrc, uint64_t hash, uint64_t size)
+{
+	if (!sampled(mrc, hash))
+		return;
+
+	uint64_t weight = 1ULL << mrc->shift;
+	WRITE_ONCE(mrc->refs, mrc->refs + weight);
+	uint32_t i = obj_find(mrc, hash);
+	struct mrc_obj *obj = &mrc->objs[i];
+	if (obj->time != 0) {
+		uint64_t dist = mrc->total - tree_sum(mrc, obj->time - 1);
+		if (size != 0)
+			dist += size - obj->size;
+		unsigned __int128 point = 0;
+		if (dist != 0)
+			point = (((unsigned __int128)dist << mrc->shift) - 1) /
+								MRC_STEP;
+		if (point < MRC_POINT_NR)
+			WRITE_ONCE(mrc->hits[point], mrc->hits[point] + weight);
+	}
+	obj_access(mrc, i, hash, size);
+
+	if (++mrc->sampled == MRC_DECAY)
+		decay(mrc);
+}
+
+/**
+ * mrc_set - Count a SET of the key of @hash, whose kv is of @size
+ */
+void mrc_set(struct mrc *mrc, uint64_t hash, uint64_t size)
+{
+	if (sampled(mrc, hash))
+		obj_access(mrc, obj_find(mrc, hash), hash, size);
+}
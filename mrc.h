@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_MRC_H
+#define __UMEM_CACHE_MRC_H
+
+#ifdef CONFIG_MRC
+
+#include <stdint.h>
+#include "config.h"
+
+/* number of sampled keys a thread simulates (at most) */
+#define MRC_OBJ_MAX	8192
+/* number of slots of (struct mrc->objs), power of 2 */
+#define MRC_SLOT_NR	(MRC_OBJ_MAX * 2)
+/* the access times are compacted when they reach this */
+#define MRC_TIME_MAX	(MRC_OBJ_MAX * 2)
+/* one of every (1 << MRC_SHIFT_MIN) keys is sampled at start */
+#define MRC_SHIFT_MIN	6
+/* number of cache sizes the hit ratio curve is estimated at */
+#define MRC_POINT_NR	64
+/* the points are this far apart (in bytes of a thread), the last one is 4
+ * times of the memory limit */
+#define MRC_STEP	((uint64_t)CONFIG_MEM_LIMIT / CONFIG_THREAD_NR / 16 ?: 1)
+/* the counters are halved every this many sampled GETs */
+#define MRC_DECAY	(1 << 20)
+
+/**
+ * mrc_obj - A sampled key
+ * @hash: hash of the key
+ * @size: size of the kv, 0 if it is unknown yet
+ * @time: when it is accessed last time, 0 if the slot is empty
+ */
+struct mrc_obj {
+	uint64_t hash;
+	uint64_t size;
+	uint32_t time;
+};
+
+/**
+ * mrc - A miniature LRU cache simulated on the sampled keys of a thread, which
+ * estimates the hit ratio curve of the thread by the SHARDS algorithm
+ * @shift: a key is sampled if its highest @shift bits of hash are all 0, and
+ * it stands for (1 << @shift) keys
+ * @nr: number of keys in @objs
+ * @now: the last access time
+ * @sampled: number of sampled GETs since the last decay, see MRC_DECAY
+ * @total: sum of the sizes in @objs
+ * @refs: estimated number of GETs, other threads read it
+ * @hits: estimated number of GETs that hit if the cache size were between
+ * the (@i - 1)'th and the @i'th point, other threads read them
+ * @objs: the sampled keys, an open addressing hash table
+ * @time_obj: the slot in @objs of each access time, -1 if the time is stale
+ * @tree: a Fenwick tree of the sizes of @objs indexed by access time
+ * 
+ * Note: @refs and @hits are only written by the thread itself with
+ * WRITE_ONCE(), other threads read them with READ_ONCE().
+ */
+struct mrc {
+	uint32_t shift;
+	uint32_t nr;
+	uint32_t now;
+	uint32_t sampled;
+	uint64_t total;
+	uint64_t refs __attribute__((aligned(CACHE_LINE_SIZE)));
+	uint64_t hits[MRC_POINT_NR];
+	struct mrc_obj objs[MRC_SLOT_NR] __attribute__((aligned(CACHE_LINE_SIZE)));
+	int32_t time_obj[MRC_TIME_MAX + 1];
+	uint64_t tree[MRC_TIME_MAX + 1];
+};
+
+void mrc_init(struct mrc *mrc);
+void mrc_get(struct mrc *mrc, uint64_t hash, uint64_t size);
+void mrc_set(struct mrc *mrc, uint64_t hash, uint64_t size);
+
+#endif
+
+#endif
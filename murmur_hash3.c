@@ -7,6 +7,7 @@
 // compile and run any of them on any platform, but your performance with the
 // non-native version will be less than optimal.
 
+#include <string.h>
 #include "murmur_hash3.h"
 
 #define	FORCE_INLINE inline __attribute__((always_inline))
@@ -26,7 +27,10 @@ static inline uint64_t rotl64 ( uint64_t x, int8_t r )
 
 FORCE_INLINE uint64_t getblock64 ( const uint64_t * p, int i )
 {
-  return p[i];
+  // keys follow their 1-byte size, so the blocks are rarely aligned
+  uint64_t block;
+  memcpy(&block, p + i, sizeof(block));
+  return block;
 }
 
 //-----------------------------------------------------------------------------
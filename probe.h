@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_PROBE_H
+#define __UMEM_CACHE_PROBE_H
+
+// Note: USDT probes for bpftrace and the like, see README.rst -> USDT PROBES.
+// A probe is a nop whose address and arguments are recorded in the
+// .note.stapsdt section, in the format of <sys/sdt.h>, which is not required to
+// build. Every argument is passed as an 8-byte integer, the probes cost nothing
+// but the nop and the arguments in registers, and nothing at all if the server
+// is built without USDT.
+
+#include <stdint.h>
+
+/* the provider of the probes, as in usdt:./umem-cache:umem_cache:cmd */
+#define PROBE_PROVIDER	umem_cache
+
+#ifdef CONFIG_USDT
+
+#define __PROBE_STR(x)	#x
+#define PROBE_STR(x)	__PROBE_STR(x)
+
+#define __PROBE_NARGS(_1, _2, _3, _4, _5, n, ...)	n
+#define PROBE_NARGS(...)	__PROBE_NARGS(__VA_ARGS__, 5, 4, 3, 2, 1)
+
+#define PROBE_ARGS1	"8@%0"
+#define PROBE_ARGS2	PROBE_ARGS1 " 8@%1"
+#define PROBE_ARGS3	PROBE_ARGS2 " 8@%2"
+#define PROBE_ARGS4	PROBE_ARGS3 " 8@%3"
+#define PROBE_ARGS5	PROBE_ARGS4 " 8@%4"
+
+#define PROBE_OP(x)	"nor" ((uint64_t)(x))
+#define PROBE_OPS1(a)			PROBE_OP(a)
+#define PROBE_OPS2(a, b)		PROBE_OPS1(a), PROBE_OP(b)
+#define PROBE_OPS3(a, b, c)		PROBE_OPS2(a, b), PROBE_OP(c)
+#define PROBE_OPS4(a, b, c, d)		PROBE_OPS3(a, b, c), PROBE_OP(d)
+#define PROBE_OPS5(a, b, c, d, e)	PROBE_OPS4(a, b, c, d), PROBE_OP(e)
+
+/* the note is (provider, name, arguments), _.stapsdt.base lets the tools find
+ * the probes of a relocated binary */
+#define __probe(name, n, ...)						       \
+	__asm__ __volatile__ (						       \
+		"990:	nop\n"						       \
+		".pushsection .note.stapsdt,\"?\",\"note\"\n"		       \
+		".balign 4\n"						       \
+		".4byte 992f-991f, 994f-993f, 3\n"			       \
+		"991:	.asciz \"stapsdt\"\n"				       \
+		"992:	.balign 4\n"					       \
+		"993:	.8byte 990b\n"					       \
+		".8byte _.stapsdt.base\n"				       \
+		".8byte 0\n"						       \
+		".asciz \"" PROBE_STR(PROBE_PROVIDER) "\"\n"		       \
+		".asciz \"" #name "\"\n"				       \
+		".asciz \"" PROBE_ARGS##n "\"\n"			       \
+		"994:	.balign 4\n"					       \
+		".popsection\n"						       \
+		".ifndef _.stapsdt.base\n"				       \
+		".pushsection .stapsdt.base,\"aG\",\"progbits\","	       \
+						".stapsdt.base,comdat\n"       \
+		".weak _.stapsdt.base\n"				       \
+		".hidden _.stapsdt.base\n"				       \
+		"_.stapsdt.base: .space 1\n"				       \
+		".size _.stapsdt.base, 1\n"				       \
+		".popsection\n"						       \
+		".endif\n"						       \
+		:: PROBE_OPS##n(__VA_ARGS__))
+#define _probe(name, n, ...)	__probe(name, n, __VA_ARGS__)
+
+/**
+ * probe - Fire the USDT probe @name with 1 to 5 integer or pointer arguments
+ */
+#define probe(name, ...)	_probe(name, PROBE_NARGS(__VA_ARGS__), __VA_ARGS__)
+
+#else
+
+#define probe(name, ...)	({})
+
+#endif
+
+#endif
@@ -99,6 +99,8 @@ void raft_conn_free(struct raft_conn *conn)
 		raft_conn_return_log(conn);
 	else if (conn->state > RAFT_CONN_STATE_AUTHORITY_DIVIDER)
 		list_del(&conn->authority);
+	else if (conn->state == RAFT_CONN_STATE_REPLY_OUT)
+		free(conn->reply);
 #ifdef CONFIG_KERNEL_TLS
 	else if (conn->state < RAFT_CONN_STATE_TLS_SERVER_DIVIDER)
 		tls_deinit(&conn->session);
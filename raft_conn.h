@@ -44,9 +44,12 @@ enum raft_conn_state {
 	RAFT_CONN_STATE_INIT_CLUSTER_IN		= (23 << 3) + EPOLLIN  + EPOLLLOG,
 	RAFT_CONN_STATE_CHANGE_CLUSTER_IN	= (24 << 3) + EPOLLIN  + EPOLLLOG,
 
-	RAFT_CONN_STATE_AUTHORITY_DIVIDER	= (25 << 3) + 0,
-	RAFT_CONN_STATE_AUTHORITY_PENDING	= (26 << 3) + EPOLLIN,
-	RAFT_CONN_STATE_AUTHORITY_OUT		= (27 << 3) + EPOLLOUT,
+	RAFT_CONN_STATE_REPLY_OUT		= (25 << 3) + EPOLLOUT,
+	RAFT_CONN_STATE_SUCCESS_OUT		= (26 << 3) + EPOLLOUT,
+
+	RAFT_CONN_STATE_AUTHORITY_DIVIDER	= (27 << 3) + 0,
+	RAFT_CONN_STATE_AUTHORITY_PENDING	= (28 << 3) + EPOLLIN,
+	RAFT_CONN_STATE_AUTHORITY_OUT		= (29 << 3) + EPOLLOUT,
 } __attribute__((__packed__));
 
 struct raft_conn {
@@ -65,6 +68,12 @@ struct raft_conn {
 		struct leader_res leader_res;
 		struct cluster_res cluster_res;
 		struct connect_req connect_req;
+		struct small_ratio_req small_ratio_req;
+		/* see RAFT_CONN_STATE_REPLY_OUT */
+		struct {
+			unsigned char *reply;
+			uint64_t reply_size;
+		};
 		unsigned char buffer[RAFT_CONN_BUFFER_SIZE];
 		struct {
 			struct authority_approval authority_approval;
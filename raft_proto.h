@@ -20,6 +20,13 @@ enum raft_cmd {
 	RAFT_CMD_CLUSTER,
 	RAFT_CMD_CONNECT,
 	RAFT_CMD_AUTHORITY,
+	/* admin only, they follow the divider to keep the command codes */
+	RAFT_CMD_STATS,
+	RAFT_CMD_LATENCY,
+	RAFT_CMD_LATENCY_RESET,
+	RAFT_CMD_TOP_KEYS,
+	RAFT_CMD_MRC,
+	RAFT_CMD_SMALL_RATIO,
 } __attribute__((__packed__));
 
 static_assert(sizeof(enum raft_cmd) == 1);
@@ -85,6 +92,11 @@ struct connect_req {
 	uint32_t thread_id;
 } __attribute__((aligned(4)));
 
+struct small_ratio_req {
+	enum raft_cmd cmd;
+	uint16_t ratio;
+} __attribute__((aligned(2)));
+
 struct authority_approval {
 	uint64_t version;
 	uint64_t count;
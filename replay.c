@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+// Note: umem-cache-replay replays the trace files of a server built with TRACE
+// against a server built without RAFT, see README.rst -> REQUEST TRACE. Keys
+// are made up by trace_make_key(). The requests are replayed in the order of
+// their time by a thread per server thread, a GET that misses sets the value,
+// so a replayed server sees the same requests as the traced one did, with the
+// same value sizes as far as they are known.
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "trace.h"
+#include "client.h"
+#include "config.h"
+
+/**
+ * worker - A replaying thread
+ * @fd: connection to the server thread of the same index
+ * @ops: the records dispatched to @id, in the order of time
+ * @nr: number of @ops
+ * @lat: latency of each op (in nanoseconds)
+ * @gets: number of GETs replayed
+ * @hits: number of GETs that hit
+ * @lag: how far the ops fall behind the trace at most (in nanoseconds)
+ */
+struct worker {
+	pthread_t tid;
+	int fd;
+	struct trace_record **ops;
+	uint64_t nr;
+	uint64_t *lat;
+	uint64_t gets;
+	uint64_t hits;
+	uint64_t lag;
+};
+
+static double speed = 1;
+static uint64_t trace_start;
+static uint64_t replay_start;
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "umem-cache-replay: %s\n", msg);
+	exit(1);
+}
+
+static void usage()
+{
+	die("usage: umem-cache-replay [-t thread-nr] [-s speed] {{port}} {{trace-file}}...");
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	unsigned char key[1 + CONFIG_KEY_SIZE_MAX];
+	for (uint64_t i = 0; i < w->nr; i++) {
+		struct trace_record *r = w->ops[i];
+		uint64_t now = client_now_ns();
+		if (speed > 0) {
+			uint64_t at = replay_start +
+				      (uint64_t)((r->time - trace_start) / speed);
+			if (at > now) {
+				struct timespec ts = {
+					at / 1000000000ULL, at % 1000000000ULL
+				};
+				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+								&ts, NULL);
+				now = client_now_ns();
+			} else if (now - at > w->lag) {
+				w->lag = now - at;
+			}
+		}
+
+		trace_make_key(r, key);
+		bool ok = true;
+		switch (r->op) {
+		case TRACE_GET:;
+			enum client_res res = client_get_or_set(w->fd, key,
+								r->val_size);
+			ok = res != CLIENT_ERROR;
+			w->gets++;
+			w->hits += res == CLIENT_HIT;
+			break;
+		case TRACE_SET:
+			ok = client_set(w->fd, key, r->val_size);
+			break;
+		case TRACE_DEL:
+			ok = client_del(w->fd, key);
+			break;
+		default:
+			break;
+		}
+		if (!ok)
+			die("connection lost");
+		w->lat[i] = client_now_ns() - now;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t thread_nr = CONFIG_THREAD_NR;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			thread_nr = atoi(optarg);
+			break;
+		case 's':
+			speed = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind < 2 || thread_nr == 0 || speed < 0)
+		usage();
+	int port = atoi(argv[optind]);
+
+	struct trace_record *records = NULL;
+	uint64_t nr = 0;
+	for (int i = optind + 1; i < argc; i++)
+		if (!trace_load(argv[i], &records, &nr))
+			die("failed to load the trace file");
+	if (nr == 0)
+		die("no records");
+	if (!trace_prepare(records, nr))
+		die("out of memory");
+	trace_start = records[0].time;
+
+	/* FILL records are replayed by the GETs that miss */
+	uint64_t trace_gets = 0, trace_hits = 0;
+	struct worker *workers = calloc(thread_nr, sizeof(*workers));
+	struct trace_record **ops = malloc(nr * sizeof(*ops));
+	uint64_t *lat = malloc(nr * sizeof(*lat));
+	uint32_t *owner = malloc(nr * sizeof(*owner));
+	if (workers == NULL || ops == NULL || lat == NULL || owner == NULL)
+		die("out of memory");
+	unsigned char key[1 + CONFIG_KEY_SIZE_MAX];
+	for (uint64_t i = 0; i < nr; i++) {
+		if (records[i].op == TRACE_GET) {
+			trace_gets++;
+			trace_hits += records[i].outcome == TRACE_HIT;
+		}
+		if (records[i].op == TRACE_FILL)
+			continue;
+		trace_make_key(&records[i], key);
+		owner[i] = client_thread(key, thread_nr);
+		workers[owner[i]].nr++;
+	}
+
+	uint64_t op_nr = 0;
+	for (uint32_t id = 0; id < thread_nr; id++) {
+		struct worker *w = &workers[id];
+		w->ops = ops + op_nr;
+		w->lat = lat + op_nr;
+		op_nr += w->nr;
+		w->nr = 0;
+		w->fd = client_connect(port, id);
+		if (w->fd == -1)
+			die("failed to connect");
+	}
+	for (uint64_t i = 0; i < nr; i++) {
+		if (records[i].op != TRACE_FILL) {
+			struct worker *w = &workers[owner[i]];
+			w->ops[w->nr++] = &records[i];
+		}
+	}
+
+	replay_start = client_now_ns();
+	for (uint32_t id = 0; id < thread_nr; id++)
+		if (pthread_create(&workers[id].tid, NULL, worker_run,
+							&workers[id]) != 0)
+			die("failed to create threads");
+
+	uint64_t gets = 0, hits = 0, lag = 0;
+	for (uint32_t id = 0; id < thread_nr; id++) {
+		struct worker *w = &workers[id];
+		pthread_join(w->tid, NULL);
+		gets += w->gets;
+		hits += w->hits;
+		if (w->lag > lag)
+			lag = w->lag;
+	}
+	uint64_t elapsed = client_now_ns() - replay_start;
+
+	printf("records:     %lu, replayed %lu in %.3f s, %.0f ops/s\n",
+	       nr, op_nr, elapsed / 1e9, op_nr / (elapsed / 1e9));
+	printf("hit ratio:   trace %.4f, replay %.4f\n",
+	       trace_gets ? (double)trace_hits / trace_gets : 0,
+	       gets ? (double)hits / gets : 0);
+	client_print_latency(lat, op_nr);
+	if (speed > 0)
+		printf("lag(us):     max %.1f\n", lag / 1e3);
+	return 0;
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_REPLICA_H
+#define __UMEM_CACHE_REPLICA_H
+
+#ifdef CONFIG_REPLICA
+
+#include "kv.h"
+
+/* every this many GET hits one is sampled for hot key detection */
+#define HOT_KEY_SAMPLE	64
+/* number of hot key candidates per thread */
+#define HOT_KEY_NR	8
+/* a candidate sampled this many times is replicated */
+#define HOT_KEY_COUNT	32
+/* counts of candidates are halved every this many samples */
+#define HOT_KEY_DECAY	1024
+
+/**
+ * replica - Read-only copy of a hot kv, published by the owner thread
+ * @hash: dispatch hash of the key
+ * @epoch: unique among all replicas ever published, copies of other threads
+ * are valid as long as the published replica has the same epoch
+ * @owner: the thread owns the key
+ * @retire: the QSBR epoch it is retired at
+ * @next_retired: resides in (struct thread->retired) after retired
+ * @val_size: value size
+ * @flush_epoch: see (struct kv->epoch)
+ * @ns: see (struct kv->ns)
+ * @data: data of key and value
+ */
+struct replica {
+	uint64_t hash;
+	uint64_t epoch;
+	uint32_t owner;
+	uint64_t retire;
+	struct replica *next_retired;
+	uint64_t val_size;
+#ifdef CONFIG_NAMESPACE
+	uint32_t flush_epoch;
+	uint32_t ns;
+#endif
+	unsigned char data[];
+};
+
+#define REPLICA_KEY(r)	((r)->data)
+#define REPLICA_VAL(r)	((r)->data + KEY_SIZE(REPLICA_KEY(r)))
+
+/**
+ * hot_key - A hot key candidate
+ * @hash: dispatch hash of the key
+ * @count: number of times it is sampled
+ */
+struct hot_key {
+	uint64_t hash;
+	uint32_t count;
+};
+
+/**
+ * replica_copy - Copy of a replica in a thread's own memory
+ * @epoch: epoch of the replica it copies
+ * @borrower: holds the copy, which is never enabled
+ */
+struct replica_copy {
+	uint64_t epoch;
+	struct kv_borrower borrower;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_ROUTE_H
+#define __UMEM_CACHE_ROUTE_H
+
+#ifdef CONFIG_ROUTE
+
+#include <stdint.h>
+#include "conn.h"
+#include "config.h"
+
+#define ROUTE_RING_SIZE	32
+
+static_assert((ROUTE_RING_SIZE & (ROUTE_RING_SIZE - 1)) == 0);
+
+/**
+ * route_msg - A connection moving to the thread that owns its key
+ * @fd: socket file descriptor of the connection
+ * @n: number of bytes in @cmd, bytes after the command are its payload
+ * @cmd: the command already read from the connection, see README.rst -> =CMD=
+ */
+struct route_msg {
+	int fd;
+	uint32_t n;
+	unsigned char cmd[CMD_SIZE_MAX];
+};
+
+/**
+ * route_ring - Single producer single consumer ring between two threads
+ * @head: next message to pop, only written by the consumer
+ * @tail: next message to push, only written by the producer
+ * @blocked: the producer found the ring full, the consumer should wake it up
+ * after popping
+ * @msgs: the messages
+ */
+struct route_ring {
+	uint32_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+	uint32_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+	bool blocked __attribute__((aligned(CACHE_LINE_SIZE)));
+	struct route_msg msgs[ROUTE_RING_SIZE];
+};
+
+/**
+ * route_ring_tail - Get the slot to push to, producer only
+ * 
+ * @return: the slot, or NULL if @ring is full
+ */
+static inline struct route_msg *route_ring_tail(struct route_ring *ring)
+{
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	if (ring->tail - head == ROUTE_RING_SIZE)
+		return NULL;
+	return &ring->msgs[ring->tail & (ROUTE_RING_SIZE - 1)];
+}
+
+/**
+ * route_ring_push - Publish the slot got from route_ring_tail()
+ */
+static inline void route_ring_push(struct route_ring *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * route_ring_head - Get the slot to pop, consumer only
+ * 
+ * @return: the slot, or NULL if @ring is empty
+ */
+static inline struct route_msg *route_ring_head(struct route_ring *ring)
+{
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (ring->head == tail)
+		return NULL;
+	return &ring->msgs[ring->head & (ROUTE_RING_SIZE - 1)];
+}
+
+/**
+ * route_ring_pop - Hand the slot got from route_ring_head() back to the
+ * producer
+ */
+static inline void route_ring_pop(struct route_ring *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_S3FIFO_H
+#define __UMEM_CACHE_S3FIFO_H
+
+// Note: the eviction policy of a thread, shared with the simulator, see sim.c.
+// A new key goes to the small queue unless the hash table remembers it as a
+// ghost, a GET hit moves a key to the hot end of the main queue, and the
+// victim comes from the small queue while it is larger than its share.
+
+#include "kv.h"
+#include "rwonce.h"
+#include "container_of.h"
+
+/* the small queue of S3-FIFO holds this per-mille of the keys by default */
+#define SMALL_RATIO_DEFAULT	100
+/* the small queue ratio is tuned by the ghost hits, see s3fifo_tune() */
+#define SMALL_RATIO_AUTO	0
+/* the range s3fifo_tune() keeps the small queue ratio in */
+#define SMALL_RATIO_MIN		10
+#define SMALL_RATIO_MAX		500
+/* s3fifo_tune() moves the small queue ratio by this much */
+#define SMALL_TUNE_STEP		10
+/* s3fifo_tune() runs every this many evictions of a thread */
+#define SMALL_TUNE_WINDOW	4096
+
+/**
+ * s3fifo - The queues of the enabled kvs of a thread
+ * @s_lru_size: number of kvs on @s_lru_head, be aware of other threads will
+ * read it
+ * @m_lru_size: number of kvs on @m_lru_head, be aware of other threads will
+ * read it
+ * @small_ratio: @s_lru_size is kept at this per-mille of the keys, be aware
+ * of other threads will read it
+ * @small_step: how much s3fifo_tune() moves @small_ratio next time, the sign
+ * is the direction
+ * @small_gets: number of GETs when the tuning window started
+ * @small_ghost: number of ghost hits when the tuning window started
+ * @small_rate: ghost hits per million GETs in the last tuning window
+ * @s_lru_head: the small queue
+ * @m_lru_head: the main queue
+ */
+struct s3fifo {
+	uint64_t s_lru_size;
+	uint64_t m_lru_size;
+	uint32_t small_ratio;
+	int32_t small_step;
+	uint64_t small_gets;
+	uint64_t small_ghost;
+	uint64_t small_rate;
+	struct list_head s_lru_head;
+	struct list_head m_lru_head;
+};
+
+/**
+ * small_ratio_valid - Check if @ratio is a valid small queue ratio from client
+ */
+static inline bool small_ratio_valid(uint32_t ratio)
+{
+	return ratio < 1000;
+}
+
+static inline void s3fifo_init(struct s3fifo *q)
+{
+	q->s_lru_size = 0;
+	q->m_lru_size = 0;
+	q->small_ratio = SMALL_RATIO_DEFAULT;
+	q->small_step = SMALL_TUNE_STEP;
+	q->small_gets = 0;
+	q->small_ghost = 0;
+	q->small_rate = UINT64_MAX;
+	list_head_init(&q->s_lru_head);
+	list_head_init(&q->m_lru_head);
+}
+
+/**
+ * s3fifo_add - Queue @kv that is just enabled
+ * @ghost: the key of @kv is a ghost, see hash_ghost()
+ */
+static inline void s3fifo_add(struct s3fifo *q, struct kv *kv, bool ghost)
+{
+	if (ghost) {
+		kv->on_s_lru = 0;
+		list_lru_add(&q->m_lru_head, &kv->lru);
+		WRITE_ONCE(q->m_lru_size, q->m_lru_size + 1);
+	} else {
+		kv->on_s_lru = 1;
+		list_lru_add(&q->s_lru_head, &kv->lru);
+		WRITE_ONCE(q->s_lru_size, q->s_lru_size + 1);
+	}
+}
+
+/**
+ * s3fifo_del - Dequeue @kv that is being disabled
+ */
+static inline void s3fifo_del(struct s3fifo *q, struct kv *kv)
+{
+	list_lru_del(&kv->lru);
+	if (kv->on_s_lru)
+		WRITE_ONCE(q->s_lru_size, q->s_lru_size - 1);
+	else
+		WRITE_ONCE(q->m_lru_size, q->m_lru_size - 1);
+}
+
+/**
+ * s3fifo_touch - Move @kv to the hot end of the main queue
+ *
+ * @return: true on @kv is promoted from the small queue
+ */
+static inline bool s3fifo_touch(struct s3fifo *q, struct kv *kv)
+{
+	list_lru_del(&kv->lru);
+	list_lru_add(&q->m_lru_head, &kv->lru);
+	if (!kv->on_s_lru)
+		return false;
+
+	WRITE_ONCE(q->s_lru_size, q->s_lru_size - 1);
+	WRITE_ONCE(q->m_lru_size, q->m_lru_size + 1);
+	kv->on_s_lru = 0;
+	return true;
+}
+
+/**
+ * s3fifo_tune - Move the small queue ratio of @q by the ghost hits per GET of
+ * the last SMALL_TUNE_WINDOW evictions
+ * @evict: number of evictions of the thread
+ * @gets: number of GETs of the thread
+ * @ghost: number of ghost hits of the thread
+ *
+ * Note: a ghost hit is a key stored again soon after it is evicted, which a
+ * better split between the queues might have kept. It is hill climbing, the
+ * ratio keeps moving while the ghost hits per GET drop, and turns back when
+ * they rise.
+ */
+static inline void s3fifo_tune(struct s3fifo *q, uint64_t evict, uint64_t gets,
+								uint64_t ghost)
+{
+	if (evict % SMALL_TUNE_WINDOW != 0)
+		return;
+
+	if (gets != q->small_gets) {
+		uint64_t rate = (ghost - q->small_ghost) * 1000000 /
+							(gets - q->small_gets);
+		if (rate > q->small_rate)
+			q->small_step = -q->small_step;
+		q->small_rate = rate;
+
+		int32_t ratio = (int32_t)q->small_ratio + q->small_step;
+		if (ratio < SMALL_RATIO_MIN)
+			ratio = SMALL_RATIO_MIN;
+		else if (ratio > SMALL_RATIO_MAX)
+			ratio = SMALL_RATIO_MAX;
+		WRITE_ONCE(q->small_ratio, ratio);
+	}
+	q->small_gets = gets;
+	q->small_ghost = ghost;
+}
+
+/**
+ * s3fifo_victim - Get the kv to evict
+ * @n: number of keys of the thread
+ *
+ * @return: the kv, or NULL if the queues are empty
+ */
+static inline struct kv *s3fifo_victim(struct s3fifo *q, uint64_t n)
+{
+	struct list_head *lru_head;
+	if (q->s_lru_size * 1000 > n * q->small_ratio)
+		lru_head = &q->s_lru_head;
+	else if (!list_empty(&q->m_lru_head))
+		lru_head = &q->m_lru_head;
+	else
+		return NULL;
+	return container_of(list_lru_peek(lru_head), struct kv, lru);
+}
+
+#endif
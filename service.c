@@ -107,7 +107,7 @@ static void read_thread_info(struct service_conn *conn, int epfd)
 		return;
 
 	uint32_t thread_id = le32toh(*(uint32_t *)conn->buffer);
-	if (thread_id >= CONFIG_THREAD_NR) {
+	if (!thread_id_valid(thread_id)) {
 		service_conn_free(conn);
 		return;
 	}
@@ -152,7 +152,8 @@ void must_service_run(int port)
 	int fd = listen_port(port, epfd, 0);
 	must(fd != -1);
 
-	must(threads_run());
+	/* thread ports follow the running port */
+	must(threads_run(port + 1));
 
 	while (true) {
 		int n;
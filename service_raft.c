@@ -1054,10 +1054,104 @@ static void change_to_cluster_out(struct server *s, struct raft_conn *conn)
 	state_cluster_out(conn);
 }
 
+static void state_reply_out(struct raft_conn *conn)
+{
+	debug_printf("RAFT_CONN_STATE_REPLY_OUT:\n");
+
+	uint64_t written = conn->reply_size - conn->unio;
+	struct iovec iov;
+	iov.iov_base = conn->reply + written;
+	iov.iov_len = conn->unio;
+	if (raft_conn_full_write_msg(conn, true, &iov, 1)) {
+		free(conn->reply);
+		change_to_in_cmd(conn);
+	}
+}
+
+/**
+ * change_to_reply_out - Reply @size bytes of @reply
+ * 
+ * Note: @reply should be malloced, it is freed after written
+ */
+static void change_to_reply_out(
+	struct raft_conn *conn, void *reply, uint64_t size)
+{
+	conn->reply = reply;
+	conn->reply_size = size;
+	raft_conn_set_io(conn, RAFT_CONN_STATE_REPLY_OUT, size);
+	state_reply_out(conn);
+}
+
+static void state_success_out(struct raft_conn *conn)
+{
+	debug_printf("RAFT_CONN_STATE_SUCCESS_OUT:\n");
+
+	if (raft_conn_write_byte_zero(conn, true))
+		change_to_in_cmd(conn);
+}
+
+static void change_to_success_out(struct raft_conn *conn)
+{
+	conn->state = RAFT_CONN_STATE_SUCCESS_OUT;
+	state_success_out(conn);
+}
+
+static void change_to_stats_out(struct raft_conn *conn)
+{
+	uint64_t *stats = malloc(sizeof(uint64_t) * THREADS_STATS_NR);
+	if (stats == NULL) {
+		raft_conn_free(conn);
+		return;
+	}
+
+	threads_stats(stats);
+	change_to_reply_out(conn, stats, sizeof(uint64_t) * THREADS_STATS_NR);
+}
+
+#ifdef CONFIG_LATENCY
+static void change_to_latency_out(struct raft_conn *conn)
+{
+	uint64_t *latency = malloc(sizeof(uint64_t) * THREADS_LATENCY_NR);
+	if (latency == NULL) {
+		raft_conn_free(conn);
+		return;
+	}
+
+	threads_latency(latency);
+	change_to_reply_out(conn, latency,
+				sizeof(uint64_t) * THREADS_LATENCY_NR);
+}
+#endif
+
+static void change_to_top_keys_out(struct raft_conn *conn)
+{
+	unsigned char *top_keys = malloc(TOPK_OUT_SIZE);
+	if (top_keys == NULL) {
+		raft_conn_free(conn);
+		return;
+	}
+
+	change_to_reply_out(conn, top_keys, threads_top_keys(top_keys));
+}
+
+#ifdef CONFIG_MRC
+static void change_to_mrc_out(struct raft_conn *conn)
+{
+	uint64_t *mrc = malloc(sizeof(uint64_t) * THREADS_MRC_NR);
+	if (mrc == NULL) {
+		raft_conn_free(conn);
+		return;
+	}
+
+	threads_mrc(mrc);
+	change_to_reply_out(conn, mrc, sizeof(uint64_t) * THREADS_MRC_NR);
+}
+#endif
+
 static void state_connect_in(struct server *s, struct raft_conn *conn)
 {
 	uint32_t thread_id = le32toh(conn->connect_req.thread_id);
-	if (thread_id >= CONFIG_THREAD_NR) {
+	if (!thread_id_valid(thread_id)) {
 		raft_conn_free(conn);
 	} else {
 		epoll_del(s->epfd, conn->fd);
@@ -1066,6 +1160,17 @@ static void state_connect_in(struct server *s, struct raft_conn *conn)
 	}
 }
 
+static void state_small_ratio_in(struct raft_conn *conn)
+{
+	uint32_t ratio = le16toh(conn->small_ratio_req.ratio);
+	if (!small_ratio_valid(ratio)) {
+		raft_conn_free(conn);
+	} else {
+		threads_small_ratio(ratio);
+		change_to_success_out(conn);
+	}
+}
+
 static void state_in_cmd(struct server *s, struct raft_conn *conn)
 {
 	uint64_t readed = RAFT_CONN_BUFFER_SIZE - conn->unio;
@@ -1073,7 +1178,8 @@ static void state_in_cmd(struct server *s, struct raft_conn *conn)
 		return;
 
 	enum raft_cmd cmd = conn->buffer[0];
-	if (!conn->admin && cmd < RAFT_CMD_ADMIN_DIVIDER) {
+	if (!conn->admin &&
+	    (cmd < RAFT_CMD_ADMIN_DIVIDER || cmd >= RAFT_CMD_STATS)) {
 		raft_conn_free(conn);
 		return;
 	}
@@ -1135,6 +1241,42 @@ static void state_in_cmd(struct server *s, struct raft_conn *conn)
 		conn->authority_processing_nr = 0;
 		conn->authority_succeed_nr = 0;
 		change_to_authority_out(s, conn);
+		break;
+	case RAFT_CMD_STATS:
+		assert(readed == 1);
+		debug_printf("RAFT_CMD_STATS:\n");
+		change_to_stats_out(conn);
+		break;
+#ifdef CONFIG_LATENCY
+	case RAFT_CMD_LATENCY:
+		assert(readed == 1);
+		debug_printf("RAFT_CMD_LATENCY:\n");
+		change_to_latency_out(conn);
+		break;
+	case RAFT_CMD_LATENCY_RESET:
+		assert(readed == 1);
+		debug_printf("RAFT_CMD_LATENCY_RESET:\n");
+		threads_latency_reset();
+		change_to_success_out(conn);
+		break;
+#endif
+	case RAFT_CMD_TOP_KEYS:
+		assert(readed == 1);
+		debug_printf("RAFT_CMD_TOP_KEYS:\n");
+		change_to_top_keys_out(conn);
+		break;
+#ifdef CONFIG_MRC
+	case RAFT_CMD_MRC:
+		assert(readed == 1);
+		debug_printf("RAFT_CMD_MRC:\n");
+		change_to_mrc_out(conn);
+		break;
+#endif
+	case RAFT_CMD_SMALL_RATIO:
+		debug_printf("RAFT_CMD_SMALL_RATIO:\n");
+		if (readed == sizeof(struct small_ratio_req))
+			state_small_ratio_in(conn);
+
 		break;
 	default:
 		debug_printf("unrecognized command.........................\n");
@@ -1505,6 +1647,12 @@ static void process(struct server *s, struct raft_conn *conn)
 	case RAFT_CONN_STATE_CHANGE_CLUSTER_OUT:
 		state_change_cluster_out(conn);
 		break;
+	case RAFT_CONN_STATE_REPLY_OUT:
+		state_reply_out(conn);
+		break;
+	case RAFT_CONN_STATE_SUCCESS_OUT:
+		state_success_out(conn);
+		break;
 	case RAFT_CONN_STATE_AUTHORITY_OUT:
 		if (state_authority_in(s, conn))
 			state_authority_out(conn);
@@ -1605,7 +1753,8 @@ static struct server __s;
 
 void must_service_run(int port)
 {
-	must(threads_run());
+	/* thread ports follow the running port and the admin port */
+	must(threads_run(port + 2));
 	must_server_init(&__s);
 
 	int fd = listen_user(__s.epfd, port);
@@ -0,0 +1,643 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+// Note: umem-cache-sim runs requests through the hash table, the kv_caches and
+// the S3-FIFO queues of the server without sockets, see README.rst ->
+// BENCHMARK. The requests come from trace files or a synthetic Zipf, and are
+// dispatched to the simulated threads the way clients do. The memory manager is
+// faked, it counts the pages as the server does but never touches a value, and
+// the way kvs are allocated mirrors thread.c. Each combination of memory size
+// and small queue ratio runs in a child process of its own, which starts from an
+// empty cache and gives everything back to the system when it exits.
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hash_table.h"
+#include "kv_cache.h"
+#include "s3fifo.h"
+#include "trace.h"
+#include "client.h"
+#include "config.h"
+
+/* the fake memory manager gets this many pages or more from mmap() */
+#define SIM_MMAP_PAGE		16
+/* number of memory sizes or small queue ratios at most */
+#define SIM_SWEEP_MAX		16
+/* the memory sizes by default are the footprint shifted by these */
+#define SIM_MEMORY_SHIFT_MAX	4
+
+/**
+ * sim_thread - A simulated server thread, see struct thread
+ * @gets: number of GETs
+ * @hits: number of GETs that hit
+ * @ghost: number of kvs stored while their keys are ghosts
+ * @evict: number of kvs evicted
+ * @rejected: number of values not stored for lack of memory
+ */
+struct sim_thread {
+	struct memory memory;
+	struct hash_table hash_table;
+	struct s3fifo s3fifo;
+	struct kv_cache kv_cache_list[KV_CACHE_LEN];
+	uint64_t gets;
+	uint64_t hits;
+	uint64_t ghost;
+	uint64_t evict;
+	uint64_t rejected;
+};
+
+/**
+ * sim_result - What a child process reports
+ * @small_ratio: sum of the small queue ratios of the threads at the end
+ * @elapsed: time of the run (in nanoseconds)
+ * @failed: the threads could not even set up their hash tables
+ */
+struct sim_result {
+	uint64_t gets;
+	uint64_t hits;
+	uint64_t ghost;
+	uint64_t evict;
+	uint64_t rejected;
+	uint64_t small_ratio;
+	uint64_t elapsed;
+	bool failed;
+};
+
+static uint32_t thread_nr = CONFIG_THREAD_NR;
+static uint32_t job_nr;
+static uint64_t memories[SIM_SWEEP_MAX];
+static uint32_t memory_nr;
+static uint32_t ratios[SIM_SWEEP_MAX] = {10, 100, 250, SMALL_RATIO_AUTO};
+static uint32_t ratio_nr = 4;
+
+/* the trace files, or NULL for the synthetic Zipf */
+static struct trace_record *records;
+static uint64_t record_nr = 10000000;
+static uint64_t key_nr = 1000000;
+static double zipf_alpha = 0.99;
+static uint64_t val_min = 100;
+static uint64_t val_max = 100;
+static uint64_t seed = 1;
+/* zipf_cdf[i] is the probability of keys [0, i] */
+static double *zipf_cdf;
+/* zipf_guide[j] is the first key i whose zipf_cdf[i] > j / key_nr */
+static uint64_t *zipf_guide;
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "umem-cache-sim: %s\n", msg);
+	exit(1);
+}
+
+static void usage()
+{
+	die("usage: umem-cache-sim [-t thread-nr] [-j job-nr] [-m size,...] "
+	    "[-p ratio|auto,...] [-n request-nr] [-k key-nr] [-a alpha] "
+	    "[-v size[-size]] [-s seed] [{{trace-file}}...]");
+}
+
+void memory_init(struct memory *m, uint64_t page)
+{
+	m->free_pages = page;
+}
+
+void *memory_malloc(struct memory *m, uint64_t page)
+{
+	if (page > m->free_pages)
+		return NULL;
+
+	void *ptr;
+	if (page >= SIM_MMAP_PAGE) {
+		/* the pages are zeroed when they are first touched */
+		ptr = mmap(NULL, page << PAGE_SHIFT, PROT_READ | PROT_WRITE,
+				MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+		if (ptr == MAP_FAILED)
+			return NULL;
+	} else {
+		ptr = aligned_alloc(1 << PAGE_SHIFT, page << PAGE_SHIFT);
+		if (ptr == NULL)
+			return NULL;
+		memset(ptr, 0, page << PAGE_SHIFT);
+	}
+	m->free_pages -= page;
+	return ptr;
+}
+
+void memory_free(struct memory *m, void *ptr, uint64_t page)
+{
+	if (page >= SIM_MMAP_PAGE)
+		munmap(ptr, page << PAGE_SHIFT);
+	else
+		free(ptr);
+	m->free_pages += page;
+}
+
+static void kv_disable(struct sim_thread *t, struct kv *kv)
+{
+	s3fifo_del(&t->s3fifo, kv);
+	hash_del(&t->hash_table, KV_KEY(kv));
+	kv->enabled = false;
+}
+
+static void kv_free(struct sim_thread *t, struct kv *kv)
+{
+	uint64_t size = KV_SIZE(kv);
+	if (size <= KV_CACHE_OBJ_SIZE_MAX) {
+		struct kv_cache *cache = kv_cache_list_get(t->kv_cache_list, size);
+		kv_cache_free(cache, kv->soo, &t->memory);
+	} else if (kv_is_concat(kv)) {
+		struct kv_cache *cache = kv_cache_list_get(t->kv_cache_list,
+						(size & PAGE_MASK) + 8);
+		kv_cache_free(cache, kv->soo, &t->memory);
+		memory_free(&t->memory, kv, size >> PAGE_SHIFT);
+	} else {
+		memory_free(&t->memory, kv, (size + PAGE_MASK) >> PAGE_SHIFT);
+	}
+}
+
+/**
+ * reclaim_lru - Reclaim one kv from lru, see reclaim_lru() of thread.c
+ * @ratio: the small queue ratio, or SMALL_RATIO_AUTO
+ */
+static bool reclaim_lru(struct sim_thread *t, uint32_t ratio)
+{
+	if (ratio != SMALL_RATIO_AUTO)
+		t->s3fifo.small_ratio = ratio;
+	else
+		s3fifo_tune(&t->s3fifo, t->evict, t->gets, t->ghost);
+
+	struct kv *kv = s3fifo_victim(&t->s3fifo, t->hash_table.n);
+	if (kv == NULL)
+		return false;
+
+	kv_disable(t, kv);
+	t->evict++;
+	kv_free(t, kv);
+	return true;
+}
+
+static void *memory_malloc_advance(struct sim_thread *t, uint64_t page,
+								uint32_t ratio)
+{
+	while (t->memory.free_pages < page && reclaim_lru(t, ratio)) {}
+	return memory_malloc(&t->memory, page);
+}
+
+/**
+ * reserve_kv_cache - Try to reserve memory for allocating from @cache, see
+ * reserve_kv_cache() of thread.c
+ */
+static void reserve_kv_cache(struct sim_thread *t, struct kv_cache *cache,
+								uint32_t ratio)
+{
+	while (cache->free_objects == 0 &&
+		t->memory.free_pages < cache->slab_page && reclaim_lru(t, ratio)) {}
+}
+
+/**
+ * kv_malloc - Allocate a kv, see kv_malloc() of thread.c
+ *
+ * Note: without borrowers every reclaimed kv is freed at once, so a single
+ * round of reclaiming finds the space if there is any.
+ */
+static struct kv *kv_malloc(struct sim_thread *t, const unsigned char *key,
+					uint64_t val_size, uint32_t ratio)
+{
+	uint64_t size = sizeof(struct kv) + KEY_SIZE(key) + val_size;
+	struct kv *kv;
+	if (size <= KV_CACHE_OBJ_SIZE_MAX) {
+		struct kv_cache *cache = kv_cache_list_get(t->kv_cache_list, size);
+		reserve_kv_cache(t, cache, ratio);
+		return kv_cache_malloc_kv(cache, &t->memory);
+	}
+
+	unsigned int overflow = size & PAGE_MASK;
+	if (overflow == 0 || overflow + 8 > KV_CACHE_OBJ_SIZE_MAX) {
+		uint64_t page = (size + PAGE_MASK) >> PAGE_SHIFT;
+		kv = memory_malloc_advance(t, page, ratio);
+		if (kv) {
+			/* fake a soo for kv_is_concat() */
+			kv->soo = SOO_MAKE(kv, 0);
+		}
+		return kv;
+	}
+
+	uint64_t page = size >> PAGE_SHIFT;
+	kv = memory_malloc_advance(t, page, ratio);
+	if (kv) {
+		struct kv_cache *cache = kv_cache_list_get(t->kv_cache_list,
+								overflow + 8);
+		reserve_kv_cache(t, cache, ratio);
+		if (!kv_cache_malloc_concat_val(cache, &t->memory, &kv->soo)) {
+			memory_free(&t->memory, kv, page);
+			return NULL;
+		}
+	}
+	return kv;
+}
+
+/**
+ * sim_store - Store a value of @val_size bytes for @key which is not in @t,
+ * the way a conn locks the key and enables the kv
+ */
+static void sim_store(struct sim_thread *t, const unsigned char *key,
+					uint64_t val_size, uint32_t ratio)
+{
+	struct {
+		struct hlist_node hash_node;
+		unsigned char key[1 + CONFIG_KEY_SIZE_MAX];
+	} lock;
+	memcpy(lock.key, key, KEY_SIZE(key));
+	hash_add(&t->hash_table, lock.key, &t->memory);
+
+	struct kv *kv = kv_malloc(t, lock.key, val_size, ratio);
+	if (kv == NULL) {
+		hash_del(&t->hash_table, lock.key);
+		t->rejected++;
+		return;
+	}
+
+	kv_init(kv, lock.key, val_size);
+	kv->hash_node = lock.hash_node;
+	hlist_node_fix(&kv->hash_node);
+	bool ghost = hash_ghost(&t->hash_table, KV_KEY(kv));
+	t->ghost += ghost;
+	s3fifo_add(&t->s3fifo, kv, ghost);
+
+	uint64_t page = hash_resize_page(&t->hash_table);
+	if (page > 0) {
+		void *new = memory_malloc_advance(t, page, ratio);
+		if (new)
+			hash_resize(&t->hash_table, page, new);
+	}
+}
+
+/**
+ * sim_drop - Delete @key from @t if it is there
+ */
+static void sim_drop(struct sim_thread *t, const unsigned char *key)
+{
+	struct hlist_node *node = hash_get(&t->hash_table, key, &t->memory);
+	if (node) {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		kv_disable(t, kv);
+		kv_free(t, kv);
+	}
+}
+
+/**
+ * splitmix64 - Get the next random number of @state
+ */
+static uint64_t splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * zipf_init - Build the table of the synthetic Zipf
+ *
+ * Note: a binary search of the cdf misses the cache on every step, the guide
+ * table starts the search a few keys before the one it looks for.
+ */
+static void zipf_init()
+{
+	zipf_cdf = malloc(key_nr * sizeof(*zipf_cdf));
+	zipf_guide = malloc(key_nr * sizeof(*zipf_guide));
+	if (zipf_cdf == NULL || zipf_guide == NULL)
+		die("out of memory");
+
+	double sum = 0;
+	for (uint64_t i = 0; i < key_nr; i++) {
+		sum += 1 / pow(i + 1, zipf_alpha);
+		zipf_cdf[i] = sum;
+	}
+	for (uint64_t i = 0; i < key_nr; i++)
+		zipf_cdf[i] /= sum;
+	/* make sure the search stops at the last key */
+	zipf_cdf[key_nr - 1] = 2;
+
+	uint64_t i = 0;
+	for (uint64_t j = 0; j < key_nr; j++) {
+		while (zipf_cdf[i] <= (double)j / key_nr)
+			i++;
+		zipf_guide[j] = i;
+	}
+}
+
+/**
+ * next_record - Get the next request in @r
+ * @i: index of the request
+ * @rand: state of the random numbers of the synthetic Zipf
+ *
+ * Note: a synthetic request is a GET of key i, the i'th most popular one,
+ * whose value size never changes.
+ */
+static void next_record(uint64_t i, uint64_t *rand, struct trace_record *r)
+{
+	if (records) {
+		*r = records[i];
+		return;
+	}
+
+	double u = (splitmix64(rand) >> 11) * 0x1p-53;
+	uint64_t k = zipf_guide[(uint64_t)(u * key_nr)];
+	while (zipf_cdf[k] <= u)
+		k++;
+	uint64_t state = seed ^ (k * 0xD1B54A32D192ED03ULL);
+	r->key_hash = splitmix64(&state);
+	r->val_size = val_min + splitmix64(&state) % (val_max - val_min + 1);
+	r->op = TRACE_GET;
+	r->outcome = TRACE_HIT;
+	r->key_size = 16;
+}
+
+/**
+ * sim_run - Run all the requests against @thread_nr threads with @memory
+ * bytes of memory in total, keeping the small queue at @ratio
+ */
+static void sim_run(uint64_t memory, uint32_t ratio, struct sim_result *res)
+{
+	struct sim_thread *threads = calloc(thread_nr, sizeof(*threads));
+	if (threads == NULL)
+		die("out of memory");
+	for (uint32_t id = 0; id < thread_nr; id++) {
+		struct sim_thread *t = &threads[id];
+		memory_init(&t->memory, (memory / thread_nr) >> PAGE_SHIFT);
+		if (!hash_table_init(&t->hash_table, &t->memory)) {
+			res->failed = true;
+			return;
+		}
+		s3fifo_init(&t->s3fifo);
+		kv_cache_list_init(t->kv_cache_list);
+	}
+
+	unsigned char key[1 + CONFIG_KEY_SIZE_MAX];
+	uint64_t rand = seed;
+	uint64_t start = client_now_ns();
+	for (uint64_t i = 0; i < record_nr; i++) {
+		struct trace_record r;
+		next_record(i, &rand, &r);
+		/* a GET that misses stores the value */
+		if (r.op == TRACE_FILL)
+			continue;
+
+		trace_make_key(&r, key);
+		struct sim_thread *t = &threads[client_thread(key, thread_nr)];
+		struct hlist_node *node;
+		switch (r.op) {
+		case TRACE_GET:
+			t->gets++;
+			node = hash_get(&t->hash_table, key, &t->memory);
+			if (node) {
+				t->hits++;
+				s3fifo_touch(&t->s3fifo, container_of(node,
+							struct kv, hash_node));
+			} else {
+				sim_store(t, key, r.val_size, ratio);
+			}
+			break;
+		case TRACE_SET:
+			sim_drop(t, key);
+			sim_store(t, key, r.val_size, ratio);
+			break;
+		case TRACE_DEL:
+			sim_drop(t, key);
+			break;
+		default:
+			break;
+		}
+	}
+	res->elapsed = client_now_ns() - start;
+
+	for (uint32_t id = 0; id < thread_nr; id++) {
+		struct sim_thread *t = &threads[id];
+		res->gets += t->gets;
+		res->hits += t->hits;
+		res->ghost += t->ghost;
+		res->evict += t->evict;
+		res->rejected += t->rejected;
+		res->small_ratio += t->s3fifo.small_ratio;
+	}
+}
+
+/**
+ * footprint - Get the bytes all the kvs take if none is evicted
+ */
+static uint64_t footprint()
+{
+	uint64_t bound = records ? record_nr : key_nr;
+	uint64_t slot_nr = 1;
+	while (slot_nr < bound * 2)
+		slot_nr <<= 1;
+	/* slot is (hash, size + 1) */
+	uint64_t (*table)[2] = calloc(slot_nr, sizeof(*table));
+	if (table == NULL)
+		die("out of memory");
+
+	uint64_t rand = seed;
+	for (uint64_t i = 0; i < record_nr; i++) {
+		struct trace_record r;
+		next_record(i, &rand, &r);
+		if (r.op == TRACE_DEL)
+			continue;
+
+		uint64_t s = r.key_hash & (slot_nr - 1);
+		while (table[s][1] != 0 && table[s][0] != r.key_hash)
+			s = (s + 1) & (slot_nr - 1);
+		uint64_t key_size = r.key_size < TRACE_KEY_SIZE_MIN ?
+					TRACE_KEY_SIZE_MIN : r.key_size;
+		table[s][0] = r.key_hash;
+		table[s][1] = sizeof(struct kv) + 1 + key_size + r.val_size + 1;
+	}
+
+	uint64_t sum = 0;
+	for (uint64_t s = 0; s < slot_nr; s++)
+		if (table[s][1] != 0)
+			sum += table[s][1] - 1;
+	free(table);
+	return sum;
+}
+
+/**
+ * reap - Wait for a child process to exit
+ */
+static void reap()
+{
+	int status;
+	if (wait(&status) == -1 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0)
+		die("a simulation failed");
+}
+
+/**
+ * parse_size - Parse @arg of an optional K, M or G suffix
+ */
+static uint64_t parse_size(const char *arg)
+{
+	char *end;
+	uint64_t size = strtoull(arg, &end, 10);
+	switch (*end) {
+	case 'G':
+		size <<= 10;
+		/* fall through */
+	case 'M':
+		size <<= 10;
+		/* fall through */
+	case 'K':
+		size <<= 10;
+		end++;
+		break;
+	}
+	if (*end != '\0' || size == 0)
+		usage();
+	return size;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+	int opt;
+	char *arg;
+	while ((opt = getopt(argc, argv, "t:j:m:p:n:k:a:v:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			thread_nr = strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			job_nr = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			memory_nr = 0;
+			while ((arg = strsep(&optarg, ",")) != NULL) {
+				if (memory_nr == SIM_SWEEP_MAX)
+					usage();
+				memories[memory_nr++] = parse_size(arg);
+			}
+			break;
+		case 'p':
+			ratio_nr = 0;
+			while ((arg = strsep(&optarg, ",")) != NULL) {
+				if (ratio_nr == SIM_SWEEP_MAX)
+					usage();
+				uint32_t ratio = strcmp(arg, "auto") == 0 ?
+					SMALL_RATIO_AUTO : strtoul(arg, NULL, 10);
+				if (!small_ratio_valid(ratio) ||
+				    (ratio == SMALL_RATIO_AUTO &&
+				     strcmp(arg, "auto") != 0))
+					usage();
+				ratios[ratio_nr++] = ratio;
+			}
+			break;
+		case 'n':
+			record_nr = strtoull(optarg, NULL, 10);
+			break;
+		case 'k':
+			key_nr = strtoull(optarg, NULL, 10);
+			break;
+		case 'a':
+			zipf_alpha = atof(optarg);
+			break;
+		case 'v':
+			switch (sscanf(optarg, "%lu-%lu", &val_min, &val_max)) {
+			case 1:
+				val_max = val_min;
+				break;
+			case 2:
+				break;
+			default:
+				usage();
+			}
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (thread_nr == 0 || key_nr == 0 || zipf_alpha < 0 ||
+	    val_min > val_max)
+		usage();
+	if (job_nr == 0)
+		job_nr = sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	if (optind < argc) {
+		record_nr = 0;
+		for (int i = optind; i < argc; i++)
+			if (!trace_load(argv[i], &records, &record_nr))
+				die("failed to load the trace file");
+		if (record_nr == 0)
+			die("no records");
+		if (!trace_prepare(records, record_nr))
+			die("out of memory");
+	} else {
+		zipf_init();
+	}
+
+	uint64_t total = footprint();
+	if (memory_nr == 0) {
+		for (int i = SIM_MEMORY_SHIFT_MAX; i >= 0; i--)
+			memories[memory_nr++] = total >> i;
+	}
+	printf("requests:    %lu, footprint %.1f MiB, %u threads\n",
+	       record_nr, total / 1048576.0, thread_nr);
+
+	uint32_t run_nr = memory_nr * ratio_nr;
+	struct sim_result *results = mmap(NULL, run_nr * sizeof(*results),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED)
+		die("out of memory");
+	memset(results, 0, run_nr * sizeof(*results));
+
+	uint32_t running = 0;
+	for (uint32_t i = 0; i < run_nr; i++) {
+		if (running == job_nr) {
+			reap();
+			running--;
+		}
+		pid_t pid = fork();
+		if (pid == -1)
+			die("failed to fork");
+		if (pid == 0) {
+			sim_run(memories[i / ratio_nr], ratios[i % ratio_nr],
+								&results[i]);
+			_exit(0);
+		}
+		running++;
+	}
+	for (; running > 0; running--)
+		reap();
+
+	printf("%11s %8s %10s %10s %10s %10s %10s\n", "memory(MiB)", "small",
+	       "hit ratio", "ghost", "evicted", "rejected", "Mreq/s");
+	for (uint32_t i = 0; i < run_nr; i++) {
+		struct sim_result *res = &results[i];
+		uint32_t ratio = ratios[i % ratio_nr];
+		char small[16];
+		if (ratio == SMALL_RATIO_AUTO)
+			sprintf(small, "auto:%lu", res->small_ratio / thread_nr);
+		else
+			sprintf(small, "%u", ratio);
+		printf("%11.1f %8s ", memories[i / ratio_nr] / 1048576.0, small);
+		if (res->failed) {
+			printf("%10s\n", "too small");
+			continue;
+		}
+		printf("%10.4f %10lu %10lu %10lu %10.2f\n",
+		       res->gets ? (double)res->hits / res->gets : 0,
+		       res->ghost, res->evict, res->rejected,
+		       record_nr / (res->elapsed / 1e3));
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_STATS_H
+#define __UMEM_CACHE_STATS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "rwonce.h"
+
+/**
+ * counters of a thread, see README.rst -> CMD-STATS for the meanings
+ * 
+ * Note: the gauges are not counted, threads_stats() fills them in the reply
+ */
+enum stat_counter {
+	STAT_GET_HIT,
+	STAT_GET_MISS,
+	STAT_GET_BLOCKED,
+	STAT_SET,
+	STAT_DEL,
+	STAT_EVICT,
+	STAT_GHOST_HIT,
+	STAT_BYTES_IN,
+	STAT_BYTES_OUT,
+	STAT_MEMORY,		/* gauge */
+	STAT_PROMOTE,
+	STAT_EVICT_SMALL,
+	STAT_EVICT_MAIN,
+	STAT_SMALL,		/* gauge */
+	STAT_MAIN,		/* gauge */
+	STAT_SMALL_RATIO,	/* gauge */
+	STAT_NR,
+};
+
+/**
+ * stats - Counters of a thread, only written by the thread itself
+ * 
+ * Note: other threads read them with READ_ONCE(), the counters are written
+ * with WRITE_ONCE() instead of atomic instructions, which costs the same as
+ * a plain increment. They live in their own cache line, so the readers never
+ * contend with the hot data of the thread.
+ */
+struct stats {
+	uint64_t n[STAT_NR];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/**
+ * stat_add - Add @delta to counter @stat of @s, owner thread only
+ */
+static inline void stat_add(
+	struct stats *s, enum stat_counter stat, uint64_t delta)
+{
+	WRITE_ONCE(s->n[stat], s->n[stat] + delta);
+}
+
+/**
+ * stat_inc - Add 1 to counter @stat of @s, owner thread only
+ */
+static inline void stat_inc(struct stats *s, enum stat_counter stat)
+{
+	stat_add(s, stat, 1);
+}
+
+#endif
@@ -3,8 +3,15 @@
 
 #include <sys/socket.h>
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <endian.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
@@ -12,80 +19,17 @@
 #include "thread.h"
 #include "rwonce.h"
 #include "epoll.h"
+#include "socket.h"
+#include "route.h"
+#include "murmur_hash3.h"
 #include "debug.h"
+#include "probe.h"
 
 static struct thread threads[CONFIG_THREAD_NR];
 
 #define conn_kv(conn)	(conn->kv_borrower.kv)
-
-#define SIZE_TO_IDX_IDX(size)	(((size) + 7 - KV_CACHE_OBJ_SIZE_MIN) >> 3)
-#define KV_CACHE_IDX_LEN	(SIZE_TO_IDX_IDX(KV_CACHE_OBJ_SIZE_MAX) + 1)
-static const unsigned char kv_cache_idx[KV_CACHE_IDX_LEN] = {
-	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 
-	18, 19, 20, 21, 22, 23, 24, 25, 25, 26, 26, 27, 27, 28, 28, 29, 29, 30, 
-	30, 30, 31, 31, 31, 32, 32, 33, 33, 34, 34, 35, 35, 35, 36, 36, 37, 37, 
-	37, 38, 38, 38, 38, 39, 39, 39, 39, 40, 40, 40, 40, 41, 41, 41, 41, 41, 
-	42, 42, 42, 42, 42, 43, 43, 43, 44, 44, 44, 44, 45, 45, 45, 45, 46, 46, 
-	46, 46, 47, 47, 47, 47, 48, 48, 48, 48, 48, 49, 49, 49, 49, 49, 50, 50, 
-	50, 50, 50, 50, 51, 51, 51, 51, 51, 51, 51, 52, 52, 52, 52, 52, 52, 52, 
-	52, 53, 53, 53, 53, 53, 53, 53, 53, 54, 54, 54, 54, 54, 55, 55, 55, 55, 
-	55, 56, 56, 56, 56, 56, 57, 57, 57, 57, 57, 57, 58, 58, 58, 58, 58, 58, 
-	59, 59, 59, 59, 59, 59, 59, 60, 60, 60, 60, 60, 60, 60, 60, 61, 61, 61, 
-	61, 61, 61, 61, 61, 62, 62, 62, 62, 62, 62, 62, 62, 62, 63, 63, 63, 63, 
-	63, 63, 63, 63, 63, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 65, 65, 
-	65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 66, 66, 66, 66, 66, 66, 66, 66, 
-	66, 66, 66, 66, 66, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 67, 
-	67, 67, 67, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 
-	68, 68, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 69, 
-	69, 69, 69, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 70, 
-	70, 70, 70, 70, 70, 70, 70, 70, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 
-	71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 71, 72, 72, 
-	72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 
-	72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 72, 73, 73, 73, 73, 73, 73, 73, 
-	73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 
-	73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 74, 74, 74, 74, 74, 74, 
-	74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 
-	74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 74, 
-	74, 74, 74, 74, };
-
-#ifdef DEBUG
-static void kv_cache_idx_generate_print()
-{
-	struct kv_cache cache;
-	kv_cache_init(&cache, KV_CACHE_OBJ_SIZE_MIN);
-	int i = 0;
-	printf("{\n\t 0, ");
-	for (unsigned int size = KV_CACHE_OBJ_SIZE_MIN + 8;
-				size <= KV_CACHE_OBJ_SIZE_MAX; size += 8) {
-		if (cache.obj_size < size) {
-			struct kv_cache temp;
-			kv_cache_init(&temp, size);
-			i++;
-			cache = temp;
-		}
-
-		if (SIZE_TO_IDX_IDX(size) % 18 == 0)
-			printf("\n\t%2d, ", i);
-		else
-			printf("%2d, ", i);
-	}
-	printf("}\n\n");
-}
-#endif
-
-static void kv_cache_list_init(struct kv_cache kv_cache_list[KV_CACHE_LEN])
-{
-	assert(KV_CACHE_LEN == kv_cache_idx[KV_CACHE_IDX_LEN - 1] + 1);
-
-	kv_cache_init(&kv_cache_list[0], KV_CACHE_OBJ_SIZE_MIN);
-	for (unsigned int i = 1; i < KV_CACHE_IDX_LEN; i++) {
-		if (kv_cache_idx[i] != kv_cache_idx[i - 1]) {
-			uint16_t size = KV_CACHE_OBJ_SIZE_MIN + 8 * i;
-			kv_cache_init(&kv_cache_list[kv_cache_idx[i]], size);
-		}
-	}
-	assert(kv_cache_list[KV_CACHE_LEN - 1].obj_size == KV_CACHE_OBJ_SIZE_MAX);
-}
+#define conn_slot(t, conn)	((conn) - (t)->__conns)
+#define thread_index(t)	((t) - threads)
 
 /**
  * conn_malloc - Allocate space for conn
@@ -98,21 +42,154 @@ static struct conn *conn_malloc(struct thread *t, int fd)
 	if (conn) {
 		conn->state = CONN_STATE_OUT_SUCCESS;
 		conn->clock_called = false;
+		conn->route = false;
+		conn->set = false;
 		conn->fd = fd;
+		conn->bulk = NULL;
+		conn->chunk = NULL;
+		conn->sub = NULL;
+	#ifndef CONFIG_IO_URING
+		conn->mux = NULL;
+	#endif
+	#ifdef CONFIG_LATENCY
+		conn->lat_stall = 0;
+		conn->lat = LAT_NONE;
+	#endif
 		kv_borrower_init(&conn->kv_borrower);
+	#ifdef CONFIG_ZEROCOPY
+		kv_borrower_init(&conn->zc_borrower);
+		conn->zc_sent = 0;
+		conn->zc_done = 0;
+	#endif
+	#ifdef CONFIG_IO_URING
+		conn->res_ready = false;
+		conn->inflight = false;
+		if (!uring_update_file(&t->ring, conn_slot(t, conn), fd)) {
+			fixed_mem_cache_free(&t->conn_cache, conn);
+			return NULL;
+		}
+	#endif
 	}
 	return conn;
 }
 
+static void borrower_return_kv(struct thread *t, struct kv_borrower *borrower);
+
+/**
+ * conn_free_chunks - Free the chunks of the value @conn is reading
+ */
+static void conn_free_chunks(struct thread *t, struct conn *conn)
+{
+	struct chunk *last = conn->chunk;
+	if (last == NULL)
+		return;
+
+	struct chunk *chunk = last->next;
+	while (chunk != last) {
+		struct chunk *next = chunk->next;
+		memory_free(&t->memory, chunk, CHUNK_PAGE);
+		chunk = next;
+	}
+	memory_free(&t->memory, last, CHUNK_PAGE);
+	conn->chunk = NULL;
+}
+
+#ifndef CONFIG_IO_URING
+/**
+ * mux_req_free - Deallocates the space related to request @req
+ */
+static void mux_req_free(struct thread *t, struct conn *req)
+{
+	struct mux *mux = req->mux;
+	if (conn_kv(req))
+		borrower_return_kv(t, &req->kv_borrower);
+	fixed_mem_cache_free(&mux->req_cache, req);
+
+	mux->req_nr--;
+	if (mux->req_nr == 0 && mux->conn == NULL)
+		memory_free(&t->memory, mux, MUX_PAGE);
+}
+
+/**
+ * mux_close - Detach @mux from its connection, which is closed
+ * 
+ * Note: blocked requests are freed when they are woken up, see mux_wake()
+ */
+static void mux_close(struct thread *t, struct mux *mux)
+{
+	while (!list_empty(&mux->done)) {
+		struct conn *req;
+		req = list_first_entry(&mux->done, struct conn, interest);
+		list_del(&req->interest);
+		mux_req_free(t, req);
+	}
+
+	mux->conn = NULL;
+	if (mux->req_nr == 0)
+		memory_free(&t->memory, mux, MUX_PAGE);
+}
+#endif
+
 /**
  * conn_free - Deallocates the space related to @conn
+ * 
+ * Note: for io_uring, @conn->fd is reset to -1, so the completion handler
+ * knows the conn is gone
  */
 static void conn_free(struct thread *t, struct conn *conn)
 {
+#ifdef CONFIG_IO_URING
+	assert(!conn->inflight);
+	bool ok __attribute__((unused));
+	ok = uring_update_file(&t->ring, conn_slot(t, conn), -1);
+	assert(ok);
+#endif
 	close(conn->fd);
+	conn->fd = -1;
+	if (conn->bulk) {
+		memory_free(&t->memory, conn->bulk, BULK_PAGE);
+		conn->bulk = NULL;
+	}
+	conn_free_chunks(t, conn);
+	if (conn->sub) {
+		list_del(&conn->sub->node);
+		memory_free(&t->memory, conn->sub, SUB_PAGE);
+		conn->sub = NULL;
+	}
+#ifndef CONFIG_IO_URING
+	if (conn->mux) {
+		mux_close(t, conn->mux);
+		conn->mux = NULL;
+	}
+#endif
+#ifdef CONFIG_ZEROCOPY
+#ifdef CONFIG_IO_URING
+	/* notifications still refer to @conn, it is freed when they arrive,
+	see conn_zerocopy_notified() */
+	if (conn->zc_sent != conn->zc_done)
+		return;
+#endif
+	/* socket is closed with SO_LINGER {0, 0}, which drops the data that
+	still refers to the kv */
+	if (conn->zc_borrower.kv)
+		borrower_return_kv(t, &conn->zc_borrower);
+#endif
 	fixed_mem_cache_free(&t->conn_cache, conn);
 }
 
+/**
+ * conn_io_busy - Check if @conn has an io_uring request in flight, the memory
+ * the request refers to must not be freed
+ */
+static bool conn_io_busy(struct conn *conn __attribute__((unused)))
+{
+#ifdef CONFIG_IO_URING
+	return conn->inflight;
+#else
+	return false;
+#endif
+}
+
 /**
  * thread_range - Check if @ptr is inside a thread
  */
@@ -129,12 +206,60 @@ static bool thread_range(void *ptr)
  */
 static struct kv_cache *kv_cache_get(struct thread *t, uint64_t size)
 {
-	struct kv_cache *cache;
-	cache = &t->kv_cache_list[kv_cache_idx[SIZE_TO_IDX_IDX(size)]];
-	assert(cache->obj_size >= size);
-	assert(cache == t->kv_cache_list || (cache - 1)->obj_size < size);
-	return cache;
+	return kv_cache_list_get(t->kv_cache_list, size);
+}
+
+#ifdef CONFIG_ROUTE
+/**
+ * key_dispatch_hash - Hash @key the way clients do, see README.rst ->
+ * KEY DISPATCH
+ */
+static uint64_t key_dispatch_hash(const unsigned char *key)
+{
+	const unsigned char *data = key + 1;
+	int len = key[0];
+#ifdef CONFIG_RAFT
+	/* the version prefix is not passed to the hash method */
+	if (len >= 8) {
+		data += 8;
+		len -= 8;
+	}
+#endif
+	uint64_t out[2];
+	MurmurHash3_x64_128(data, len, 74, &out);
+	return out[0];
+}
+
+#ifdef CONFIG_SHARD
+/* shard_map[i] is the thread owns shard i, only the owner changes it */
+static uint32_t shard_map[CONFIG_SHARD_NR];
+/* buckets checked for kvs of a moved shard in a round, see shard_sweep() */
+#define SHARD_SWEEP	(1 << 10)
+
+static uint32_t hash_shard(uint64_t hash)
+{
+	return ((__uint128_t)hash * CONFIG_SHARD_NR) >> 64;
+}
+
+static uint32_t key_shard(const unsigned char *key)
+{
+	return hash_shard(key_dispatch_hash(key));
+}
+
+static struct thread *shard_thread(uint32_t shard)
+{
+	return threads + __atomic_load_n(&shard_map[shard], __ATOMIC_ACQUIRE);
+}
+#else
+/**
+ * hash_thread - Get the thread that owns the key of dispatch hash @hash
+ */
+static struct thread *hash_thread(uint64_t hash)
+{
+	return threads + (uint32_t)(((__uint128_t)hash * CONFIG_THREAD_NR) >> 64);
 }
+#endif
+#endif
 
 #ifdef CONFIG_RAFT
 static void warmed_up(struct thread *t)
@@ -158,20 +283,244 @@ bool threads_warmed_up()
 }
 #endif
 
+#ifdef CONFIG_REPLICA
+/* replicas[i] is published to slot i by the owner of the key */
+static struct replica *replicas[CONFIG_REPLICA_NR];
+/* number of published replicas */
+static uint32_t replica_nr;
+/* see (struct replica->epoch) */
+static uint64_t replica_epoch;
+/* bumped every time a replica is retired */
+static uint64_t qsbr_epoch;
+
+/**
+ * qsbr_retire - Free @r once no thread refers to it, see qsbr_quiescent()
+ * 
+ * Note: @r should be unpublished already
+ */
+static void qsbr_retire(struct thread *t, struct replica *r)
+{
+	r->retire = __atomic_add_fetch(&qsbr_epoch, 1, __ATOMIC_SEQ_CST);
+	r->next_retired = t->retired;
+	t->retired = r;
+}
+
+/**
+ * qsbr_quiescent - Tell other threads we refer to no replica, and free the
+ * replicas retired by us that no thread refers to
+ * 
+ * Note: threads blocked on waiting events are woken up by the clock service
+ * from time to time, so the replicas are freed eventually
+ */
+static void qsbr_quiescent(struct thread *t)
+{
+	uint64_t epoch = __atomic_load_n(&qsbr_epoch, __ATOMIC_SEQ_CST);
+	/* replicas are loaded after this, see replica_get() */
+	__atomic_store_n(&t->qsbr_seen, epoch, __ATOMIC_SEQ_CST);
+	if (t->retired == NULL)
+		return;
+
+	uint64_t min = epoch;
+	for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
+		uint64_t seen;
+		seen = __atomic_load_n(&threads[i].qsbr_seen, __ATOMIC_ACQUIRE);
+		if (seen < min)
+			min = seen;
+	}
+
+	/* every thread has seen an epoch no older than the retire epoch, so
+	they loaded the replica after it was unpublished */
+	struct replica **pprev = &t->retired;
+	while (*pprev && (*pprev)->retire > min)
+		pprev = &(*pprev)->next_retired;
+
+	struct replica *r = *pprev;
+	*pprev = NULL;
+	while (r) {
+		struct replica *next = r->next_retired;
+		free(r);
+		r = next;
+	}
+}
+
+/**
+ * replica_unpublish - Stop replicating @kv
+ */
+static void replica_unpublish(struct thread *t, struct kv *kv)
+{
+	for (int i = 0; i < CONFIG_REPLICA_NR; i++) {
+		struct replica *r;
+		r = __atomic_load_n(&replicas[i], __ATOMIC_RELAXED);
+		if (r && r->owner == t - threads &&
+		    memcmp(REPLICA_KEY(r), KV_KEY(kv), KV_KEY_SIZE(kv)) == 0) {
+			__atomic_store_n(&replicas[i], NULL, __ATOMIC_RELEASE);
+			__atomic_sub_fetch(&replica_nr, 1, __ATOMIC_RELAXED);
+			qsbr_retire(t, r);
+			break;
+		}
+	}
+	kv->replicated = 0;
+}
+#endif
+
+#ifdef CONFIG_NAMESPACE
+/* every spare bucket is checked for flushed kvs on a clock service */
+#define NAMESPACE_SWEEP	(16 << 10)
+
+/* bumped by every flush, see README.rst -> CMD-FLUSH */
+static uint32_t flush_epoch;
+/* the epoch the whole cache is last flushed at */
+static uint32_t all_flushed;
+/* ns_flushed[i] is the epoch namespace i is last flushed at, namespace 0 is
+for keys without namespace, which are only flushed with the whole cache */
+static uint32_t ns_flushed[1 + CONFIG_NAMESPACE_NR];
+
+/**
+ * key_namespace - Get the namespace of @key, which is named by the bytes
+ * before the first CONFIG_NAMESPACE_SEP
+ * 
+ * @return: the namespace, or 0 if @key has no namespace
+ */
+static uint32_t key_namespace(const unsigned char *key)
+{
+	const unsigned char *data = key + 1;
+	int len = key[0];
+#ifdef CONFIG_RAFT
+	/* the version prefix is not a part of the namespace */
+	if (len >= 8) {
+		data += 8;
+		len -= 8;
+	}
+#endif
+	const unsigned char *sep = memchr(data, CONFIG_NAMESPACE_SEP, len);
+	if (sep == NULL)
+		return 0;
+
+	uint64_t out[2];
+	MurmurHash3_x64_128(data, sep - data, 74, &out);
+	return 1 + out[0] % CONFIG_NAMESPACE_NR;
+}
+
+/**
+ * namespace_flushed - Check if a key of namespace @ns locked at @epoch is
+ * flushed
+ */
+static bool namespace_flushed(uint32_t ns, uint32_t epoch)
+{
+	return epoch < READ_ONCE(all_flushed) ||
+	       epoch < READ_ONCE(ns_flushed[ns]);
+}
+
+/**
+ * namespace_flush - Flush namespace @ns, or the whole cache if @all
+ * 
+ * Note: flushes of other threads may race with us, the flushed epoch never
+ * goes back
+ */
+static void namespace_flush(uint32_t ns, bool all)
+{
+	uint32_t *flushed = all ? &all_flushed : &ns_flushed[ns];
+	uint32_t epoch = __atomic_add_fetch(&flush_epoch, 1, __ATOMIC_SEQ_CST);
+	uint32_t old = __atomic_load_n(flushed, __ATOMIC_RELAXED);
+	while (old < epoch &&
+	       !__atomic_compare_exchange_n(flushed, &old, epoch, true,
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {}
+}
+
+static void conn_stamp(struct conn *conn)
+{
+	conn->epoch = __atomic_load_n(&flush_epoch, __ATOMIC_SEQ_CST);
+}
+#endif
+
+#ifdef CONFIG_ETAG
+/* boot time in nanoseconds, see thread_etag() */
+static uint64_t etag_base;
+
+/**
+ * thread_etag - Generate an etag, which is unique among kvs of all threads
+ * 
+ * Threads take turns in the sequence starting from @etag_base, so etags are
+ * not reused after restart either, as long as a thread generates less than
+ * one etag every CONFIG_THREAD_NR nanoseconds and the clock does not go back.
+ */
+static uint64_t thread_etag(struct thread *t)
+{
+	t->etag += CONFIG_THREAD_NR;
+	return t->etag;
+}
+#endif
+
+/**
+ * now_ns - Get the monotonic time (in nanoseconds)
+ */
+static uint64_t now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#ifdef CONFIG_LATENCY
+/* histograms read before the last reset, see threads_latency_reset() */
+static uint64_t latency_base[LAT_NR][LAT_BUCKET_NR];
+
+/**
+ * lat_record - Record the latency since @start to histogram @hist of @t
+ */
+static void lat_record(struct thread *t, enum lat_hist hist, uint64_t start)
+{
+	uint64_t *n = &t->latency.n[hist][lat_bucket(now_ns() - start)];
+	WRITE_ONCE(*n, *n + 1);
+}
+
+/**
+ * conn_lat_begin - Start timing the command of @conn for histogram @hist
+ */
+static void conn_lat_begin(struct conn *conn, enum lat_hist hist)
+{
+	conn->lat_start = now_ns();
+	conn->lat = hist;
+}
+
+/**
+ * conn_lat_end - Record the command of @conn if it is timed
+ */
+static void conn_lat_end(struct thread *t, struct conn *conn)
+{
+	if (conn->lat != LAT_NONE) {
+		lat_record(t, conn->lat, conn->lat_start);
+		conn->lat = LAT_NONE;
+	}
+}
+#endif
+
 static void kv_enable(struct thread *t, struct conn *conn)
 {
 	struct kv *kv = conn_kv(conn);
 	kv->hash_node = conn->hash_node;
 	hlist_node_fix(&kv->hash_node);
+#ifdef CONFIG_NAMESPACE
+	kv->epoch = conn->epoch;
+	kv->ns = key_namespace(KV_KEY(kv));
+#endif
+#ifdef CONFIG_ETAG
+	kv->etag = thread_etag(t);
+#endif
 	
-	if (hash_ghost(&t->hash_table, KV_KEY(kv))) {
-		kv->on_s_lru = 0;
-		list_lru_add(&t->m_lru_head, &kv->lru);
-	} else {
-		kv->on_s_lru = 1;
-		list_lru_add(&t->s_lru_head, &kv->lru);
-		t->s_lru_size++;
-	}
+	stat_inc(&t->stats, STAT_SET);
+#ifdef CONFIG_MRC
+	mrc_set(&t->mrc, key_hash(KV_KEY(kv)), KV_SIZE(kv));
+#endif
+#ifdef CONFIG_TRACE
+	trace_add(&t->trace, now_ns(),
+		  *(conn->key - 1) == CACHE_CMD_GET_OR_SET ? TRACE_FILL :
+		  TRACE_SET, TRACE_HIT, KV_KEY(kv), kv->val_size);
+#endif
+	bool ghost = hash_ghost(&t->hash_table, KV_KEY(kv));
+	if (ghost)
+		stat_inc(&t->stats, STAT_GHOST_HIT);
+	s3fifo_add(&t->s3fifo, kv, ghost);
 }
 
 /**
@@ -181,8 +530,12 @@ static void kv_enable(struct thread *t, struct conn *conn)
  */
 static void kv_disable(struct thread *t, struct kv *kv)
 {
-	list_lru_del(&kv->lru);
-	t->s_lru_size -= kv->on_s_lru;
+#ifdef CONFIG_REPLICA
+	/* other threads must not serve the value any more */
+	if (kv->replicated)
+		replica_unpublish(t, kv);
+#endif
+	s3fifo_del(&t->s3fifo, kv);
 	hash_del(&t->hash_table, KV_KEY(kv));
 
 	assert(kv->enabled);
@@ -211,6 +564,19 @@ static void kv_free(struct thread *t, struct kv *kv)
 	}
 }
 
+/* small queue ratio set by client, or SMALL_RATIO_AUTO */
+static uint32_t small_ratio = SMALL_RATIO_DEFAULT;
+
+/**
+ * threads_small_ratio - Set the small queue ratio of all threads to @ratio
+ * per-mille of the keys, or SMALL_RATIO_AUTO to let them tune themselves
+ */
+void threads_small_ratio(uint32_t ratio)
+{
+	assert(small_ratio_valid(ratio));
+	__atomic_store_n(&small_ratio, ratio, __ATOMIC_RELAXED);
+}
+
 /**
  * reclaim_lru - Reclaim one kv from lru
  */
@@ -220,16 +586,23 @@ static bool reclaim_lru(struct thread *t)
 	warmed_up(t);
 #endif
 
-	struct list_head *lru_head;
-	if (t->s_lru_size * 10 > t->hash_table.n)
-		lru_head = &t->s_lru_head;
-	else if (!list_empty(&t->m_lru_head))
-		lru_head = &t->m_lru_head;
+	uint32_t ratio = __atomic_load_n(&small_ratio, __ATOMIC_RELAXED);
+	if (ratio != SMALL_RATIO_AUTO)
+		WRITE_ONCE(t->s3fifo.small_ratio, ratio);
 	else
+		s3fifo_tune(&t->s3fifo, t->stats.n[STAT_EVICT],
+			    t->stats.n[STAT_GET_HIT] + t->stats.n[STAT_GET_MISS],
+			    t->stats.n[STAT_GHOST_HIT]);
+
+	struct kv *kv = s3fifo_victim(&t->s3fifo, t->hash_table.n);
+	if (kv == NULL)
 		return false;
 
-	struct kv *kv = container_of(list_lru_peek(lru_head), struct kv, lru);
+	stat_inc(&t->stats, kv->on_s_lru ? STAT_EVICT_SMALL : STAT_EVICT_MAIN);
+	probe(kv_evict, thread_index(t), KV_KEY(kv), kv->val_size,
+							kv->on_s_lru);
 	kv_disable(t, kv);
+	stat_inc(&t->stats, STAT_EVICT);
 	/**
 	 * Note: why the coldest kv have a borrower?
 	 * 
@@ -250,7 +623,16 @@ static bool reclaim_lru(struct thread *t)
  */
 static void reserve_page(struct thread *t, uint64_t page)
 {
+	if (t->memory.free_pages >= page)
+		return;
+
+#ifdef CONFIG_LATENCY
+	uint64_t start = now_ns();
+#endif
 	while (t->memory.free_pages < page && reclaim_lru(t)) {}
+#ifdef CONFIG_LATENCY
+	lat_record(t, LAT_EVICT, start);
+#endif
 }
 
 /**
@@ -278,8 +660,17 @@ static void *memory_malloc_advance(struct thread *t, uint64_t page)
  */
 static void reserve_kv_cache(struct thread *t, struct kv_cache *cache)
 {
+	if (cache->free_objects > 0 || t->memory.free_pages >= cache->slab_page)
+		return;
+
+#ifdef CONFIG_LATENCY
+	uint64_t start = now_ns();
+#endif
 	while (cache->free_objects == 0 &&
 		t->memory.free_pages < cache->slab_page && reclaim_lru(t)) {}
+#ifdef CONFIG_LATENCY
+	lat_record(t, LAT_EVICT, start);
+#endif
 }
 
 /**
@@ -288,9 +679,18 @@ static void reserve_kv_cache(struct thread *t, struct kv_cache *cache)
  */
 static void reserve_kv_cache_aggressive(struct thread *t, struct kv_cache *cache)
 {
+	if (cache->free_objects > 0)
+		return;
+
+#ifdef CONFIG_LATENCY
+	uint64_t start = now_ns();
+#endif
 	uint64_t page = t->memory.free_pages + cache->slab_page;
 	while (cache->free_objects == 0 &&
 		t->memory.free_pages < page && reclaim_lru(t)) {}
+#ifdef CONFIG_LATENCY
+	lat_record(t, LAT_EVICT, start);
+#endif
 }
 
 static struct kv *kv_cache_malloc_kv_advance(
@@ -348,92 +748,425 @@ static void *kv_malloc(struct thread *t, unsigned char *key, uint64_t val_size)
 	return kv;
 }
 
+/**
+ * kv_touch - Move the enabled @kv to the hot end of the main lru
+ */
+static void kv_touch(struct thread *t, struct kv *kv)
+{
+	if (s3fifo_touch(&t->s3fifo, kv))
+		stat_inc(&t->stats, STAT_PROMOTE);
+}
+
 static void conn_borrow_kv(struct thread *t, struct conn *conn, struct kv *kv)
 {
 	assert(kv->enabled);
 	kv_borrow(kv, &conn->kv_borrower);
-	list_lru_del(&kv->lru);
-	list_lru_add(&t->m_lru_head, &kv->lru);
-	t->s_lru_size -= kv->on_s_lru;
-	kv->on_s_lru = 0;
+	kv_touch(t, kv);
 }
 
-static void conn_return_kv(struct thread *t, struct conn *conn)
+#ifdef CONFIG_IO_URING
+/**
+ * kv_unpin - @kv has no borrower now, the slab it is allocated from may be the
+ * one its kv_cache waits for, see kv_cache_unpin()
+ */
+static void kv_unpin(struct thread *t, struct kv *kv)
 {
-	struct kv *kv = conn_kv(conn);
-	kv_return(&conn->kv_borrower);
+	uint64_t size = KV_SIZE(kv);
+	if (size <= KV_CACHE_OBJ_SIZE_MAX) {
+		struct kv_cache *cache = kv_cache_get(t, size);
+		kv_cache_unpin(cache, kv->soo, &t->memory);
+	} else if (kv_is_concat(kv)) {
+		struct kv_cache *cache = kv_cache_get(t, (size & PAGE_MASK) + 8);
+		kv_cache_unpin(cache, kv->soo, &t->memory);
+	}
+}
+#endif
 
-	if (!kv->enabled && kv_no_borrower(kv))
+static void borrower_return_kv(struct thread *t, struct kv_borrower *borrower)
+{
+	struct kv *kv = borrower->kv;
+	kv_return(borrower);
+
+	if (!kv_no_borrower(kv))
+		return;
+	if (!kv->enabled)
 		kv_free(t, kv);
+#ifdef CONFIG_IO_URING
+	else
+		kv_unpin(t, kv);
+#endif
 }
 
-static void conn_lock_key(struct thread *t, struct conn *conn)
+static void conn_return_kv(struct thread *t, struct conn *conn)
 {
-	hash_add(&t->hash_table, conn->key, &t->memory);
-	// Note: conn->interest might be used as a list node before
-	list_head_init(&conn->interest);
+	borrower_return_kv(t, &conn->kv_borrower);
 }
 
-static bool conn_with_key_locked(struct conn *conn)
+/**
+ * conn_res_head - Get the part of the response @conn sends before the value
+ * @n: returns number of bytes of the part
+ */
+static unsigned char *conn_res_head(struct conn *conn, uint64_t *n)
 {
-	return conn->state > CONN_STATE_FREE;
+#ifdef CONFIG_ETAG
+	if (conn->state == CONN_STATE_GET_OUT_ETAG) {
+		*n = GET_ETAG_RES_SIZE;
+		return (unsigned char *)&conn->etag;
+	}
+#endif
+	*n = GET_RES_SIZE;
+	return conn->buffer;
 }
 
-static void __call_clock(struct thread *t, struct conn *conn)
+#ifdef CONFIG_ZEROCOPY
+/**
+ * conn_zerocopy - Check if the kv borrowed by @conn should be sent with zero
+ * copy
+ * 
+ * Note: (@conn->zc_borrower) holds one kv only, until all the sends refer to
+ * it are completed, other kvs are copied in the meantime
+ */
+static bool conn_zerocopy(struct conn *conn)
 {
-	assert(!conn->clock_called);
-	conn->clock_called = true;
-	hlist_add(&t->clock_probation, &conn->clock);
+	struct kv *kv = conn_kv(conn);
+	return conn->length >= CONFIG_ZEROCOPY_THRESHOLD &&
+	       (conn->zc_borrower.kv == NULL || conn->zc_borrower.kv == kv);
 }
 
-static void call_clock(struct thread *t, struct conn *conn)
+/**
+ * conn_zerocopy_release - Return the kv held for zero copy sends if all of
+ * them are completed
+ */
+static void conn_zerocopy_release(struct thread *t, struct conn *conn)
 {
-	if (!conn->clock_called)
-		__call_clock(t, conn);
+	if (conn->zc_borrower.kv && conn->zc_sent == conn->zc_done)
+		borrower_return_kv(t, &conn->zc_borrower);
 }
+#endif
 
-static void cancel_clock(struct conn *conn)
+#ifdef CONFIG_REPLICA
+/**
+ * replica_publish - Publish a replica of @kv for other threads
+ * @hash: dispatch hash of the key
+ */
+static void replica_publish(struct thread *t, struct kv *kv, uint64_t hash)
 {
-	if (conn->clock_called) {
-		conn->clock_called = false;
-		hlist_del(&conn->clock);
+	if (__atomic_load_n(&replica_nr, __ATOMIC_RELAXED) >= CONFIG_REPLICA_NR)
+		return;
+
+	struct replica *r = malloc(sizeof(*r) + KV_KEY_SIZE(kv) + kv->val_size);
+	if (r == NULL)
+		return;
+
+	r->hash = hash;
+	r->epoch = __atomic_add_fetch(&replica_epoch, 1, __ATOMIC_RELAXED);
+	r->owner = t - threads;
+	r->val_size = kv->val_size;
+#ifdef CONFIG_NAMESPACE
+	r->flush_epoch = kv->epoch;
+	r->ns = kv->ns;
+#endif
+	memcpy(REPLICA_KEY(r), KV_KEY(kv), KV_KEY_SIZE(kv));
+
+	struct iovec iov[2];
+	int iov_len = kv_val_to_iovec(kv, 0, iov);
+	unsigned char *val = REPLICA_VAL(r);
+	for (int i = 0; i < iov_len; i++) {
+		memcpy(val, iov[i].iov_base, iov[i].iov_len);
+		val += iov[i].iov_len;
+	}
+
+	for (int i = 0; i < CONFIG_REPLICA_NR; i++) {
+		struct replica *empty = NULL;
+		if (__atomic_compare_exchange_n(&replicas[i], &empty, r, false,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			__atomic_add_fetch(&replica_nr, 1, __ATOMIC_RELAXED);
+			kv->replicated = 1;
+			return;
+		}
 	}
+	free(r);
 }
 
-static void __change_to_get_out_miss(struct conn *conn)
-{
+/**
+ * hot_key_sample - Count a GET hit of @kv, and replicate @kv if it is hot
+ */
+static void hot_key_sample(struct thread *t, struct kv *kv)
+{
+	if (++t->hot_sample % HOT_KEY_SAMPLE != 0)
+		return;
+
+	if (t->hot_sample % (HOT_KEY_SAMPLE * HOT_KEY_DECAY) == 0) {
+		for (int i = 0; i < HOT_KEY_NR; i++)
+			t->hot_keys[i].count >>= 1;
+	}
+
+	if (kv->replicated || kv->val_size > CONFIG_REPLICA_VAL_MAX)
+		return;
+
+	/* the Space-Saving algorithm, the least counted candidate is replaced */
+	uint64_t hash = key_dispatch_hash(KV_KEY(kv));
+	struct hot_key *hot = NULL, *min = &t->hot_keys[0];
+	for (int i = 0; i < HOT_KEY_NR; i++) {
+		if (t->hot_keys[i].hash == hash) {
+			hot = &t->hot_keys[i];
+			break;
+		}
+		if (t->hot_keys[i].count < min->count)
+			min = &t->hot_keys[i];
+	}
+	if (hot == NULL) {
+		hot = min;
+		hot->hash = hash;
+	}
+
+	if (++hot->count >= HOT_KEY_COUNT) {
+		hot->count = 0;
+		replica_publish(t, kv, hash);
+	}
+}
+
+/**
+ * replica_get - Let @conn borrow our copy of the replica of @conn->key
+ * @hash: dispatch hash of the key
+ * @owner: the thread owns the key
+ * 
+ * @return: true on borrowed, false on the key is not replicated
+ */
+static bool replica_get(struct thread *t, struct conn *conn, uint64_t hash,
+							struct thread *owner)
+{
+	if (__atomic_load_n(&replica_nr, __ATOMIC_RELAXED) == 0)
+		return false;
+
+	for (int i = 0; i < CONFIG_REPLICA_NR; i++) {
+		struct replica *r;
+		r = __atomic_load_n(&replicas[i], __ATOMIC_ACQUIRE);
+		if (r == NULL || r->hash != hash || r->owner != owner - threads ||
+		    memcmp(REPLICA_KEY(r), conn->key, KEY_SIZE(conn->key)) != 0)
+			continue;
+	#ifdef CONFIG_NAMESPACE
+		/* the owner drops the kv once the key is looked up */
+		if (namespace_flushed(r->ns, r->flush_epoch))
+			return false;
+	#endif
+
+		struct replica_copy *copy = &t->replica_copies[i];
+		if (copy->borrower.kv == NULL || copy->epoch != r->epoch) {
+			if (copy->borrower.kv)
+				borrower_return_kv(t, &copy->borrower);
+
+			struct kv *kv = kv_malloc(t, conn->key, r->val_size);
+			if (kv == NULL)
+				return false;
+
+			kv_init(kv, conn->key, r->val_size);
+			kv_copy_val(kv, REPLICA_VAL(r), r->val_size);
+			kv->replicated = 1;
+			kv_borrow(kv, &copy->borrower);
+			copy->epoch = r->epoch;
+		}
+		kv_borrow(copy->borrower.kv, &conn->kv_borrower);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * replica_copies_shrink - Free our copies of the replicas that are gone
+ */
+static void replica_copies_shrink(struct thread *t)
+{
+	for (int i = 0; i < CONFIG_REPLICA_NR; i++) {
+		struct replica_copy *copy = &t->replica_copies[i];
+		if (copy->borrower.kv == NULL)
+			continue;
+
+		struct replica *r;
+		r = __atomic_load_n(&replicas[i], __ATOMIC_ACQUIRE);
+		if (r == NULL || r->epoch != copy->epoch)
+			borrower_return_kv(t, &copy->borrower);
+	}
+}
+#endif
+
+static void conn_lock_key(struct thread *t, struct conn *conn)
+{
+#ifdef CONFIG_NAMESPACE
+	conn_stamp(conn);
+#endif
+	hash_add(&t->hash_table, conn->key, &t->memory);
+	probe(lock_acquire, thread_index(t), conn_slot(t, conn), conn->key);
+	// Note: conn->interest might be used as a list node before
+	list_head_init(&conn->interest);
+}
+
+static bool conn_with_key_locked(struct conn *conn)
+{
+	return conn->state > CONN_STATE_FREE;
+}
+
+static void __call_clock(struct thread *t, struct conn *conn)
+{
+	assert(!conn->clock_called);
+	conn->clock_called = true;
+	hlist_add(&t->clock_probation, &conn->clock);
+}
+
+static void call_clock(struct thread *t, struct conn *conn)
+{
+	if (!conn->clock_called)
+		__call_clock(t, conn);
+}
+
+static void cancel_clock(struct conn *conn)
+{
+	if (conn->clock_called) {
+		conn->clock_called = false;
+		hlist_del(&conn->clock);
+	}
+}
+
+static void __change_to_get_out_miss(struct conn *conn)
+{
 	conn->state = CONN_STATE_GET_OUT_MISS;
 	conn->unio = GET_RES_SIZE;
 	conn->miss = true;
 }
 
+#ifdef CONFIG_IO_URING
+#define URING_WAKE_UP	4
+
+static_assert(__alignof__(struct conn) > URING_WAKE_UP);
+
+/**
+ * thread_get_sqe - Get a submission queue entry from @t->ring
+ * 
+ * Note: there is always a free entry, see THREAD_URING_ENTRIES
+ */
+static struct io_uring_sqe *thread_get_sqe(struct thread *t)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&t->ring);
+	if (sqe == NULL) {
+		/* only happens when the kernel polling thread falls behind */
+		uring_submit_and_wait(&t->ring, 0);
+		sqe = uring_get_sqe(&t->ring);
+	}
+	assert(sqe);
+	return sqe;
+}
+
+/**
+ * thread_poll - Let @t->ring reports readable events of @fd
+ * @tag: tag of the event, the same as epoll event
+ */
+static void thread_poll(struct thread *t, int fd, uint64_t tag)
+{
+	struct io_uring_sqe *sqe = thread_get_sqe(t);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = ((uint64_t)fd << 32) | tag;
+}
+#endif
+
 static void epfd_weak_up_conn(struct thread *t, struct conn *conn)
 {
+#ifdef CONFIG_IO_URING
+	assert(!conn->inflight);
+	struct io_uring_sqe *sqe = thread_get_sqe(t);
+	sqe->opcode = IORING_OP_NOP;
+	sqe->user_data = (uint64_t)conn | URING_WAKE_UP;
+	conn->inflight = true;
+#else
 	struct epoll_event event;
 	event.events = EPOLLIN | EPOLLOUT | EPOLLET;
 	event.data.ptr = conn;
 	int ret __attribute__((unused));
 	ret = epoll_ctl(t->epfd, EPOLL_CTL_MOD, conn->fd, &event);
 	assert(ret == 0);
+#endif
+}
+
+/**
+ * conn_wake_retries - Let the commands waiting for the key locked by @conn run
+ * again, see CONN_STATE_RETRY_BLOCKED
+ */
+static void conn_wake_retries(struct thread *t, struct conn *conn)
+{
+	struct conn *curr, *temp;
+	list_for_each_entry_safe(curr, temp, &conn->interest, interest) {
+		if (curr->state != CONN_STATE_RETRY_BLOCKED)
+			continue;
+		list_del(&curr->interest);
+		curr->state = CONN_STATE_RETRY;
+		epfd_weak_up_conn(t, curr);
+	}
+}
+
+#ifndef CONFIG_IO_URING
+static void mux_wake(struct thread *t, struct conn *req, struct kv *kv);
+#endif
+
+/**
+ * conn_next_filler - Get the first conn waiting for the key locked by @conn
+ * that is able to fill the value
+ * 
+ * @return: the conn, or NULL if there is none
+ */
+static struct conn *conn_next_filler(struct conn *conn)
+{
+	struct conn *curr;
+	list_for_each_entry(curr, &conn->interest, interest) {
+	#ifndef CONFIG_IO_URING
+		/* requests of multiplexed connections never fill the value */
+		if (curr->state == CONN_STATE_MUX_BLOCKED)
+			continue;
+	#endif
+		return curr;
+	}
+	return NULL;
 }
 
+/**
+ * conn_unlock_key_for_failure - Unlock the key locked by @conn
+ * 
+ * Note: caller should return the kv borrowed by @conn
+ */
 static void conn_unlock_key_for_failure(struct thread *t, struct conn *conn)
 {
 	cancel_clock(conn);
-	if (conn_kv(conn))
-		conn_return_kv(t, conn);
+	conn_wake_retries(t, conn);
 
-	if (list_empty(&conn->interest)) {
+	struct conn *first = conn_next_filler(conn);
+	if (first == NULL) {
+		probe(lock_release, thread_index(t), conn_slot(t, conn),
+								conn->key, 0);
 		hash_del(&t->hash_table, conn->key);
+	#ifndef CONFIG_IO_URING
+		struct conn *curr, *temp;
+		list_for_each_entry_safe(curr, temp, &conn->interest, interest) {
+			list_del(&curr->interest);
+			mux_wake(t, curr, NULL);
+		}
+	#endif
 		return;
 	}
 
-	struct conn *first;
-	first = list_first_entry(&conn->interest, struct conn, interest);
+	probe(lock_transfer, thread_index(t), conn_slot(t, conn),
+					conn_slot(t, first), conn->key);
 	list_del(&conn->interest);
 	first->hash_node = conn->hash_node;
 	hlist_node_fix(&first->hash_node);
+#ifdef CONFIG_NAMESPACE
+	conn_stamp(first);
+#endif
 	__call_clock(t, first);
+#ifdef CONFIG_LATENCY
+	lat_record(t, LAT_GET_BLOCKED, first->lat_start);
+	conn_lat_begin(first, LAT_GET_MISS);
+#endif
 	// Note: don't call change_to_get_out_miss(), we should not trust client 
 	__change_to_get_out_miss(first);
 	epfd_weak_up_conn(t, first);
@@ -445,17 +1178,91 @@ static void conn_unlock_key_for_failure(struct thread *t, struct conn *conn)
 static void free_conn(struct thread *t, struct conn *conn)
 {
 	debug_printf("free conn:\n");
+	probe(conn_free, thread_index(t), conn_slot(t, conn), conn->state);
 
 	if (conn_with_key_locked(conn))
 		conn_unlock_key_for_failure(t, conn);
-	else if (conn_kv(conn))
-		conn_return_kv(t, conn);
-	else if (conn->state == CONN_STATE_GET_BLOCKED)
+	else if (conn->state == CONN_STATE_GET_BLOCKED ||
+		 conn->state == CONN_STATE_ROUTE_BLOCKED ||
+		 conn->state == CONN_STATE_RETRY_BLOCKED)
 		list_del(&conn->interest);
+#ifdef CONFIG_SHARD
+	else if (conn->state == CONN_STATE_OUT_SHARD_MAP)
+		t->shard_map_readers--;
+#endif
+#ifndef CONFIG_RAFT
+	else if (conn->state == CONN_STATE_OUT_STATS)
+		t->stats_readers--;
+#endif
+#if defined(CONFIG_LATENCY) && !defined(CONFIG_RAFT)
+	else if (conn->state == CONN_STATE_OUT_LATENCY)
+		t->latency_readers--;
+#endif
+#ifndef CONFIG_RAFT
+	else if (conn->state == CONN_STATE_OUT_TOP_KEYS)
+		t->topk_readers--;
+#endif
+#if defined(CONFIG_MRC) && !defined(CONFIG_RAFT)
+	else if (conn->state == CONN_STATE_OUT_MRC)
+		t->mrc_readers--;
+#endif
+
+	if (conn_kv(conn))
+		conn_return_kv(t, conn);
 
 	conn_free(t, conn);
 }
 
+#ifdef CONFIG_IO_URING
+/**
+ * conn_uring_msg - Submit a message request of @opcode for @conn
+ * @iovlen: length of @iov
+ * 
+ * Note: @iov is copied, because the request outlives the caller
+ */
+static void conn_uring_msg(struct thread *t, struct conn *conn,
+	uint8_t opcode, const struct iovec *iov, size_t iovlen, int flags)
+{
+	assert(!conn->inflight);
+	assert(iovlen <= sizeof(conn->iov) / sizeof(conn->iov[0]));
+	memcpy(conn->iov, iov, iovlen * sizeof(*iov));
+	memset(&conn->msg, 0, sizeof(conn->msg));
+	conn->msg.msg_iov = conn->iov;
+	conn->msg.msg_iovlen = iovlen;
+
+	struct io_uring_sqe *sqe = thread_get_sqe(t);
+	sqe->opcode = opcode;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = conn_slot(t, conn);
+	sqe->addr = (uint64_t)&conn->msg;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL | flags;
+	sqe->user_data = (uint64_t)conn;
+	conn->inflight = true;
+}
+
+/**
+ * conn_uring_result - Take the result of the completed request of @conn
+ * @n: where to store the result, in the way of read() or write()
+ * 
+ * @return: true on there is a result, false on the request is just submitted
+ */
+static bool conn_uring_result(struct conn *conn, ssize_t *n)
+{
+	if (!conn->res_ready)
+		return false;
+
+	conn->res_ready = false;
+	if (conn->res < 0) {
+		errno = -conn->res;
+		*n = -1;
+	} else {
+		*n = conn->res;
+	}
+	return true;
+}
+#endif
+
 /**
  * conn_check_read - Update @conn after a read
  * @n: the return value from read()
@@ -467,6 +1274,7 @@ static bool conn_check_read(struct thread *t, struct conn *conn, ssize_t n)
 	if (n > 0) {
 		assert(conn->unio >= (size_t)n);
 		conn->unio -= n;
+		stat_add(&t->stats, STAT_BYTES_IN, n);
 		return true;
 	}
 
@@ -477,34 +1285,50 @@ static bool conn_check_read(struct thread *t, struct conn *conn, ssize_t n)
 }
 
 /**
- * conn_read - Read from @conn to @buffer
+ * conn_read_msg - Read message from @conn to @iov
+ * @iovlen: length of @iov
  * 
  * @return: true on something is read, false on nothing is read
+ * 
+ * Note: for io_uring, false is also returned when the read is submitted, and
+ * the same call is expected when the read completes
  */
-static bool conn_read(
-struct thread *t, struct conn *conn, unsigned char *buffer)
+static bool conn_read_msg(
+struct thread *t, struct conn *conn, struct iovec *iov, size_t iovlen)
 {
 	assert(conn->unio > 0);
-	ssize_t n = read(conn->fd, buffer, conn->unio);
+#ifdef CONFIG_IO_URING
+	ssize_t n;
+	if (!conn_uring_result(conn, &n)) {
+		conn_uring_msg(t, conn, IORING_OP_RECVMSG, iov, iovlen, 0);
+		return false;
+	}
+#else
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovlen;
+
+	ssize_t n = recvmsg(conn->fd, &msg, 0);
+#endif
 	return conn_check_read(t, conn, n);
 }
 
 /**
- * conn_read_msg - Read message from @conn to @iov
- * @iovlen: length of @iov
+ * conn_read - Read from @conn to @buffer
  * 
  * @return: true on something is read, false on nothing is read
  */
-static bool conn_read_msg(
-struct thread *t, struct conn *conn, struct iovec *iov, size_t iovlen)
+static bool conn_read(
+struct thread *t, struct conn *conn, unsigned char *buffer)
 {
-	struct msghdr msg = {};
-	msg.msg_iov = iov;
-	msg.msg_iovlen = iovlen;
-
 	assert(conn->unio > 0);
-	ssize_t n = recvmsg(conn->fd, &msg, 0);
+#ifdef CONFIG_IO_URING
+	struct iovec iov = { .iov_base = buffer, .iov_len = conn->unio };
+	return conn_read_msg(t, conn, &iov, 1);
+#else
+	ssize_t n = read(conn->fd, buffer, conn->unio);
 	return conn_check_read(t, conn, n);
+#endif
 }
 
 /**
@@ -518,68 +1342,118 @@ static bool conn_check_write(struct thread *t, struct conn *conn, ssize_t n)
 	if (n > 0) {
 		assert(conn->unio >= (size_t)n);
 		conn->unio -= n;
+		stat_add(&t->stats, STAT_BYTES_OUT, n);
+	#ifdef CONFIG_LATENCY
+		if (conn->unio > 0 && conn->lat_stall == 0) {
+			conn->lat_stall = now_ns();
+		} else if (conn->unio == 0 && conn->lat_stall != 0) {
+			lat_record(t, LAT_WRITE, conn->lat_stall);
+			conn->lat_stall = 0;
+		}
+	#endif
 		return true;
 	}
 
 	assert(n == -1);
 	if (errno != EWOULDBLOCK)
 		free_conn(t, conn);
+#ifdef CONFIG_LATENCY
+	else if (conn->lat_stall == 0)
+		conn->lat_stall = now_ns();
+#endif
 
 	return false;
 }
 
 /**
- * conn_write - Write from @buffer to @conn
+ * conn_write_msg - Write message from @iov to @conn
+ * @iovlen: length of @iov
+ * @flags: flags of sendmsg(), MSG_ZEROCOPY is counted in (@conn->zc_sent)
  * 
  * @return: true on something is written, false on nothing is written
+ * 
+ * Note: for io_uring, false is also returned when the write is submitted, and
+ * the same call is expected when the write completes
  */
-static bool conn_write(
-struct thread *t, struct conn *conn, const unsigned char *buffer)
+static bool conn_write_msg(struct thread *t, struct conn *conn,
+				struct iovec *iov, size_t iovlen, int flags)
 {
 	assert(conn->unio > 0);
-	ssize_t n = send(conn->fd, buffer, conn->unio, MSG_NOSIGNAL);
+#ifdef CONFIG_IO_URING
+	ssize_t n;
+	if (!conn_uring_result(conn, &n)) {
+		uint8_t opcode = IORING_OP_SENDMSG;
+	#ifdef CONFIG_ZEROCOPY
+		if (flags & MSG_ZEROCOPY) {
+			opcode = IORING_OP_SENDMSG_ZC;
+			flags &= ~MSG_ZEROCOPY;
+		}
+	#endif
+		conn_uring_msg(t, conn, opcode, iov, iovlen, flags);
+		return false;
+	}
+#else
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovlen;
+
+	ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | flags);
+#ifdef CONFIG_ZEROCOPY
+	if (flags & MSG_ZEROCOPY) {
+		/* notifications are out of optmem, fall back to copy */
+		if (n == -1 && errno == ENOBUFS) {
+			flags &= ~MSG_ZEROCOPY;
+			n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | flags);
+		} else if (n > 0) {
+			conn->zc_sent++;
+		}
+	}
+#endif
+#endif
 	return conn_check_write(t, conn, n);
 }
 
 /**
- * conn_full_write - Write from @buffer to @conn
+ * conn_full_write_msg - Write message from @iov to @conn
+ * @iovlen: length of @iov
  * 
  * @return: true on full write, false on short write
  */
-static bool conn_full_write(
-struct thread *t, struct conn *conn, const unsigned char *buffer)
+static bool conn_full_write_msg(
+struct thread *t, struct conn *conn, struct iovec *iov, size_t iovlen)
 {
-	return conn_write(t, conn, buffer) && conn->unio == 0;
+	return conn_write_msg(t, conn, iov, iovlen, 0) && conn->unio == 0;
 }
 
 /**
- * conn_write_msg - Write message from @iov to @conn
- * @iovlen: length of @iov
+ * conn_write - Write from @buffer to @conn
  * 
  * @return: true on something is written, false on nothing is written
  */
-static bool conn_write_msg(
-struct thread *t, struct conn *conn, struct iovec *iov, size_t iovlen)
+static bool conn_write(
+struct thread *t, struct conn *conn, const unsigned char *buffer)
 {
-	struct msghdr msg = {};
-	msg.msg_iov = iov;
-	msg.msg_iovlen = iovlen;
-
 	assert(conn->unio > 0);
-	ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+#ifdef CONFIG_IO_URING
+	struct iovec iov;
+	iov.iov_base = (unsigned char *)buffer;
+	iov.iov_len = conn->unio;
+	return conn_write_msg(t, conn, &iov, 1, 0);
+#else
+	ssize_t n = send(conn->fd, buffer, conn->unio, MSG_NOSIGNAL);
 	return conn_check_write(t, conn, n);
+#endif
 }
 
 /**
- * conn_full_write_msg - Write message from @iov to @conn
- * @iovlen: length of @iov
+ * conn_full_write - Write from @buffer to @conn
  * 
  * @return: true on full write, false on short write
  */
-static bool conn_full_write_msg(
-struct thread *t, struct conn *conn, struct iovec *iov, size_t iovlen)
+static bool conn_full_write(
+struct thread *t, struct conn *conn, const unsigned char *buffer)
 {
-	return conn_write_msg(t, conn, iov, iovlen) && conn->unio == 0;
+	return conn_write(t, conn, buffer) && conn->unio == 0;
 }
 
 /**
@@ -590,9 +1464,22 @@ struct thread *t, struct conn *conn, struct iovec *iov, size_t iovlen)
 static bool conn_write_byte_zero(struct thread *t, struct conn *conn)
 {
 	static const unsigned char zero[1] = { 0 };
+#ifdef CONFIG_IO_URING
+	ssize_t n;
+	if (!conn_uring_result(conn, &n)) {
+		struct iovec iov;
+		iov.iov_base = (unsigned char *)zero;
+		iov.iov_len = 1;
+		conn_uring_msg(t, conn, IORING_OP_SENDMSG, &iov, 1, 0);
+		return false;
+	}
+#else
 	ssize_t n = send(conn->fd, &zero, 1, MSG_NOSIGNAL);
-	if (n > 0)
+#endif
+	if (n > 0) {
+		stat_inc(&t->stats, STAT_BYTES_OUT);
 		return true;
+	}
 
 	assert(n == -1);
 	if (errno != EWOULDBLOCK)
@@ -606,6 +1493,10 @@ static void change_to_in_cmd(struct conn *conn)
 	assert(conn_kv(conn) == NULL);
 	conn->state = CONN_STATE_IN_CMD;
 	conn->unio = CMD_SIZE_MAX;
+#ifdef CONFIG_LATENCY
+	/* replies not ended by conn_lat_end() are not timed */
+	conn->lat = LAT_NONE;
+#endif
 	/* Don't call state_in_cmd(), it is very likely that we are blocked on
 	read. And we just out something, so the read event can not be triggered
 	this round, it will be triggered later. */
@@ -615,8 +1506,12 @@ static void state_out_success(struct thread *t, struct conn *conn)
 {
 	debug_printf("CONN_STATE_OUT_SUCCESS:\n");
 
-	if (conn_write_byte_zero(t, conn))
+	if (conn_write_byte_zero(t, conn)) {
+	#ifdef CONFIG_LATENCY
+		conn_lat_end(t, conn);
+	#endif
 		change_to_in_cmd(conn);
+	}
 }
 
 static void change_to_out_success(struct thread *t, struct conn *conn)
@@ -625,108 +1520,2166 @@ static void change_to_out_success(struct thread *t, struct conn *conn)
 	state_out_success(t, conn);
 }
 
+#ifdef CONFIG_ZEROCOPY
+/**
+ * state_get_out_hit_zerocopy - Send the hit with zero copy
+ * 
+ * Note: zero copy refers to the memory until the completion arrives, the kv is
+ * held by (@conn->zc_borrower), but (@conn->buffer) is not, so the response
+ * header is copied in advance
+ */
+static void state_get_out_hit_zerocopy(struct thread *t, struct conn *conn)
+{
+	struct kv *kv = conn_kv(conn);
+	uint64_t head_n;
+	unsigned char *head = conn_res_head(conn, &head_n);
+	uint64_t written = head_n + conn->length - conn->unio;
+	if (written < head_n) {
+		struct iovec iov;
+		iov.iov_base = head + written;
+		iov.iov_len = head_n - written;
+		if (!conn_write_msg(t, conn, &iov, 1, MSG_MORE) ||
+		    conn->unio > conn->length)
+			return;
+	}
+
+	if (conn->zc_borrower.kv == NULL)
+		kv_borrow(kv, &conn->zc_borrower);
+
+	struct iovec iov[2];
+	uint64_t i = conn->offset + conn->length - conn->unio;
+	uint64_t iov_len = kv_val_range_to_iovec(kv, i, conn->unio, iov);
+	if (conn_write_msg(t, conn, iov, iov_len, MSG_ZEROCOPY) &&
+	    conn->unio == 0) {
+		conn_return_kv(t, conn);
+		conn_zerocopy_release(t, conn);
+	#ifdef CONFIG_LATENCY
+		conn_lat_end(t, conn);
+	#endif
+		change_to_in_cmd(conn);
+	}
+}
+#endif
+
 static void state_get_out_hit(struct thread *t, struct conn *conn)
 {
 	debug_printf("CONN_STATE_GET_OUT_HIT: %lu\n",
 					(uint64_t)conn_kv(conn)->val_size);
 
-	uint64_t written = GET_RES_SIZE + conn_kv(conn)->val_size - conn->unio;
+#ifdef CONFIG_ZEROCOPY
+	if (conn_zerocopy(conn)) {
+		state_get_out_hit_zerocopy(t, conn);
+		return;
+	}
+#endif
+
+	uint64_t head_n;
+	unsigned char *head = conn_res_head(conn, &head_n);
+	uint64_t written = head_n + conn->length - conn->unio;
 	struct iovec iov[3];
 	uint64_t iov_len;
-	if (written < GET_RES_SIZE) {
-		iov[0].iov_base = conn->buffer + written;
-		iov[0].iov_len = GET_RES_SIZE - written;
-		iov_len = 1 + kv_val_to_iovec(conn_kv(conn), 0, iov + 1);
+	if (written < head_n) {
+		iov[0].iov_base = head + written;
+		iov[0].iov_len = head_n - written;
+		iov_len = 1 + kv_val_range_to_iovec(conn_kv(conn), conn->offset,
+							conn->length, iov + 1);
 	} else {
-		uint64_t i = conn_kv(conn)->val_size - conn->unio;
-		iov_len = kv_val_to_iovec(conn_kv(conn), i, iov);
+		uint64_t i = conn->offset + conn->length - conn->unio;
+		iov_len = kv_val_range_to_iovec(conn_kv(conn), i, conn->unio,
+									iov);
 	}
 
 	if (conn_full_write_msg(t, conn, iov, iov_len)) {
 		conn_return_kv(t, conn);
+	#ifdef CONFIG_LATENCY
+		conn_lat_end(t, conn);
+	#endif
 		change_to_in_cmd(conn);
 	}
 }
 
-static void change_to_get_out_hit(struct thread *t, struct conn *conn)
+/**
+ * conn_res_hit - Fill (@conn->buffer) with the hit of the borrowed kv
+ */
+static void conn_res_hit(struct conn *conn)
 {
-	conn->state = CONN_STATE_GET_OUT_HIT;
-	conn->unio = GET_RES_SIZE + conn_kv(conn)->val_size;
 	conn->size = htole64(conn_kv(conn)->val_size);
 	conn->miss = false;
-	state_get_out_hit(t, conn);
+#ifdef CONFIG_REPLICA
+	if (conn_kv(conn)->replicated)
+		conn->miss = GET_RES_REPLICATED;
+#endif
 }
 
-#define SET_EXTRA_BUFFER (16 << 10)
-
-static void change_to_set_in_value_size(struct conn *conn)
+/**
+ * change_to_get_out_range - Send @length bytes of the value from @offset
+ * 
+ * Note: [value-size] of the response is the size of the whole value
+ */
+static void change_to_get_out_range(struct thread *t, struct conn *conn,
+					uint64_t offset, uint64_t length)
+{
+	conn->state = CONN_STATE_GET_OUT_HIT;
+	conn->offset = offset;
+	conn->length = length;
+	conn->unio = GET_RES_SIZE + length;
+	conn_res_hit(conn);
+	state_get_out_hit(t, conn);
+}
+
+static void change_to_get_out_hit(struct thread *t, struct conn *conn)
+{
+	change_to_get_out_range(t, conn, 0, conn_kv(conn)->val_size);
+}
+
+#ifdef CONFIG_IO_URING
+/* io_uring reads outlive the stack frame, so no extra buffer on the stack */
+#define SET_EXTRA_BUFFER 0
+#else
+#define SET_EXTRA_BUFFER (16 << 10)
+#endif
+
+static_assert(BULK_DATA_SIZE >= SET_EXTRA_BUFFER);
+#ifndef CONFIG_IO_URING
+static_assert(MUX_DATA_SIZE >= SET_EXTRA_BUFFER);
+#endif
+
+/**
+ * cmd_has_payload - Check if @cmd is followed by a payload, which the client
+ * sends without waiting, so it may be read together with the command
+ */
+static bool cmd_has_payload(enum cache_cmd cmd)
+{
+	return cmd == CACHE_CMD_SET || cmd == CACHE_CMD_BULK_LOAD ||
+	       cmd == CACHE_CMD_INCR || cmd == CACHE_CMD_DECR ||
+	       cmd == CACHE_CMD_ADD || cmd == CACHE_CMD_GET_RANGE ||
+	       cmd == CACHE_CMD_GET_IF_CHANGED || cmd == CACHE_CMD_MUX;
+}
+
+/**
+ * conn_set_extra_buffer - Get the number of bytes read ahead with the value
+ * size
+ * 
+ * Note: bytes read after the value are the next command, conns that may route
+ * it read ahead no more than (struct route_msg) carries
+ */
+static uint64_t conn_set_extra_buffer(struct conn *conn __attribute__((unused)))
+{
+#if defined(CONFIG_SHARD)
+	return SET_EXTRA_BUFFER < CMD_SIZE_MAX ? SET_EXTRA_BUFFER : CMD_SIZE_MAX;
+#elif defined(CONFIG_ROUTE)
+	if (conn->route)
+		return SET_EXTRA_BUFFER < CMD_SIZE_MAX ? SET_EXTRA_BUFFER :
+							 CMD_SIZE_MAX;
+#endif
+	return SET_EXTRA_BUFFER;
+}
+
+#ifndef CONFIG_IO_URING
+/* maximum size of kv header, key and SET_EXTRA_BUFFER (in pages) */
+#define LANDING_PAGE ((sizeof(struct kv) + 1 + CONFIG_KEY_SIZE_MAX +	       \
+			SET_EXTRA_BUFFER + PAGE_MASK) >> PAGE_SHIFT)
+/* number of pages allocated for (struct thread->landing) each time */
+#define LANDING_ARENA_PAGE 64
+
+static_assert(LANDING_ARENA_PAGE >= LANDING_PAGE);
+
+/**
+ * landing_get - Get the landing arena of @t, allocate a new one if there is
+ * not enough room left
+ * 
+ * @return: the landing arena, or NULL on failure
+ */
+static unsigned char *landing_get(struct thread *t)
+{
+	if (t->landing_page >= LANDING_PAGE)
+		return t->landing;
+
+	if (t->landing_page > 0)
+		memory_free(&t->memory, t->landing, t->landing_page);
+
+	t->landing = memory_malloc_advance(t, LANDING_ARENA_PAGE);
+	t->landing_page = t->landing ? LANDING_ARENA_PAGE : 0;
+	return t->landing;
+}
+
+/**
+ * kv_adopt_landing - Take a kv from the landing arena, that the value read by
+ * state_set_in_value_size() is already in place
+ * @n: number of value bytes in the landing arena
+ * 
+ * @return: the kv, or NULL if the kv should not be page allocated or there is
+ * not enough room left
+ * 
+ * Note: the pages left in the landing arena are still mapped, which keeps the
+ * bytes read after the value available until the next landing_get()
+ */
+static struct kv *kv_adopt_landing(
+struct thread *t, unsigned char *key, uint64_t val_size, uint64_t n)
+{
+	uint64_t size = sizeof(struct kv) + KEY_SIZE(key) + val_size;
+	if (size <= KV_CACHE_OBJ_SIZE_MAX)
+		return NULL;
+
+	unsigned int overflow = size & PAGE_MASK;
+	bool concat = !(overflow == 0 || overflow + 8 > KV_CACHE_OBJ_SIZE_MAX);
+	uint64_t page = concat ? size >> PAGE_SHIFT :
+				 (size + PAGE_MASK) >> PAGE_SHIFT;
+	if (page > t->landing_page)
+		return NULL;
+
+	struct kv *kv = (void *)t->landing;
+	if (concat) {
+		struct kv_cache *cache = kv_cache_get(t, overflow + 8);
+		if (!kv_cache_malloc_concat_val_advance(t, cache, kv))
+			return NULL;
+	} else {
+		/* fake a soo for kv_is_concat() */
+		kv->soo = SOO_MAKE(kv, 0);
+	}
+	t->landing += page << PAGE_SHIFT;
+	t->landing_page -= page;
+
+	kv_init(kv, key, val_size);
+	if (concat) {
+		/* the value overflows into the pages after the kv */
+		struct concat_val *concat_val = SOO_OBJ(kv->soo);
+		uint64_t in_page = (page << PAGE_SHIFT) - (size - val_size);
+		if (n > val_size)
+			n = val_size;
+		if (n > in_page)
+			memcpy(concat_val->data, KV_VAL(kv) + in_page, n - in_page);
+	}
+	return kv;
+}
+#endif
+
+static void change_to_set_in_value_size(struct conn *conn)
+{
+	conn->state = CONN_STATE_SET_IN_VALUE_SIZE;
+	conn->unio = SET_REQ_SIZE + conn_set_extra_buffer(conn);
+	/* Don't call state_set_in_value_size(), it is very likely that we are
+	blocked on read. And we just out miss, so the read event can not be
+	triggered this round, it will be triggered later. */
+}
+
+static void state_get_out_miss(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_GET_OUT_MISS:\n");
+
+	uint64_t written = GET_RES_SIZE - conn->unio;
+	if (conn_full_write(t, conn, conn->buffer + written))
+		change_to_set_in_value_size(conn);
+}
+
+static void change_to_get_out_miss(struct thread *t, struct conn *conn)
+{
+	__change_to_get_out_miss(conn);
+	state_get_out_miss(t, conn);
+}
+
+static void conn_unlock_key_for_success(struct thread *t, struct conn *conn)
+{
+	probe(lock_release, thread_index(t), conn_slot(t, conn), conn->key, 1);
+	cancel_clock(conn);
+	conn_wake_retries(t, conn);
+	kv_enable(t, conn);
+	struct kv *kv = conn_kv(conn);
+
+	struct conn *curr, *temp;
+	list_for_each_entry_safe(curr, temp, &conn->interest, interest) {
+		list_del(&curr->interest);
+	#ifndef CONFIG_IO_URING
+		if (curr->state == CONN_STATE_MUX_BLOCKED) {
+			mux_wake(t, curr, kv);
+			continue;
+		}
+	#endif
+	#ifdef CONFIG_LATENCY
+		lat_record(t, LAT_GET_BLOCKED, curr->lat_start);
+	#endif
+		conn_borrow_kv(t, curr, kv);
+		change_to_get_out_hit(t, curr);
+	}
+
+#ifdef CONFIG_SHARD
+	/* the shard is moved away while we are reading the value */
+	if (shard_thread(key_shard(KV_KEY(kv))) != t)
+		kv_disable(t, kv);
+#endif
+	conn_return_kv(t, conn);
+#ifdef CONFIG_LATENCY
+	conn_lat_end(t, conn);
+#endif
+
+	uint64_t page = hash_resize_page(&t->hash_table);
+	if (page > 0) {
+		void *new = memory_malloc_advance(t, page);
+		if (new)
+			hash_resize(&t->hash_table, page, new);
+	}
+}
+
+/**
+ * sub_changed - Tell the subscribers of @t that the value of @key is changed
+ * 
+ * Note: events are sent at the end of the round, see subscribers_flush()
+ */
+static void sub_changed(struct thread *t, const unsigned char *key)
+{
+	uint32_t n = 1 + KEY_SIZE(key);
+	struct sub *sub;
+	list_for_each_entry(sub, &t->subscribers, node) {
+		/* the pending SUB_EVENT_RESYNC covers it */
+		if (sub->resync)
+			continue;
+
+		if (SUB_DATA_SIZE - sub->tail < n) {
+			sub->resync = true;
+			continue;
+		}
+		sub->data[sub->tail] = SUB_EVENT_CHANGED;
+		memcpy(sub->data + sub->tail + 1, key, KEY_SIZE(key));
+		sub->tail += n;
+	}
+	t->sub_pending = true;
+}
+
+/**
+ * kv_changed - Tell the subscribers that the value of @kv is deleted or
+ * replaced
+ */
+static inline void kv_changed(struct thread *t, struct kv *kv)
+{
+	if (!list_empty(&t->subscribers))
+		sub_changed(t, KV_KEY(kv));
+}
+
+static void state_sub_out(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_SUB_OUT:\n");
+
+	struct sub *sub = conn->sub;
+	do {
+		if (conn->unio == 0) {
+			/* nothing is in flight, move the events left to front */
+			sub->tail -= sub->head;
+			memmove(sub->data, sub->data + sub->head, sub->tail);
+			sub->head = 0;
+			if (sub->resync && sub->tail < SUB_DATA_SIZE) {
+				sub->data[sub->tail++] = SUB_EVENT_RESYNC;
+				sub->resync = false;
+			}
+			if (sub->tail == 0) {
+				conn->state = CONN_STATE_SUB_IDLE;
+				return;
+			}
+			conn->unio = sub->tail;
+		}
+
+		uint64_t unio = conn->unio;
+		if (!conn_write(t, conn, sub->data + sub->head))
+			return;
+		sub->head += unio - conn->unio;
+	} while (conn->unio == 0);
+}
+
+/**
+ * subscribers_flush - Send the events of this round to the idle subscribers
+ * of @t
+ */
+static void subscribers_flush(struct thread *t)
+{
+#ifdef CONFIG_NAMESPACE
+	if (!list_empty(&t->subscribers)) {
+		uint32_t epoch = __atomic_load_n(&flush_epoch, __ATOMIC_RELAXED);
+		if (epoch != t->sub_epoch) {
+			/* flushed values are not told one by one */
+			struct sub *sub;
+			list_for_each_entry(sub, &t->subscribers, node)
+				sub->resync = true;
+			t->sub_epoch = epoch;
+			t->sub_pending = true;
+		}
+	}
+#endif
+	if (!t->sub_pending)
+		return;
+
+	t->sub_pending = false;
+	struct sub *sub, *temp;
+	list_for_each_entry_safe(sub, temp, &t->subscribers, node) {
+		struct conn *conn = sub->conn;
+		if (conn->state == CONN_STATE_SUB_IDLE) {
+			conn->state = CONN_STATE_SUB_OUT;
+			conn->unio = 0;
+			state_sub_out(t, conn);
+		}
+	}
+}
+
+/**
+ * cmd_subscribe - Make @conn a subscriber of @t, see README.rst ->
+ * CMD-SUBSCRIBE
+ */
+static void cmd_subscribe(struct thread *t, struct conn *conn)
+{
+	struct sub *sub = memory_malloc_advance(t, SUB_PAGE);
+	if (sub == NULL) {
+		free_conn(t, conn);
+		return;
+	}
+
+	sub->conn = conn;
+	sub->head = 0;
+	sub->tail = 0;
+	/* the stream starts with SUB_EVENT_RESYNC */
+	sub->resync = true;
+	list_add(&t->subscribers, &sub->node);
+	conn->sub = sub;
+	conn->state = CONN_STATE_SUB_OUT;
+	conn->unio = 0;
+	state_sub_out(t, conn);
+}
+
+/**
+ * __thread_hash_get - Get the hash node of @key whose hash is @hkey, which is
+ * a locked conn or a kv
+ * 
+ * @return: the hash node, or NULL if @key does not exist
+ * 
+ * Note: a flushed kv is dropped on the way, see CONFIG_NAMESPACE
+ */
+static struct hlist_node *__thread_hash_get(
+		struct thread *t, unsigned char *key, uint64_t hkey)
+{
+	struct hlist_node *node = __hash_get(&t->hash_table, key, hkey,
+								&t->memory);
+#ifdef CONFIG_NAMESPACE
+	if (node && !thread_range(node)) {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		if (namespace_flushed(kv->ns, kv->epoch)) {
+			kv_disable(t, kv);
+			if (kv_no_borrower(kv))
+				kv_free(t, kv);
+			node = NULL;
+		}
+	}
+#endif
+	if (node)
+		probe(hash_hit, thread_index(t), key, thread_range(node));
+	else
+		probe(hash_miss, thread_index(t), key);
+	return node;
+}
+
+static struct hlist_node *thread_hash_get(struct thread *t, unsigned char *key)
+{
+	return __thread_hash_get(t, key, key_hash(key));
+}
+
+/**
+ * topk_publish - Publish the keys tracked by @t in the window ended at @now,
+ * and start a new window
+ */
+static void topk_publish(struct thread *t, uint64_t now)
+{
+	struct topk *topk = &t->topk;
+	uint64_t window = now - topk->window;
+
+	__atomic_store_n(&topk->seq, topk->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	uint32_t nr = 0;
+	for (int i = 0; i < TOPK_NR; i++) {
+		struct topk_key *k = &topk->keys[i];
+		if (k->n == 0)
+			continue;
+
+		struct topk_key *p = &topk->published[nr++];
+		p->n = k->n * TOPK_SAMPLE * 1000000000ULL / window;
+		memcpy(p->key, k->key, KEY_SIZE(k->key));
+		k->n = 0;
+	}
+	topk->published_nr = nr;
+	topk->published_at = now;
+	__atomic_store_n(&topk->seq, topk->seq + 1, __ATOMIC_RELEASE);
+
+	topk->window = now;
+}
+
+/**
+ * topk_sample - Count a GET of @key, see TOPK_SAMPLE
+ */
+static void topk_sample(struct thread *t, const unsigned char *key)
+{
+	struct topk *topk = &t->topk;
+	if (++topk->sample % TOPK_SAMPLE != 0)
+		return;
+
+	uint64_t now = now_ns();
+	if (now - topk->window >= TOPK_WINDOW)
+		topk_publish(t, now);
+
+	/* the Space-Saving algorithm, the least counted key is replaced */
+	struct topk_key *hot = NULL, *min = &topk->keys[0];
+	for (int i = 0; i < TOPK_NR; i++) {
+		struct topk_key *k = &topk->keys[i];
+		if (k->key[0] == key[0] && memcmp(k->key, key, KEY_SIZE(key)) == 0) {
+			hot = k;
+			break;
+		}
+		if (k->n < min->n)
+			min = k;
+	}
+	if (hot == NULL) {
+		hot = min;
+		memcpy(hot->key, key, KEY_SIZE(key));
+	}
+	hot->n++;
+}
+
+/**
+ * thread_hash_read - thread_hash_get() for a GET of @key, which is sampled
+ * for the hot keys and the hit ratio curve
+ */
+static struct hlist_node *thread_hash_read(struct thread *t, unsigned char *key)
+{
+	topk_sample(t, key);
+#ifdef CONFIG_MRC
+	uint64_t hkey = key_hash(key);
+	struct hlist_node *node = __thread_hash_get(t, key, hkey);
+	uint64_t size = 0;
+	if (node && !thread_range(node)) {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		size = KV_SIZE(kv);
+	}
+	mrc_get(&t->mrc, hkey, size);
+	return node;
+#else
+	return thread_hash_get(t, key);
+#endif
+}
+
+static void cmd_get(struct thread *t, struct conn *conn)
+{
+	struct hlist_node *node = thread_hash_read(t, conn->key);
+#ifdef CONFIG_LATENCY
+	conn_lat_begin(conn, node ? LAT_GET_HIT : LAT_GET_MISS);
+#endif
+	if (node == NULL) {
+		stat_inc(&t->stats, STAT_GET_MISS);
+	#ifdef CONFIG_TRACE
+		trace_add(&t->trace, now_ns(), TRACE_GET, TRACE_MISS, conn->key,
+									0);
+	#endif
+		conn_lock_key(t, conn);
+		change_to_get_out_miss(t, conn);
+	} else if (thread_range(node)) {
+		struct conn *lock_conn = container_of(node, struct conn, hash_node);
+		stat_inc(&t->stats, STAT_GET_BLOCKED);
+	#ifdef CONFIG_TRACE
+		trace_add(&t->trace, now_ns(), TRACE_GET, TRACE_BLOCKED,
+								conn->key, 0);
+	#endif
+		conn->state = CONN_STATE_GET_BLOCKED;
+		list_add(&lock_conn->interest, &conn->interest);
+		call_clock(t, lock_conn);
+	} else {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+	#ifdef CONFIG_REPLICA
+		hot_key_sample(t, kv);
+	#endif
+		stat_inc(&t->stats, STAT_GET_HIT);
+	#ifdef CONFIG_TRACE
+		trace_add(&t->trace, now_ns(), TRACE_GET, TRACE_HIT, conn->key,
+								kv->val_size);
+	#endif
+		conn_borrow_kv(t, conn, kv);
+		change_to_get_out_hit(t, conn);
+	}
+}
+
+#ifndef CONFIG_IO_URING
+/**
+ * mux_res - Queue the response of @req
+ * @size: [value-size] of the response
+ * @miss: [hit] of the response
+ * 
+ * @return: true on the response is the first one to send
+ */
+static bool mux_res(struct conn *req, uint64_t size, uint8_t miss)
+{
+	struct mux *mux = req->mux;
+	bool first = list_empty(&mux->done);
+	req->state = CONN_STATE_MUX_DONE;
+	req->size = htole64(size);
+	req->miss = miss;
+	list_add_tail(&mux->done, &req->interest);
+	if (first)
+		mux->conn->unio = MUX_RES_SIZE + (conn_kv(req) ? size : 0);
+	return first;
+}
+
+/**
+ * mux_res_hit - Queue the hit of @kv as the response of @req
+ */
+static bool mux_res_hit(struct thread *t, struct conn *req, struct kv *kv)
+{
+	conn_borrow_kv(t, req, kv);
+	conn_res_hit(req);
+	return mux_res(req, kv->val_size, req->miss);
+}
+
+/**
+ * mux_get - Run GET request @frame of @mux
+ * 
+ * Note: unlike CMD-GET-OR-SET, a missing key is not locked
+ */
+static void mux_get(struct thread *t, struct mux *mux, unsigned char *frame)
+{
+	assert(mux->req_nr < MUX_REQ_MAX);
+	struct conn *req = fixed_mem_cache_malloc(&mux->req_cache);
+
+	memcpy(&req->mux_id, frame, MUX_ID_SIZE);
+	req->mux = mux;
+	kv_borrower_init(&req->kv_borrower);
+	mux->req_nr++;
+
+	unsigned char *key = frame + MUX_ID_SIZE + 1;
+#ifdef CONFIG_SHARD
+	uint32_t shard = key_shard(key);
+	if (shard_thread(shard) != t) {
+		mux_res(req, 0, GET_RES_NOT_OWNED);
+		return;
+	}
+	WRITE_ONCE(t->shard_load[shard], t->shard_load[shard] + 1);
+#endif
+	struct hlist_node *node = thread_hash_read(t, key);
+	if (node == NULL) {
+		stat_inc(&t->stats, STAT_GET_MISS);
+	#ifdef CONFIG_TRACE
+		trace_add(&t->trace, now_ns(), TRACE_GET, TRACE_MISS, key, 0);
+	#endif
+		mux_res(req, 0, true);
+	} else if (thread_range(node)) {
+		struct conn *lock_conn = container_of(node, struct conn, hash_node);
+		stat_inc(&t->stats, STAT_GET_BLOCKED);
+	#ifdef CONFIG_TRACE
+		trace_add(&t->trace, now_ns(), TRACE_GET, TRACE_BLOCKED, key, 0);
+	#endif
+		req->state = CONN_STATE_MUX_BLOCKED;
+		list_add(&lock_conn->interest, &req->interest);
+		call_clock(t, lock_conn);
+	} else {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+	#ifdef CONFIG_REPLICA
+		hot_key_sample(t, kv);
+	#endif
+		stat_inc(&t->stats, STAT_GET_HIT);
+	#ifdef CONFIG_TRACE
+		trace_add(&t->trace, now_ns(), TRACE_GET, TRACE_HIT, key,
+								kv->val_size);
+	#endif
+		mux_res_hit(t, req, kv);
+	}
+}
+
+/**
+ * mux_run - Run the requests read by @conn, until MUX_REQ_MAX requests are
+ * not responded
+ * 
+ * @return: false on @conn is freed
+ */
+static bool mux_run(struct thread *t, struct conn *conn)
+{
+	struct mux *mux = conn->mux;
+	while (mux->req_nr < MUX_REQ_MAX) {
+		unsigned char *frame = mux->data + mux->head;
+		uint32_t n = mux->tail - mux->head;
+		if (n < MUX_ID_SIZE + CMD_SIZE_MIN)
+			return true;
+
+		uint32_t size = MUX_ID_SIZE + CMD_SIZE_MIN + frame[MUX_ID_SIZE + 1];
+		if (n < size)
+			return true;
+
+		if (frame[MUX_ID_SIZE] != CACHE_CMD_GET_OR_SET) {
+			free_conn(t, conn);
+			return false;
+		}
+		mux_get(t, mux, frame);
+		mux->head += size;
+	}
+	return true;
+}
+
+/**
+ * mux_recv - Read and run the requests of @conn
+ * 
+ * @return: false on @conn is freed
+ */
+static bool mux_recv(struct thread *t, struct conn *conn)
+{
+	struct mux *mux = conn->mux;
+	while (true) {
+		if (!mux_run(t, conn))
+			return false;
+		if (mux->req_nr == MUX_REQ_MAX)
+			return true;
+
+		/* move the partial request to front */
+		if (mux->head > 0) {
+			mux->tail -= mux->head;
+			memmove(mux->data, mux->data + mux->head, mux->tail);
+			mux->head = 0;
+		}
+
+		ssize_t n = read(conn->fd, mux->data + mux->tail,
+						MUX_DATA_SIZE - mux->tail);
+		if (n > 0) {
+			mux->tail += n;
+			stat_add(&t->stats, STAT_BYTES_IN, n);
+		} else if (n == 0 || errno != EWOULDBLOCK) {
+			free_conn(t, conn);
+			return false;
+		} else {
+			return true;
+		}
+	}
+}
+
+/**
+ * mux_send - Send the responses of @conn in order
+ * 
+ * @return: true on all responses are sent, false on short write or @conn is
+ * freed
+ */
+static bool mux_send(struct thread *t, struct conn *conn)
+{
+	struct mux *mux = conn->mux;
+	while (!list_empty(&mux->done)) {
+		struct conn *req;
+		req = list_first_entry(&mux->done, struct conn, interest);
+		struct kv *kv = conn_kv(req);
+		uint64_t val_n = kv ? kv->val_size : 0;
+
+		unsigned char head[MUX_RES_SIZE];
+		memcpy(head, &req->mux_id, MUX_ID_SIZE);
+		memcpy(head + MUX_ID_SIZE, req->buffer, GET_RES_SIZE);
+
+		uint64_t written = MUX_RES_SIZE + val_n - conn->unio;
+		struct iovec iov[3];
+		int iov_len = 0;
+		if (written < MUX_RES_SIZE) {
+			iov[0].iov_base = head + written;
+			iov[0].iov_len = MUX_RES_SIZE - written;
+			iov_len = 1;
+			written = MUX_RES_SIZE;
+		}
+		uint64_t i = written - MUX_RES_SIZE;
+		if (i < val_n)
+			iov_len += kv_val_range_to_iovec(kv, i, val_n - i,
+								iov + iov_len);
+
+		if (!conn_full_write_msg(t, conn, iov, iov_len))
+			return false;
+
+		list_del(&req->interest);
+		mux_req_free(t, req);
+		if (!list_empty(&mux->done)) {
+			req = list_first_entry(&mux->done, struct conn, interest);
+			kv = conn_kv(req);
+			conn->unio = MUX_RES_SIZE + (kv ? kv->val_size : 0);
+		}
+	}
+	return true;
+}
+
+/**
+ * state_mux - Serve the multiplexed connection @conn, see README.rst ->
+ * CMD-MUX
+ */
+static void state_mux(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_MUX:\n");
+
+	struct mux *mux = conn->mux;
+	bool full;
+	do {
+		if (!mux_recv(t, conn))
+			return;
+		full = mux->req_nr == MUX_REQ_MAX;
+		if (!mux_send(t, conn))
+			return;
+		/* responses are sent, run the requests left */
+	} while (full && mux->req_nr < MUX_REQ_MAX);
+}
+
+/**
+ * mux_wake - Respond the blocked request @req with @kv, or a miss if @kv is
+ * NULL
+ * 
+ * Note: we are in the middle of unlocking the key, so the response is only
+ * queued, the connection sends it and runs more requests on its next event
+ */
+static void mux_wake(struct thread *t, struct conn *req, struct kv *kv)
+{
+	struct mux *mux = req->mux;
+	if (mux->conn == NULL) {
+		mux_req_free(t, req);
+		return;
+	}
+
+	bool first = kv ? mux_res_hit(t, req, kv) : mux_res(req, 0, true);
+	if (first)
+		epfd_weak_up_conn(t, mux->conn);
+}
+
+/**
+ * cmd_mux - Turn @conn into a multiplexed connection, see README.rst ->
+ * CMD-MUX
+ * @payload: requests read with the command
+ */
+static void cmd_mux(struct thread *t, struct conn *conn,
+			const unsigned char *payload, uint64_t payload_n)
+{
+#ifdef CONFIG_ROUTE
+	/* requests are not routed */
+	if (conn->route) {
+		free_conn(t, conn);
+		return;
+	}
+#endif
+	struct mux *mux = memory_malloc_advance(t, MUX_PAGE);
+	if (mux == NULL) {
+		free_conn(t, conn);
+		return;
+	}
+
+	mux->conn = conn;
+	list_head_init(&mux->done);
+	mux->req_nr = 0;
+	fixed_mem_cache_init(&mux->req_cache, mux->reqs, sizeof(struct conn),
+								MUX_REQ_MAX);
+	mux->head = 0;
+	mux->tail = payload_n;
+	memcpy(mux->data, payload, payload_n);
+	conn->mux = mux;
+	conn->state = CONN_STATE_MUX;
+	state_mux(t, conn);
+}
+#endif
+
+static void change_locked_to_free(struct thread *t, struct conn *conn)
+{
+	assert(conn_with_key_locked(conn));
+	conn_unlock_key_for_failure(t, conn);
+	/* io_uring may still be reading into the kv, it is returned on free */
+	if (conn_kv(conn) && !conn_io_busy(conn))
+		conn_return_kv(t, conn);
+	conn->state = CONN_STATE_FREE;
+}
+
+static void cmd_del(struct thread *t, struct conn *conn)
+{
+#ifdef CONFIG_LATENCY
+	conn_lat_begin(conn, LAT_DEL);
+#endif
+	struct hlist_node *node = thread_hash_get(t, conn->key);
+#ifdef CONFIG_TRACE
+	trace_add(&t->trace, now_ns(), TRACE_DEL,
+		  node && !thread_range(node) ? TRACE_HIT : TRACE_MISS,
+		  conn->key, 0);
+#endif
+	if (node == NULL) {
+	} else if (thread_range(node)) {
+		struct conn *lock_conn = container_of(node, struct conn, hash_node);
+		change_locked_to_free(t, lock_conn);
+	} else {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		stat_inc(&t->stats, STAT_DEL);
+		kv_changed(t, kv);
+		kv_disable(t, kv);
+		if (kv_no_borrower(kv))
+			kv_free(t, kv);
+	}
+	change_to_out_success(t, conn);
+}
+
+/**
+ * conn_lock_key_for_set - Lock the key of @conn whoever holds it
+ * 
+ * The old value is disabled. A conn holding the lock gives it up to @conn,
+ * just like the key is deleted, and conns waiting for the lock wait for @conn
+ * instead.
+ */
+static void conn_lock_key_for_set(struct thread *t, struct conn *conn)
+{
+	struct hlist_node *node = thread_hash_get(t, conn->key);
+	if (node == NULL) {
+		conn_lock_key(t, conn);
+	} else if (thread_range(node)) {
+		struct conn *lock_conn = container_of(node, struct conn, hash_node);
+		probe(lock_transfer, thread_index(t), conn_slot(t, lock_conn),
+						conn_slot(t, conn), conn->key);
+		conn->hash_node = lock_conn->hash_node;
+		hlist_node_fix(&conn->hash_node);
+	#ifdef CONFIG_NAMESPACE
+		conn_stamp(conn);
+	#endif
+		if (list_empty(&lock_conn->interest)) {
+			list_head_init(&conn->interest);
+		} else {
+			conn->interest = lock_conn->interest;
+			list_fix(&conn->interest);
+			__call_clock(t, conn);
+		}
+
+		cancel_clock(lock_conn);
+		/* io_uring may still be reading into the kv, it is returned on free */
+		if (conn_kv(lock_conn) && !conn_io_busy(lock_conn))
+			conn_return_kv(t, lock_conn);
+		lock_conn->state = CONN_STATE_FREE;
+	} else {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		kv_changed(t, kv);
+		kv_disable(t, kv);
+		if (kv_no_borrower(kv))
+			kv_free(t, kv);
+		conn_lock_key(t, conn);
+	}
+}
+
+static void state_set_in_value_size(struct thread *t, struct conn *conn);
+static void state_set_in_value(struct thread *t, struct conn *conn);
+
+static void change_set_to_out_success(struct thread *t, struct conn *conn)
+{
+	conn->set = false;
+	change_to_out_success(t, conn);
+}
+
+/**
+ * chunk_space - Get the free space of the last chunk of @conn, a chunk is
+ * added if the last one is full
+ * @space: returns the free space
+ * 
+ * @return: number of bytes in @space, or 0 on failure
+ */
+static uint64_t chunk_space(struct thread *t, struct conn *conn,
+							unsigned char **space)
+{
+	struct chunk *last = conn->chunk;
+	if (last == NULL || last->n == CHUNK_DATA_SIZE) {
+		struct chunk *chunk = memory_malloc_advance(t, CHUNK_PAGE);
+		if (chunk == NULL)
+			return 0;
+
+		chunk->n = 0;
+		chunk->next = last ? last->next : chunk;
+		if (last)
+			last->next = chunk;
+		conn->chunk = last = chunk;
+	}
+	*space = last->data + last->n;
+	return CHUNK_DATA_SIZE - last->n;
+}
+
+/**
+ * chunk_next - Move on after a chunk size or a chunk of @conn is read
+ * 
+ * @return: true if the value is complete
+ */
+static bool chunk_next(struct conn *conn)
+{
+	if (conn->state == CONN_STATE_CHUNK_IN) {
+		conn->state = CONN_STATE_CHUNK_IN_SIZE;
+		conn->unio = SET_REQ_SIZE;
+		return false;
+	}
+
+	uint64_t size = le64toh(conn->size);
+	if (size == 0)
+		return true;
+	conn->state = CONN_STATE_CHUNK_IN;
+	conn->unio = size;
+	return false;
+}
+
+/**
+ * chunk_finish - Move the value read in chunks into a kv borrowed by @conn
+ * 
+ * @return: true on success, false if @conn is freed
+ */
+static bool chunk_finish(struct thread *t, struct conn *conn)
+{
+	struct chunk *last = conn->chunk;
+	struct chunk *chunk = last;
+	uint64_t val_size = 0;
+	if (last) {
+		do {
+			chunk = chunk->next;
+			val_size += chunk->n;
+		} while (chunk != last);
+	}
+
+	struct kv *kv = kv_malloc(t, conn->key, val_size);
+	if (kv == NULL) {
+		free_conn(t, conn);
+		return false;
+	}
+
+	kv_init(kv, conn->key, val_size);
+	uint64_t i = 0;
+	if (last) {
+		do {
+			chunk = chunk->next;
+			kv_copy_val_at(kv, i, chunk->data, chunk->n);
+			i += chunk->n;
+		} while (chunk != last);
+	}
+	conn_free_chunks(t, conn);
+	kv_borrow(kv, &conn->kv_borrower);
+	return true;
+}
+
+/**
+ * chunk_feed - Feed @n bytes at @p read ahead with [value-size] SET_CHUNKED
+ * to @conn, which is in CONN_STATE_CHUNK_IN_SIZE
+ * 
+ * @return: number of bytes consumed, or -1 if @conn is freed
+ * 
+ * Note: if the value is complete, it is borrowed by @conn and the rest bytes
+ * follow it; otherwise all bytes are consumed
+ */
+static int64_t chunk_feed(struct thread *t, struct conn *conn,
+			  const unsigned char *p, uint64_t n)
+{
+	uint64_t i = 0;
+	while (i < n) {
+		uint64_t m = n - i < conn->unio ? n - i : conn->unio;
+		if (conn->state == CONN_STATE_CHUNK_IN_SIZE) {
+			memcpy(conn->buffer + SET_REQ_SIZE - conn->unio, p + i,
+									m);
+			i += m;
+			conn->unio -= m;
+		}
+		while (conn->state == CONN_STATE_CHUNK_IN && m > 0) {
+			unsigned char *space;
+			uint64_t k = chunk_space(t, conn, &space);
+			if (k == 0) {
+				free_conn(t, conn);
+				return -1;
+			}
+			if (k > m)
+				k = m;
+			memcpy(space, p + i, k);
+			conn->chunk->n += k;
+			i += k;
+			m -= k;
+			conn->unio -= k;
+		}
+
+		if (conn->unio == 0 && chunk_next(conn))
+			return chunk_finish(t, conn) ? (int64_t)i : -1;
+	}
+	return i;
+}
+
+/**
+ * chunk_start - Start to read the value of @conn in chunks
+ * @p: bytes read ahead with [value-size]
+ * @n: number of bytes in @p
+ * 
+ * @return: number of bytes consumed, or -1 if @conn is freed
+ * 
+ * Note: the value is borrowed by @conn if it is complete
+ */
+static int64_t chunk_start(struct thread *t, struct conn *conn,
+			   const unsigned char *p, uint64_t n)
+{
+	conn->state = CONN_STATE_CHUNK_IN_SIZE;
+	conn->unio = SET_REQ_SIZE;
+	return chunk_feed(t, conn, p, n);
+}
+
+static void state_chunk_in(struct thread *t, struct conn *conn);
+
+/**
+ * cmd_set - Set the value of the key, see README.rst -> CMD-SET
+ * @payload: bytes read after the command
+ * @payload_n: number of bytes in @payload
+ */
+static void cmd_set(struct thread *t, struct conn *conn,
+			const unsigned char *payload, uint64_t payload_n)
+{
+	conn_lock_key_for_set(t, conn);
+	conn->set = true;
+	if (payload_n < SET_REQ_SIZE) {
+		memcpy(conn->buffer, payload, payload_n);
+		conn->state = CONN_STATE_SET_IN_VALUE_SIZE;
+		conn->unio = SET_REQ_SIZE + conn_set_extra_buffer(conn) -
+								payload_n;
+		state_set_in_value_size(t, conn);
+		return;
+	}
+
+	memcpy(conn->buffer, payload, SET_REQ_SIZE);
+	uint64_t val_size = le64toh(conn->size);
+	if (val_size == SET_CHUNKED) {
+		if (chunk_start(t, conn, payload + SET_REQ_SIZE,
+					payload_n - SET_REQ_SIZE) == -1)
+			return;
+		if (conn_kv(conn) == NULL) {
+			state_chunk_in(t, conn);
+			return;
+		}
+		conn_unlock_key_for_success(t, conn);
+		change_set_to_out_success(t, conn);
+		return;
+	}
+
+	/* free_conn() unlocks the key only in a locked state */
+	conn->state = CONN_STATE_SET_IN_VALUE;
+	struct kv *kv = kv_malloc(t, conn->key, val_size);
+	if (kv == NULL) {
+		free_conn(t, conn);
+		return;
+	}
+
+	kv_init(kv, conn->key, val_size);
+	uint64_t n = kv_copy_val(kv, (unsigned char *)payload + SET_REQ_SIZE,
+						payload_n - SET_REQ_SIZE);
+	kv_borrow(kv, &conn->kv_borrower);
+	if (n < val_size) {
+		conn->unio = val_size + CMD_SIZE_MAX - n;
+		state_set_in_value(t, conn);
+		return;
+	}
+
+	conn_unlock_key_for_success(t, conn);
+	change_set_to_out_success(t, conn);
+}
+
+static void state_bulk_in(struct thread *t, struct conn *conn);
+static void state_bulk_in_value(struct thread *t, struct conn *conn);
+
+/**
+ * bulk_load - Load the records in @conn->bulk
+ * 
+ * @return: true on more records are expected, false on @conn leaves
+ * CONN_STATE_BULK_IN
+ */
+static bool bulk_load(struct thread *t, struct conn *conn)
+{
+	struct bulk *bulk = conn->bulk;
+	while (bulk->head < bulk->tail) {
+		unsigned char *record = bulk->data + bulk->head;
+		if (record[0] == 0) {
+			/* the end of records */
+			memory_free(&t->memory, bulk, BULK_PAGE);
+			conn->bulk = NULL;
+			change_to_out_success(t, conn);
+			return false;
+		}
+
+		uint64_t size = KEY_SIZE(record) + SET_REQ_SIZE;
+		if (bulk->tail - bulk->head < size)
+			break;
+
+		uint64_t val_size;
+		memcpy(conn->key, record, KEY_SIZE(record));
+		memcpy(&val_size, record + KEY_SIZE(record), SET_REQ_SIZE);
+		val_size = le64toh(val_size);
+		bulk->head += size;
+		if (val_size == SET_CHUNKED) {
+			free_conn(t, conn);
+			return false;
+		}
+	#ifdef CONFIG_SHARD
+		/* records are not routed, a GET would never find the key */
+		uint32_t shard = key_shard(conn->key);
+		if (shard_thread(shard) != t) {
+			free_conn(t, conn);
+			return false;
+		}
+		WRITE_ONCE(t->shard_load[shard], t->shard_load[shard] + 1);
+	#endif
+
+		conn_lock_key_for_set(t, conn);
+		conn->state = CONN_STATE_BULK_IN_VALUE;
+		struct kv *kv = kv_malloc(t, conn->key, val_size);
+		if (kv == NULL) {
+			free_conn(t, conn);
+			return false;
+		}
+
+		kv_init(kv, conn->key, val_size);
+		uint64_t n = kv_copy_val(kv, bulk->data + bulk->head,
+						bulk->tail - bulk->head);
+		bulk->head += n;
+		kv_borrow(kv, &conn->kv_borrower);
+		if (n < val_size) {
+			bulk->head = 0;
+			bulk->tail = 0;
+			conn->unio = val_size - n + BULK_DATA_SIZE;
+			state_bulk_in_value(t, conn);
+			return false;
+		}
+
+		conn_unlock_key_for_success(t, conn);
+		conn->state = CONN_STATE_BULK_IN;
+	}
+
+	/* keep the partial record */
+	bulk->tail -= bulk->head;
+	memmove(bulk->data, bulk->data + bulk->head, bulk->tail);
+	bulk->head = 0;
+	return true;
+}
+
+/**
+ * cmd_bulk_load - Set the values of many keys, see README.rst ->
+ * CMD-BULK-LOAD
+ * @payload: bytes read after the command
+ * @payload_n: number of bytes in @payload
+ */
+static void cmd_bulk_load(struct thread *t, struct conn *conn,
+			const unsigned char *payload, uint64_t payload_n)
+{
+#ifdef CONFIG_ROUTE
+	/* records are not routed */
+	if (conn->route) {
+		free_conn(t, conn);
+		return;
+	}
+#endif
+	struct bulk *bulk = memory_malloc_advance(t, BULK_PAGE);
+	if (bulk == NULL) {
+		free_conn(t, conn);
+		return;
+	}
+
+	bulk->head = 0;
+	bulk->tail = payload_n;
+	memcpy(bulk->data, payload, payload_n);
+	conn->bulk = bulk;
+	conn->state = CONN_STATE_BULK_IN;
+	if (bulk_load(t, conn))
+		state_bulk_in(t, conn);
+}
+
+/**
+ * conn_retry_blocked - Let @conn wait for the key locked by the conn of @node,
+ * and run the command again once the key is unlocked
+ * 
+ * Note: the command must not be GET-OR-SET, whose waiters takes over the lock
+ * on failure, see conn_unlock_key_for_failure()
+ */
+static void conn_retry_blocked(struct thread *t, struct conn *conn,
+						struct hlist_node *node)
+{
+	struct conn *lock_conn = container_of(node, struct conn, hash_node);
+	conn->state = CONN_STATE_RETRY_BLOCKED;
+	list_add(&lock_conn->interest, &conn->interest);
+	call_clock(t, lock_conn);
+}
+
+static void state_out_buffer(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_OUT_BUFFER:\n");
+
+	uint64_t written = sizeof(conn->buffer) - conn->unio;
+	if (conn_full_write(t, conn, conn->buffer + written))
+		change_to_in_cmd(conn);
+}
+
+/**
+ * change_to_out_buffer - Send a response of [size 8] [miss 1]
+ */
+static void change_to_out_buffer(struct thread *t, struct conn *conn,
+						uint64_t size, uint8_t miss)
+{
+	conn->state = CONN_STATE_OUT_BUFFER;
+	conn->unio = sizeof(conn->buffer);
+	conn->size = htole64(size);
+	conn->miss = miss;
+	state_out_buffer(t, conn);
+}
+
+/**
+ * counter_apply - Apply counter command @cmd with @delta to @val
+ * 
+ * @return: the new value
+ */
+static uint64_t counter_apply(enum cache_cmd cmd, uint64_t val, uint64_t delta)
+{
+	int64_t res;
+	switch (cmd) {
+	case CACHE_CMD_INCR:
+		return val + delta;
+	case CACHE_CMD_DECR:
+		return val > delta ? val - delta : 0;
+	default:
+		if (__builtin_add_overflow((int64_t)val, (int64_t)delta, &res))
+			res = (int64_t)delta < 0 ? INT64_MIN : INT64_MAX;
+		return res;
+	}
+}
+
+static uint64_t kv_counter_get(struct kv *kv)
+{
+	assert(!kv_is_concat(kv));
+	uint64_t val;
+	memcpy(&val, KV_VAL(kv), COUNTER_SIZE);
+	return le64toh(val);
+}
+
+static void kv_counter_set(struct kv *kv, uint64_t val)
+{
+	assert(!kv_is_concat(kv));
+	val = htole64(val);
+	memcpy(KV_VAL(kv), &val, COUNTER_SIZE);
+}
+
+/**
+ * counter_run - Run the counter command of @conn, whose request is in
+ * (@conn->buffer)
+ * 
+ * The value is updated in place unless someone else may read it, in which
+ * case a new kv takes its place, the same as CMD-SET.
+ */
+static void counter_run(struct thread *t, struct conn *conn)
+{
+	enum cache_cmd cmd = *(conn->key - 1);
+	uint64_t delta = le64toh(conn->size);
+	bool create = conn->miss;
+
+	struct hlist_node *node = thread_hash_get(t, conn->key);
+	uint64_t val;
+	if (node == NULL) {
+		if (!create) {
+			change_to_out_buffer(t, conn, 0, COUNTER_MISS);
+			return;
+		}
+		val = counter_apply(cmd, 0, delta);
+	} else if (thread_range(node)) {
+		conn_retry_blocked(t, conn, node);
+		return;
+	} else {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		if (kv->val_size != COUNTER_SIZE) {
+			change_to_out_buffer(t, conn, 0, COUNTER_NOT_COUNTER);
+			return;
+		}
+
+		val = counter_apply(cmd, kv_counter_get(kv), delta);
+		kv_changed(t, kv);
+		if (kv_no_borrower(kv) && !kv->replicated) {
+			kv_counter_set(kv, val);
+		#ifdef CONFIG_ETAG
+			kv->etag = thread_etag(t);
+		#endif
+			kv_touch(t, kv);
+			change_to_out_buffer(t, conn, val, COUNTER_OK);
+			return;
+		}
+
+		kv_disable(t, kv);
+		if (kv_no_borrower(kv))
+			kv_free(t, kv);
+	}
+
+	/* allocate before locking, so failure leaves nothing to unlock */
+	struct kv *kv = kv_malloc(t, conn->key, COUNTER_SIZE);
+	if (kv == NULL) {
+		free_conn(t, conn);
+		return;
+	}
+
+	kv_init(kv, conn->key, COUNTER_SIZE);
+	kv_counter_set(kv, val);
+	conn_lock_key(t, conn);
+	kv_borrow(kv, &conn->kv_borrower);
+	conn_unlock_key_for_success(t, conn);
+	change_to_out_buffer(t, conn, val, COUNTER_OK);
+}
+
+static void state_counter_in(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_COUNTER_IN:\n");
+
+	uint64_t readed = COUNTER_REQ_SIZE - conn->unio;
+	if (conn_read(t, conn, conn->buffer + readed) && conn->unio == 0)
+		counter_run(t, conn);
+}
+
+static_assert(COUNTER_REQ_SIZE <= sizeof(((struct conn *)0)->buffer));
+
+/**
+ * cmd_counter - Update the counter of the key, see README.rst -> CMD-INCR
+ * @payload: bytes read after the command
+ * @payload_n: number of bytes in @payload
+ */
+static void cmd_counter(struct thread *t, struct conn *conn,
+			const unsigned char *payload, uint64_t payload_n)
+{
+	if (payload_n > COUNTER_REQ_SIZE)
+		payload_n = COUNTER_REQ_SIZE;
+	memcpy(conn->buffer, payload, payload_n);
+	if (payload_n < COUNTER_REQ_SIZE) {
+		conn->state = CONN_STATE_COUNTER_IN;
+		conn->unio = COUNTER_REQ_SIZE - payload_n;
+		state_counter_in(t, conn);
+		return;
+	}
+
+	counter_run(t, conn);
+}
+
+/**
+ * get_range_run - Run CMD-GET-RANGE of @conn, whose request is in
+ * (@conn->offset) and (@conn->length)
+ */
+static void get_range_run(struct thread *t, struct conn *conn)
+{
+	struct hlist_node *node = thread_hash_read(t, conn->key);
+	if (node == NULL) {
+		change_to_out_buffer(t, conn, 0, true);
+	} else if (thread_range(node)) {
+		conn_retry_blocked(t, conn, node);
+	} else {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		uint64_t offset = conn->offset;
+		uint64_t length = 0;
+		if (offset < kv->val_size && conn->length > 0) {
+			length = kv->val_size - offset;
+			if (length > conn->length)
+				length = conn->length;
+		}
+	#ifdef CONFIG_REPLICA
+		hot_key_sample(t, kv);
+	#endif
+		conn_borrow_kv(t, conn, kv);
+		change_to_get_out_range(t, conn, offset, length);
+	}
+}
+
+static void state_get_range_in(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_GET_RANGE_IN:\n");
+
+	uint64_t readed = GET_RANGE_REQ_SIZE - conn->unio;
+	unsigned char *req = (unsigned char *)&conn->offset;
+	if (conn_read(t, conn, req + readed) && conn->unio == 0) {
+		conn->offset = le64toh(conn->offset);
+		conn->length = le64toh(conn->length);
+		get_range_run(t, conn);
+	}
+}
+
+/**
+ * cmd_get_range - Get a part of the value, see README.rst -> CMD-GET-RANGE
+ * @payload: bytes read after the command
+ * @payload_n: number of bytes in @payload
+ */
+static void cmd_get_range(struct thread *t, struct conn *conn,
+			const unsigned char *payload, uint64_t payload_n)
+{
+	if (payload_n > GET_RANGE_REQ_SIZE)
+		payload_n = GET_RANGE_REQ_SIZE;
+	memcpy(&conn->offset, payload, payload_n);
+	conn->state = CONN_STATE_GET_RANGE_IN;
+	conn->unio = GET_RANGE_REQ_SIZE - payload_n;
+	if (conn->unio > 0) {
+		state_get_range_in(t, conn);
+		return;
+	}
+
+	conn->offset = le64toh(conn->offset);
+	conn->length = le64toh(conn->length);
+	get_range_run(t, conn);
+}
+
+#ifdef CONFIG_ETAG
+static void state_out_etag(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_OUT_ETAG:\n");
+
+	unsigned char *res = (unsigned char *)&conn->etag;
+	uint64_t written = GET_ETAG_RES_SIZE - conn->unio;
+	if (conn_full_write(t, conn, res + written))
+		change_to_in_cmd(conn);
+}
+
+/**
+ * change_to_out_etag - Send a response of [etag 8] [size 8] [miss 1]
+ */
+static void change_to_out_etag(struct thread *t, struct conn *conn,
+				uint64_t etag, uint64_t size, uint8_t miss)
+{
+	conn->state = CONN_STATE_OUT_ETAG;
+	conn->unio = GET_ETAG_RES_SIZE;
+	conn->etag = htole64(etag);
+	conn->size = htole64(size);
+	conn->miss = miss;
+	state_out_etag(t, conn);
+}
+
+/**
+ * change_to_get_out_etag - Send the etag and the value of the borrowed kv
+ */
+static void change_to_get_out_etag(struct thread *t, struct conn *conn)
+{
+	struct kv *kv = conn_kv(conn);
+	conn->state = CONN_STATE_GET_OUT_ETAG;
+	conn->offset = 0;
+	conn->length = kv->val_size;
+	conn->unio = GET_ETAG_RES_SIZE + kv->val_size;
+	conn->etag = htole64(kv->etag);
+	conn->size = htole64(kv->val_size);
+	conn->miss = false;
+	state_get_out_hit(t, conn);
+}
+
+/**
+ * get_if_changed_run - Run CMD-GET-IF-CHANGED of @conn, whose request is in
+ * (@conn->etag)
+ */
+static void get_if_changed_run(struct thread *t, struct conn *conn)
+{
+	struct hlist_node *node = thread_hash_read(t, conn->key);
+	if (node == NULL) {
+		change_to_out_etag(t, conn, 0, 0, true);
+	} else if (thread_range(node)) {
+		conn_retry_blocked(t, conn, node);
+	} else {
+		struct kv *kv = container_of(node, struct kv, hash_node);
+		if (kv->etag == conn->etag) {
+			kv_touch(t, kv);
+			change_to_out_etag(t, conn, kv->etag, kv->val_size,
+							GET_RES_NOT_MODIFIED);
+			return;
+		}
+
+		conn_borrow_kv(t, conn, kv);
+		change_to_get_out_etag(t, conn);
+	}
+}
+
+static void state_etag_in(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_ETAG_IN:\n");
+
+	uint64_t readed = ETAG_SIZE - conn->unio;
+	unsigned char *req = (unsigned char *)&conn->etag;
+	if (conn_read(t, conn, req + readed) && conn->unio == 0) {
+		conn->etag = le64toh(conn->etag);
+		get_if_changed_run(t, conn);
+	}
+}
+
+/**
+ * cmd_get_if_changed - Get the value unless the client has it, see
+ * README.rst -> CMD-GET-IF-CHANGED
+ * @payload: bytes read after the command
+ * @payload_n: number of bytes in @payload
+ */
+static void cmd_get_if_changed(struct thread *t, struct conn *conn,
+			const unsigned char *payload, uint64_t payload_n)
+{
+	if (payload_n > ETAG_SIZE)
+		payload_n = ETAG_SIZE;
+	memcpy(&conn->etag, payload, payload_n);
+	conn->state = CONN_STATE_ETAG_IN;
+	conn->unio = ETAG_SIZE - payload_n;
+	if (conn->unio > 0) {
+		state_etag_in(t, conn);
+		return;
+	}
+
+	conn->etag = le64toh(conn->etag);
+	get_if_changed_run(t, conn);
+}
+#endif
+
+static void state_retry(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_RETRY:\n");
+
+	switch (*(conn->key - 1)) {
+	case CACHE_CMD_GET_RANGE:
+		get_range_run(t, conn);
+		break;
+#ifdef CONFIG_ETAG
+	case CACHE_CMD_GET_IF_CHANGED:
+		get_if_changed_run(t, conn);
+		break;
+#endif
+	default:
+		counter_run(t, conn);
+	}
+}
+
+#ifdef CONFIG_NAMESPACE
+/**
+ * namespace_sweep - Free flushed kvs that are not looked up any more
+ * 
+ * A sweep walks through the hash table after a flush, NAMESPACE_SWEEP buckets
+ * a time, and it is restarted by later flushes.
+ */
+static void namespace_sweep(struct thread *t)
+{
+	if (t->sweep_bucket == 0) {
+		uint32_t epoch = __atomic_load_n(&flush_epoch, __ATOMIC_RELAXED);
+		if (t->swept_epoch == epoch || t->hash_table.old_buckets)
+			return;
+		t->swept_epoch = epoch;
+	}
+
+	/* kv_free() may migrate other kvs, so collect them first, migration
+	fixes the list for us */
+	struct list_head drop;
+	list_head_init(&drop);
+	for (int i = 0; i < NAMESPACE_SWEEP; i++) {
+		struct hlist_head *bucket;
+		bucket = hash_bucket_at(&t->hash_table, t->sweep_bucket);
+		if (bucket == NULL) {
+			/* go on after the hash table is migrated */
+			if (t->hash_table.old_buckets == NULL)
+				t->sweep_bucket = 0;
+			break;
+		}
+
+		struct hlist_node *curr;
+		hlist_for_each(curr, bucket) {
+			if (thread_range(curr))
+				continue;
+
+			struct kv *kv = container_of(curr, struct kv, hash_node);
+			if (namespace_flushed(kv->ns, kv->epoch)) {
+				list_del(&kv->lru);
+				list_add(&drop, &kv->lru);
+			}
+		}
+		t->sweep_bucket++;
+	}
+
+	while (!list_empty(&drop)) {
+		struct kv *kv = list_first_entry(&drop, struct kv, lru);
+		kv_disable(t, kv);
+		if (kv_no_borrower(kv))
+			kv_free(t, kv);
+	}
+}
+
+/**
+ * cmd_flush - Flush the namespace of the key, see README.rst -> CMD-FLUSH
+ */
+static void cmd_flush(struct thread *t, struct conn *conn)
+{
+	uint32_t ns = key_namespace(conn->key);
+	if (conn->key[0] > 0 && ns == 0) {
+		free_conn(t, conn);
+		return;
+	}
+
+	namespace_flush(ns, conn->key[0] == 0);
+	change_to_out_success(t, conn);
+}
+#endif
+
+#ifdef CONFIG_ROUTE
+/* route_rings[i][j] moves connections from thread i to thread j */
+static struct route_ring route_rings[CONFIG_THREAD_NR][CONFIG_THREAD_NR];
+
+/**
+ * conn_route - Move @conn and its command to thread @to, who owns the key
+ * 
+ * @return: true on @conn is moved, false on @conn should wait
+ * 
+ * Note: we move the connection instead of the command, so the kv never leaves
+ * its thread, and @to replies to the client by itself
+ */
+static bool conn_route(struct thread *t, struct conn *conn, struct thread *to)
+{
+#ifdef CONFIG_ZEROCOPY
+	/* completions of the zero copy sends are reported to us */
+	if (conn->zc_sent != conn->zc_done)
+		return false;
+	assert(conn->zc_borrower.kv == NULL);
+#endif
+	struct route_ring *ring = &route_rings[t - threads][to - threads];
+	struct route_msg *msg = route_ring_tail(ring);
+	if (msg == NULL) {
+		/* pairs with the fence in thread_route_receive() */
+		WRITE_ONCE(ring->blocked, true);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		msg = route_ring_tail(ring);
+		if (msg == NULL)
+			return false;
+	}
+
+	msg->fd = conn->fd;
+	msg->n = CMD_SIZE_MAX - conn->unio;
+	memcpy(msg->cmd, conn->key - 1, msg->n);
+#ifdef CONFIG_IO_URING
+	bool ok __attribute__((unused));
+	ok = uring_update_file(&t->ring, conn_slot(t, conn), -1);
+	assert(ok);
+#else
+	epoll_del(t->epfd, conn->fd);
+#endif
+	route_ring_push(ring);
+	eventfd_write(to->route_efd, 1);
+
+	/* the socket is not closed, it belongs to @to now */
+	conn->fd = -1;
+	fixed_mem_cache_free(&t->conn_cache, conn);
+	return true;
+}
+
+/**
+ * cmd_route - Route @conn to the thread that owns the key if it is not us
+ * 
+ * @return: true on @conn is routed or waits for routing, false on we run the
+ * command
+ */
+static bool cmd_route(struct thread *t, struct conn *conn)
+{
+#ifndef CONFIG_SHARD
+	if (!conn->route)
+		return false;
+#endif
+	uint64_t hash = key_dispatch_hash(conn->key);
+#ifdef CONFIG_SHARD
+	/* shard map of the client might be stale, so every conn is routed */
+	uint32_t shard = hash_shard(hash);
+	struct thread *owner = shard_thread(shard);
+#else
+	struct thread *owner = hash_thread(hash);
+#endif
+	if (owner == t) {
+	#ifdef CONFIG_SHARD
+		WRITE_ONCE(t->shard_load[shard], t->shard_load[shard] + 1);
+	#endif
+		return false;
+	}
+
+#ifdef CONFIG_REPLICA
+	/* replicas spread GET hits of hot keys to every thread */
+	if (*(conn->key - 1) == CACHE_CMD_GET_OR_SET &&
+	    replica_get(t, conn, hash, owner)) {
+		stat_inc(&t->stats, STAT_GET_HIT);
+	#ifdef CONFIG_TRACE
+		trace_add(&t->trace, now_ns(), TRACE_GET, TRACE_HIT, conn->key,
+									0);
+	#endif
+	#ifdef CONFIG_LATENCY
+		conn_lat_begin(conn, LAT_GET_HIT);
+	#endif
+		change_to_get_out_hit(t, conn);
+		return true;
+	}
+#endif
+
+	if (!conn_route(t, conn, owner)) {
+		debug_printf("CONN_STATE_ROUTE_BLOCKED:\n");
+		conn->state = CONN_STATE_ROUTE_BLOCKED;
+		list_add(&t->route_pending, &conn->interest);
+	}
+	return true;
+}
+#endif
+
+#ifdef CONFIG_SHARD
+static void state_out_shard_map(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_OUT_SHARD_MAP:\n");
+
+	uint64_t written = sizeof(t->shard_map_out) - conn->unio;
+	unsigned char *buffer = (unsigned char *)t->shard_map_out;
+	if (conn_full_write(t, conn, buffer + written)) {
+		t->shard_map_readers--;
+		change_to_in_cmd(conn);
+	}
+}
+
+/**
+ * cmd_shard_map - Reply the shard map, see README.rst -> CMD-SHARD-MAP
+ */
+static void cmd_shard_map(struct thread *t, struct conn *conn)
+{
+	if (t->shard_map_readers == 0) {
+		t->shard_map_out[0] = htole32(CONFIG_SHARD_NR);
+		for (uint32_t i = 0; i < CONFIG_SHARD_NR; i++) {
+			uint32_t id = __atomic_load_n(&shard_map[i],
+							__ATOMIC_RELAXED);
+			t->shard_map_out[1 + i] = htole32(id);
+		}
+	}
+
+	t->shard_map_readers++;
+	conn->state = CONN_STATE_OUT_SHARD_MAP;
+	conn->unio = sizeof(t->shard_map_out);
+	state_out_shard_map(t, conn);
+}
+#endif
+
+/**
+ * threads_stats - Sum the statistics of all threads up to @out, see
+ * README.rst -> CMD-STATS
+ * 
+ * Note: counters are read while the threads keep changing them, so they are
+ * not a snapshot of the same instant, but each of them is exact
+ */
+void threads_stats(uint64_t out[THREADS_STATS_NR])
+{
+	uint64_t *stat = out + 1;
+	uint64_t *class = stat + STAT_NR + 1;
+	memset(out, 0, sizeof(uint64_t) * THREADS_STATS_NR);
+	out[0] = STAT_NR;
+	stat[STAT_NR] = KV_CACHE_LEN;
+
+	for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
+		struct thread *t = &threads[i];
+		for (int j = 0; j < STAT_NR; j++)
+			stat[j] += READ_ONCE(t->stats.n[j]);
+
+		uint64_t page = (THREAD_MAX_MEM >> PAGE_SHIFT) -
+					READ_ONCE(t->memory.free_pages);
+		stat[STAT_MEMORY] += page << PAGE_SHIFT;
+		stat[STAT_SMALL] += READ_ONCE(t->s3fifo.s_lru_size);
+		stat[STAT_MAIN] += READ_ONCE(t->s3fifo.m_lru_size);
+		stat[STAT_SMALL_RATIO] += READ_ONCE(t->s3fifo.small_ratio);
+
+		for (int j = 0; j < KV_CACHE_LEN; j++) {
+			struct kv_cache *cache = &t->kv_cache_list[j];
+			page = READ_ONCE(cache->slab_nr) *
+					(uint64_t)cache->slab_page;
+			class[2 * j] = cache->obj_size;
+			class[2 * j + 1] += page << PAGE_SHIFT;
+		}
+	}
+	uint32_t ratio = __atomic_load_n(&small_ratio, __ATOMIC_RELAXED);
+	if (ratio != SMALL_RATIO_AUTO)
+		stat[STAT_SMALL_RATIO] = ratio;
+	else
+		stat[STAT_SMALL_RATIO] /= CONFIG_THREAD_NR;
+
+	for (int i = 0; i < THREADS_STATS_NR; i++)
+		out[i] = htole64(out[i]);
+}
+
+#ifndef CONFIG_RAFT
+static void state_out_stats(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_OUT_STATS:\n");
+
+	uint64_t written = sizeof(t->stats_out) - conn->unio;
+	unsigned char *buffer = (unsigned char *)t->stats_out;
+	if (conn_full_write(t, conn, buffer + written)) {
+		t->stats_readers--;
+		change_to_in_cmd(conn);
+	}
+}
+
+/**
+ * cmd_stats - Reply the statistics of all threads, see README.rst -> CMD-STATS
+ */
+static void cmd_stats(struct thread *t, struct conn *conn)
+{
+	if (t->stats_readers == 0)
+		threads_stats(t->stats_out);
+
+	t->stats_readers++;
+	conn->state = CONN_STATE_OUT_STATS;
+	conn->unio = sizeof(t->stats_out);
+	state_out_stats(t, conn);
+}
+#endif
+
+#ifdef CONFIG_LATENCY
+/**
+ * threads_latency_sum - Sum histogram @hist of all threads up to @out
+ */
+static void threads_latency_sum(enum lat_hist hist, uint64_t out[LAT_BUCKET_NR])
+{
+	memset(out, 0, sizeof(uint64_t) * LAT_BUCKET_NR);
+	for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
+		struct thread *t = &threads[i];
+		for (int j = 0; j < LAT_BUCKET_NR; j++)
+			out[j] += READ_ONCE(t->latency.n[hist][j]);
+	}
+}
+
+/**
+ * threads_latency - Sum the latency histograms of all threads since the last
+ * reset up to @out, see README.rst -> CMD-LATENCY
+ */
+void threads_latency(uint64_t out[THREADS_LATENCY_NR])
+{
+	out[0] = LAT_NR;
+	out[1] = LAT_BUCKET_NR;
+	for (int i = 0; i < LAT_NR; i++) {
+		uint64_t *n = out + 2 + i * LAT_BUCKET_NR;
+		threads_latency_sum(i, n);
+		for (int j = 0; j < LAT_BUCKET_NR; j++) {
+			uint64_t base = __atomic_load_n(&latency_base[i][j],
+							__ATOMIC_RELAXED);
+			n[j] = n[j] > base ? n[j] - base : 0;
+		}
+	}
+
+	for (int i = 0; i < THREADS_LATENCY_NR; i++)
+		out[i] = htole64(out[i]);
+}
+
+/**
+ * threads_latency_reset - Reset the latency histograms of all threads
+ * 
+ * Note: the histograms are only written by their owner threads, so instead of
+ * clearing them we remember what they are now and threads_latency() subtracts
+ */
+void threads_latency_reset()
+{
+	uint64_t n[LAT_BUCKET_NR];
+	for (int i = 0; i < LAT_NR; i++) {
+		threads_latency_sum(i, n);
+		for (int j = 0; j < LAT_BUCKET_NR; j++)
+			__atomic_store_n(&latency_base[i][j], n[j],
+							__ATOMIC_RELAXED);
+	}
+}
+
+#ifndef CONFIG_RAFT
+static void state_out_latency(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_OUT_LATENCY:\n");
+
+	uint64_t written = sizeof(t->latency_out) - conn->unio;
+	unsigned char *buffer = (unsigned char *)t->latency_out;
+	if (conn_full_write(t, conn, buffer + written)) {
+		t->latency_readers--;
+		change_to_in_cmd(conn);
+	}
+}
+
+/**
+ * cmd_latency - Reply the latency histograms of all threads, see README.rst ->
+ * CMD-LATENCY
+ */
+static void cmd_latency(struct thread *t, struct conn *conn)
+{
+	if (t->latency_readers == 0)
+		threads_latency(t->latency_out);
+
+	t->latency_readers++;
+	conn->state = CONN_STATE_OUT_LATENCY;
+	conn->unio = sizeof(t->latency_out);
+	state_out_latency(t, conn);
+}
+
+/**
+ * cmd_latency_reset - Reset the latency histograms of all threads, see
+ * README.rst -> CMD-LATENCY-RESET
+ */
+static void cmd_latency_reset(struct thread *t, struct conn *conn)
 {
-	conn->state = CONN_STATE_SET_IN_VALUE_SIZE;
-	conn->unio = SET_REQ_SIZE + SET_EXTRA_BUFFER;
-	/* Don't call state_set_in_value_size(), it is very likely that we are
-	blocked on read. And we just out miss, so the read event can not be
-	triggered this round, it will be triggered later. */
+	threads_latency_reset();
+	change_to_out_success(t, conn);
 }
+#endif
+#endif
 
-static void state_get_out_miss(struct thread *t, struct conn *conn)
+/**
+ * topk_read - Read the keys published by @t up to @keys
+ * @now: the time now (in nanoseconds)
+ * 
+ * @return: number of keys read, keys older than two windows are not read, the
+ * thread is not serving GETs
+ */
+static uint32_t topk_read(struct thread *t, uint64_t now,
+					struct topk_key keys[TOPK_NR])
 {
-	debug_printf("CONN_STATE_GET_OUT_MISS:\n");
+	struct topk *topk = &t->topk;
+	uint32_t nr;
+	uint64_t at;
+	while (true) {
+		uint32_t seq = __atomic_load_n(&topk->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		nr = READ_ONCE(topk->published_nr);
+		at = READ_ONCE(topk->published_at);
+		memcpy(keys, topk->published, sizeof(struct topk_key) * nr);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&topk->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+	return at + 2 * TOPK_WINDOW < now ? 0 : nr;
+}
 
-	uint64_t written = GET_RES_SIZE - conn->unio;
-	if (conn_full_write(t, conn, conn->buffer + written))
-		change_to_set_in_value_size(conn);
+/**
+ * threads_top_keys - Merge the top keys of all threads up to @out, see
+ * README.rst -> CMD-TOP-KEYS
+ * 
+ * @return: number of bytes in @out
+ */
+uint64_t threads_top_keys(unsigned char out[TOPK_OUT_SIZE])
+{
+	struct topk_key keys[TOPK_NR];
+	struct topk_key top[TOPK_OUT_NR];
+	uint32_t top_thread[TOPK_OUT_NR];
+	uint32_t top_nr = 0;
+	uint64_t now = now_ns();
+	for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
+		uint32_t nr = topk_read(&threads[i], now, keys);
+		for (uint32_t j = 0; j < nr; j++) {
+			/* insertion sort, the highest rate first */
+			uint32_t k = top_nr;
+			if (top_nr < TOPK_OUT_NR)
+				top_nr++;
+			else if (keys[j].n <= top[--k].n)
+				continue;
+
+			for (; k > 0 && top[k - 1].n < keys[j].n; k--) {
+				top[k] = top[k - 1];
+				top_thread[k] = top_thread[k - 1];
+			}
+			top[k] = keys[j];
+			top_thread[k] = i;
+		}
+	}
+
+	uint64_t n = htole64(top_nr);
+	memcpy(out, &n, sizeof(n));
+	uint64_t size = sizeof(n);
+	for (uint32_t i = 0; i < top_nr; i++) {
+		uint64_t rate = htole64(top[i].n);
+		uint32_t thread_id = htole32(top_thread[i]);
+		memcpy(out + size, &rate, sizeof(rate));
+		memcpy(out + size + 8, &thread_id, sizeof(thread_id));
+		memcpy(out + size + 12, top[i].key, KEY_SIZE(top[i].key));
+		size += 12 + KEY_SIZE(top[i].key);
+	}
+	return size;
 }
 
-static void change_to_get_out_miss(struct thread *t, struct conn *conn)
+#ifndef CONFIG_RAFT
+static void state_out_top_keys(struct thread *t, struct conn *conn)
 {
-	__change_to_get_out_miss(conn);
-	state_get_out_miss(t, conn);
+	debug_printf("CONN_STATE_OUT_TOP_KEYS:\n");
+
+	uint64_t written = t->topk_out_size - conn->unio;
+	if (conn_full_write(t, conn, t->topk_out + written)) {
+		t->topk_readers--;
+		change_to_in_cmd(conn);
+	}
 }
 
-static void cmd_get(struct thread *t, struct conn *conn)
+/**
+ * cmd_top_keys - Reply the top keys of all threads, see README.rst ->
+ * CMD-TOP-KEYS
+ */
+static void cmd_top_keys(struct thread *t, struct conn *conn)
 {
-	struct hlist_node *node = hash_get(&t->hash_table, conn->key, &t->memory);
-	if (node == NULL) {
-		conn_lock_key(t, conn);
-		change_to_get_out_miss(t, conn);
-	} else if (thread_range(node)) {
-		struct conn *lock_conn = container_of(node, struct conn, hash_node);
-		conn->state = CONN_STATE_GET_BLOCKED;
-		list_add(&lock_conn->interest, &conn->interest);
-		call_clock(t, lock_conn);
-	} else {
-		struct kv *kv = container_of(node, struct kv, hash_node);
-		conn_borrow_kv(t, conn, kv);
-		change_to_get_out_hit(t, conn);
+	if (t->topk_readers == 0)
+		t->topk_out_size = threads_top_keys(t->topk_out);
+
+	t->topk_readers++;
+	conn->state = CONN_STATE_OUT_TOP_KEYS;
+	conn->unio = t->topk_out_size;
+	state_out_top_keys(t, conn);
+}
+#endif
+
+#ifdef CONFIG_MRC
+/**
+ * threads_mrc - Sum the hit ratio curves of all threads up to @out, see
+ * README.rst -> CMD-MRC
+ * 
+ * Note: the keys are spread over the threads by hash, so the curve of the
+ * server is the sum of the curves of the threads at the same cache size each.
+ */
+void threads_mrc(uint64_t out[THREADS_MRC_NR])
+{
+	uint64_t refs = 0;
+	uint64_t hits[MRC_POINT_NR] = {0};
+	for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
+		struct mrc *mrc = &threads[i].mrc;
+		refs += READ_ONCE(mrc->refs);
+		for (int j = 0; j < MRC_POINT_NR; j++)
+			hits[j] += READ_ONCE(mrc->hits[j]);
+	}
+
+	out[0] = htole64(MRC_POINT_NR);
+	out[1] = htole64(refs);
+	uint64_t sum = 0;
+	for (int i = 0; i < MRC_POINT_NR; i++) {
+		sum += hits[i];
+		out[2 + i * 2] = htole64(MRC_STEP * (i + 1) * CONFIG_THREAD_NR);
+		out[2 + i * 2 + 1] = htole64(sum);
 	}
 }
 
-static void change_locked_to_free(struct thread *t, struct conn *conn)
+#ifndef CONFIG_RAFT
+static void state_out_mrc(struct thread *t, struct conn *conn)
 {
-	assert(conn_with_key_locked(conn));
-	conn_unlock_key_for_failure(t, conn);
-	conn->state = CONN_STATE_FREE;
+	debug_printf("CONN_STATE_OUT_MRC:\n");
+
+	uint64_t written = sizeof(t->mrc_out) - conn->unio;
+	unsigned char *buffer = (unsigned char *)t->mrc_out;
+	if (conn_full_write(t, conn, buffer + written)) {
+		t->mrc_readers--;
+		change_to_in_cmd(conn);
+	}
 }
 
-static void cmd_del(struct thread *t, struct conn *conn)
+/**
+ * cmd_mrc - Reply the hit ratio curve of the server, see README.rst -> CMD-MRC
+ */
+static void cmd_mrc(struct thread *t, struct conn *conn)
 {
-	struct hlist_node *node = hash_get(&t->hash_table, conn->key, &t->memory);
-	if (node == NULL) {
-	} else if (thread_range(node)) {
-		struct conn *lock_conn = container_of(node, struct conn, hash_node);
-		change_locked_to_free(t, lock_conn);
-	} else {
-		struct kv *kv = container_of(node, struct kv, hash_node);
-		kv_disable(t, kv);
-		if (kv_no_borrower(kv))
-			kv_free(t, kv);
+	if (t->mrc_readers == 0)
+		threads_mrc(t->mrc_out);
+
+	t->mrc_readers++;
+	conn->state = CONN_STATE_OUT_MRC;
+	conn->unio = sizeof(t->mrc_out);
+	state_out_mrc(t, conn);
+}
+#endif
+#endif
+
+#ifndef CONFIG_RAFT
+/**
+ * cmd_small_ratio - Set the small queue ratio of all threads, see README.rst
+ * -> CMD-SMALL-RATIO
+ */
+static void cmd_small_ratio(struct thread *t, struct conn *conn)
+{
+	uint32_t ratio = conn->key[1] | (uint32_t)conn->key[2] << 8;
+	if (conn->key[0] != 2 || !small_ratio_valid(ratio)) {
+		free_conn(t, conn);
+		return;
 	}
+
+	threads_small_ratio(ratio);
 	change_to_out_success(t, conn);
 }
+#endif
 
-static void cmd_run(struct thread *t, struct conn *conn)
+/**
+ * cmd_exec - Execute the command of @conn
+ * @payload: bytes read after the command, see cmd_has_payload()
+ * @payload_n: number of bytes in @payload
+ */
+static void cmd_exec(struct thread *t, struct conn *conn,
+			const unsigned char *payload, uint64_t payload_n)
 {
 	enum cache_cmd cmd = *(conn->key - 1);
+	probe(cmd, thread_index(t), conn_slot(t, conn), cmd, conn->key);
 	switch (cmd) {
 	case CACHE_CMD_GET_OR_SET:
 		debug_printf("CACHE_CMD_GET_OR_SET: key_n: %u\n", conn->key[0]);
@@ -738,16 +3691,136 @@ static void cmd_run(struct thread *t, struct conn *conn)
 		cmd_del(t, conn);
 		break;
 
+#ifdef CONFIG_SHARD
+	case CACHE_CMD_SHARD_MAP:
+		debug_printf("CACHE_CMD_SHARD_MAP:\n");
+		cmd_shard_map(t, conn);
+		break;
+#endif
+
+	case CACHE_CMD_SET:
+		debug_printf("CACHE_CMD_SET: key_n: %u\n", conn->key[0]);
+		cmd_set(t, conn, payload, payload_n);
+		break;
+
+	case CACHE_CMD_BULK_LOAD:
+		debug_printf("CACHE_CMD_BULK_LOAD:\n");
+		cmd_bulk_load(t, conn, payload, payload_n);
+		break;
+
+	case CACHE_CMD_INCR:
+	case CACHE_CMD_DECR:
+	case CACHE_CMD_ADD:
+		debug_printf("CACHE_CMD_COUNTER: %d key_n: %u\n", cmd,
+								conn->key[0]);
+		cmd_counter(t, conn, payload, payload_n);
+		break;
+
+	case CACHE_CMD_GET_RANGE:
+		debug_printf("CACHE_CMD_GET_RANGE: key_n: %u\n", conn->key[0]);
+		cmd_get_range(t, conn, payload, payload_n);
+		break;
+
+#ifdef CONFIG_NAMESPACE
+	case CACHE_CMD_FLUSH:
+		debug_printf("CACHE_CMD_FLUSH: key_n: %u\n", conn->key[0]);
+		cmd_flush(t, conn);
+		break;
+#endif
+
+#ifdef CONFIG_ETAG
+	case CACHE_CMD_GET_IF_CHANGED:
+		debug_printf("CACHE_CMD_GET_IF_CHANGED: key_n: %u\n",
+							conn->key[0]);
+		cmd_get_if_changed(t, conn, payload, payload_n);
+		break;
+#endif
+
+	case CACHE_CMD_SUBSCRIBE:
+		debug_printf("CACHE_CMD_SUBSCRIBE:\n");
+		cmd_subscribe(t, conn);
+		break;
+
+#ifndef CONFIG_IO_URING
+	case CACHE_CMD_MUX:
+		debug_printf("CACHE_CMD_MUX:\n");
+		cmd_mux(t, conn, payload, payload_n);
+		break;
+#endif
+
+#ifndef CONFIG_RAFT
+	case CACHE_CMD_STATS:
+		debug_printf("CACHE_CMD_STATS:\n");
+		cmd_stats(t, conn);
+		break;
+#endif
+
+#if defined(CONFIG_LATENCY) && !defined(CONFIG_RAFT)
+	case CACHE_CMD_LATENCY:
+		debug_printf("CACHE_CMD_LATENCY:\n");
+		cmd_latency(t, conn);
+		break;
+
+	case CACHE_CMD_LATENCY_RESET:
+		debug_printf("CACHE_CMD_LATENCY_RESET:\n");
+		cmd_latency_reset(t, conn);
+		break;
+#endif
+
+#ifndef CONFIG_RAFT
+	case CACHE_CMD_TOP_KEYS:
+		debug_printf("CACHE_CMD_TOP_KEYS:\n");
+		cmd_top_keys(t, conn);
+		break;
+#endif
+
+#ifndef CONFIG_RAFT
+	case CACHE_CMD_SMALL_RATIO:
+		debug_printf("CACHE_CMD_SMALL_RATIO:\n");
+		cmd_small_ratio(t, conn);
+		break;
+#endif
+
+#if defined(CONFIG_MRC) && !defined(CONFIG_RAFT)
+	case CACHE_CMD_MRC:
+		debug_printf("CACHE_CMD_MRC:\n");
+		cmd_mrc(t, conn);
+		break;
+#endif
+
 	default:
 		debug_printf("command not found: %d\n", cmd);
 		free_conn(t, conn);
 	}
 }
 
+static void cmd_run(struct thread *t, struct conn *conn)
+{
+#ifdef CONFIG_ROUTE
+	enum cache_cmd cmd = *(conn->key - 1);
+	if (cmd != CACHE_CMD_SHARD_MAP && cmd != CACHE_CMD_BULK_LOAD &&
+	    cmd != CACHE_CMD_FLUSH && cmd != CACHE_CMD_SUBSCRIBE &&
+	    cmd != CACHE_CMD_MUX && cmd != CACHE_CMD_STATS &&
+	    cmd != CACHE_CMD_LATENCY && cmd != CACHE_CMD_LATENCY_RESET &&
+	    cmd != CACHE_CMD_TOP_KEYS && cmd != CACHE_CMD_MRC &&
+	    cmd != CACHE_CMD_SMALL_RATIO &&
+	    cmd_route(t, conn))
+		return;
+#endif
+	uint64_t size = CMD_SIZE_MIN + (uint64_t)conn->key[0];
+	uint64_t readed = CMD_SIZE_MAX - conn->unio;
+	cmd_exec(t, conn, conn->key - 1 + size, readed - size);
+}
+
 static bool cmd_full_readed(struct conn *conn)
 {
 	uint64_t readed = CMD_SIZE_MAX - conn->unio;
-	return readed == CMD_SIZE_MIN + (uint64_t)conn->key[0];
+	if (readed < CMD_SIZE_MIN)
+		return false;
+
+	uint64_t size = CMD_SIZE_MIN + (uint64_t)conn->key[0];
+	return readed == size ||
+	       (readed > size && cmd_has_payload(*(conn->key - 1)));
 }
 
 static void state_in_cmd(struct thread *t, struct conn *conn)
@@ -760,29 +3833,6 @@ static void state_in_cmd(struct thread *t, struct conn *conn)
 		cmd_run(t, conn);
 }
 
-static void conn_unlock_key_for_success(struct thread *t, struct conn *conn)
-{
-	cancel_clock(conn);
-	kv_enable(t, conn);
-	struct kv *kv = conn_kv(conn);
-
-	struct conn *curr, *temp;
-	list_for_each_entry_safe(curr, temp, &conn->interest, interest) {
-		list_del(&curr->interest);
-		conn_borrow_kv(t, curr, kv);
-		change_to_get_out_hit(t, curr);
-	}
-
-	conn_return_kv(t, conn);
-
-	uint64_t page = hash_resize_page(&t->hash_table);
-	if (page > 0) {
-		void *new = memory_malloc_advance(t, page);
-		if (new)
-			hash_resize(&t->hash_table, page, new);
-	}
-}
-
 static void state_set_in_value(struct thread *t, struct conn *conn)
 {
 	debug_printf("CONN_STATE_SET_IN_VALUE:\n");
@@ -791,20 +3841,38 @@ static void state_set_in_value(struct thread *t, struct conn *conn)
 	struct iovec iov[2 + 2];
 	int iov_len = kv_val_to_iovec(conn_kv(conn), readed, iov);
 
+#ifdef CONFIG_IO_URING
+	/* don't read ahead the next command, see SET_EXTRA_BUFFER */
+	if (conn_read_msg(t, conn, iov, iov_len) && conn->unio == CMD_SIZE_MAX) {
+		conn_unlock_key_for_success(t, conn);
+		if (conn->set)
+			change_set_to_out_success(t, conn);
+		else
+			change_to_in_cmd(conn);
+	}
+#else
 	unsigned char cmd;
 	iov[iov_len].iov_base = &cmd;
 	iov[iov_len].iov_len = 1;
 	iov[iov_len + 1].iov_base = conn->key;
 	iov[iov_len + 1].iov_len = 1 + CONFIG_KEY_SIZE_MAX;
+	/* CMD-SET is replied, nothing follows the value */
+	if (!conn->set)
+		iov_len += 2;
 
-	if (conn_read_msg(t, conn, iov, iov_len + 2) && conn->unio <= CMD_SIZE_MAX) {
+	if (conn_read_msg(t, conn, iov, iov_len) && conn->unio <= CMD_SIZE_MAX) {
 		conn_unlock_key_for_success(t, conn);
+		if (conn->set) {
+			change_set_to_out_success(t, conn);
+			return;
+		}
 
 		conn->state = CONN_STATE_IN_CMD;
 		*(enum cache_cmd *)(conn->key - 1) = cmd;
 		if (cmd_full_readed(conn))
 			cmd_run(t, conn);
 	}
+#endif
 }
 
 static void state_set_in_value_size(struct thread *t, struct conn *conn)
@@ -812,64 +3880,274 @@ static void state_set_in_value_size(struct thread *t, struct conn *conn)
 	debug_printf("CONN_STATE_SET_IN_VALUE_SIZE:\n");
 
 	struct iovec iov[2];
-	uint64_t readed = SET_REQ_SIZE + SET_EXTRA_BUFFER - conn->unio;
+	uint64_t extra = conn_set_extra_buffer(conn);
+	uint64_t readed = SET_REQ_SIZE + extra - conn->unio;
 	iov[0].iov_base = conn->buffer + readed;
 	iov[0].iov_len = SET_REQ_SIZE - readed;
 
+#ifdef CONFIG_IO_URING
 	unsigned char buffer[SET_EXTRA_BUFFER];
+#else
+	/* the value lands where it is in a page allocated kv */
+	unsigned char *buffer = landing_get(t);
+	if (buffer == NULL) {
+		free_conn(t, conn);
+		return;
+	}
+	buffer += sizeof(struct kv) + KEY_SIZE(conn->key);
+#endif
 	iov[1].iov_base = buffer;
-	iov[1].iov_len = SET_EXTRA_BUFFER;
+	iov[1].iov_len = extra;
 
-	if (!conn_read_msg(t, conn, iov, 2) || conn->unio > SET_EXTRA_BUFFER)
+	if (!conn_read_msg(t, conn, iov, 2) || conn->unio > extra)
 		return;
 
 	uint64_t val_size = le64toh(conn->size);
-	struct kv *kv = kv_malloc(t, conn->key, val_size);
-	if (kv == NULL) {
-		free_conn(t, conn);
-		return;
-	}
-
-	kv_init(kv, conn->key, val_size);
-	kv_borrow(kv, &conn->kv_borrower);
+	uint64_t buffer_n = extra - conn->unio;
+	uint64_t n;
+	if (val_size == SET_CHUNKED) {
+		int64_t consumed = chunk_start(t, conn, buffer, buffer_n);
+		if (consumed == -1)
+			return;
+		if (conn_kv(conn) == NULL) {
+			if (buffer_n == extra)
+				state_chunk_in(t, conn);
+			return;
+		}
+		n = consumed;
+	} else {
+		struct kv *kv = NULL;
+	#ifndef CONFIG_IO_URING
+		kv = kv_adopt_landing(t, conn->key, val_size, buffer_n);
+	#endif
+		if (kv) {
+			n = buffer_n < val_size ? buffer_n : val_size;
+		} else {
+			kv = kv_malloc(t, conn->key, val_size);
+			if (kv == NULL) {
+				free_conn(t, conn);
+				return;
+			}
 
-	uint64_t buffer_n = SET_EXTRA_BUFFER - conn->unio;
-	uint64_t n = kv_copy_val(kv, buffer, buffer_n);
-	if (n < val_size) {
-		conn->state = CONN_STATE_SET_IN_VALUE;
-		conn->unio = val_size + CMD_SIZE_MAX - n;
-		if (buffer_n == SET_EXTRA_BUFFER) {
-			state_set_in_value(t, conn);
+			kv_init(kv, conn->key, val_size);
+			n = kv_copy_val(kv, buffer, buffer_n);
+		}
+		kv_borrow(kv, &conn->kv_borrower);
+		if (n < val_size) {
+			conn->state = CONN_STATE_SET_IN_VALUE;
+			conn->unio = val_size + CMD_SIZE_MAX - n;
+			if (buffer_n == extra) {
+				state_set_in_value(t, conn);
+			}
+			return;
 		}
-		return;
 	}
 
 	conn_unlock_key_for_success(t, conn);
+	if (conn->set) {
+		change_set_to_out_success(t, conn);
+		return;
+	}
 
 	conn->state = CONN_STATE_IN_CMD;
-	conn->unio = CMD_SIZE_MAX - (buffer_n - n);
-	memcpy(conn->key - 1, buffer + n, buffer_n - n);
+	uint64_t left = buffer_n - n;
+#ifndef CONFIG_IO_URING
+	if (left > CMD_SIZE_MAX) {
+		/* the next command is read with its payload, which is consumed
+		before the buffer is reused */
+		unsigned char *next = buffer + n;
+		uint64_t size = CMD_SIZE_MIN + (uint64_t)next[1];
+		memcpy(conn->key - 1, next, size);
+		conn->unio = CMD_SIZE_MAX - size;
+		if (cmd_has_payload(next[0]))
+			cmd_exec(t, conn, next + size, left - size);
+		else
+			free_conn(t, conn);
+		return;
+	}
+#endif
+
+	conn->unio = CMD_SIZE_MAX - left;
+	memcpy(conn->key - 1, buffer + n, left);
 	if (cmd_full_readed(conn)) {
 		cmd_run(t, conn);
-	} else if (buffer_n == SET_EXTRA_BUFFER) {
+	} else if (buffer_n == extra) {
 		state_in_cmd(t, conn);
 	}
 }
 
+static void state_bulk_in(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_BULK_IN:\n");
+
+	do {
+		struct bulk *bulk = conn->bulk;
+		uint64_t space = BULK_DATA_SIZE - bulk->tail;
+		conn->unio = space;
+		if (!conn_read(t, conn, bulk->data + bulk->tail))
+			return;
+
+		bulk->tail += space - conn->unio;
+		if (!bulk_load(t, conn))
+			return;
+	/* a partial read drains the socket */
+	} while (conn->unio == 0);
+}
+
+static void state_chunk_in(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_CHUNK_IN:\n");
+
+	while (true) {
+		struct iovec iov;
+		if (conn->state == CONN_STATE_CHUNK_IN_SIZE) {
+			iov.iov_base = conn->buffer + SET_REQ_SIZE - conn->unio;
+			iov.iov_len = conn->unio;
+		} else {
+			unsigned char *space;
+			uint64_t n = chunk_space(t, conn, &space);
+			if (n == 0) {
+				free_conn(t, conn);
+				return;
+			}
+			iov.iov_base = space;
+			iov.iov_len = n < conn->unio ? n : conn->unio;
+		}
+
+		uint64_t unio = conn->unio;
+		if (!conn_read_msg(t, conn, &iov, 1))
+			return;
+
+		uint64_t readed = unio - conn->unio;
+		if (conn->state == CONN_STATE_CHUNK_IN)
+			conn->chunk->n += readed;
+		if (conn->unio == 0 && chunk_next(conn))
+			break;
+		/* a partial read drains the socket */
+		if (readed < iov.iov_len)
+			return;
+	}
+
+	if (!chunk_finish(t, conn))
+		return;
+	conn_unlock_key_for_success(t, conn);
+	if (conn->set) {
+		change_set_to_out_success(t, conn);
+		return;
+	}
+
+	/* the next command may be sent with the value, and the read event is
+	consumed */
+	change_to_in_cmd(conn);
+	state_in_cmd(t, conn);
+}
+
+/**
+ * state_bulk_in_value - Read the rest of the value of a CMD-BULK-LOAD record,
+ * and read ahead the following records into @conn->bulk
+ */
+static void state_bulk_in_value(struct thread *t, struct conn *conn)
+{
+	debug_printf("CONN_STATE_BULK_IN_VALUE:\n");
+
+	struct kv *kv = conn_kv(conn);
+	uint64_t readed = kv->val_size + BULK_DATA_SIZE - conn->unio;
+	struct iovec iov[2 + 1];
+	int iov_len = kv_val_to_iovec(kv, readed, iov);
+	iov[iov_len].iov_base = conn->bulk->data;
+	iov[iov_len].iov_len = BULK_DATA_SIZE;
+
+	if (!conn_read_msg(t, conn, iov, iov_len + 1) ||
+	    conn->unio > BULK_DATA_SIZE)
+		return;
+
+	conn_unlock_key_for_success(t, conn);
+	conn->state = CONN_STATE_BULK_IN;
+	conn->bulk->tail = BULK_DATA_SIZE - conn->unio;
+	if (bulk_load(t, conn) && conn->unio == 0)
+		state_bulk_in(t, conn);
+}
+
 static void process_conn(struct thread *t, struct conn *conn)
 {
 	switch (conn->state) {
 	case CONN_STATE_IN_CMD:
 		state_in_cmd(t, conn);
 		break;
-	case CONN_STATE_OUT_SUCCESS:
-		state_out_success(t, conn);
+	case CONN_STATE_OUT_SUCCESS:
+		state_out_success(t, conn);
+		break;
+	case CONN_STATE_GET_OUT_HIT:
+		state_get_out_hit(t, conn);
+		break;
+	case CONN_STATE_OUT_SHARD_MAP:
+	#ifdef CONFIG_SHARD
+		state_out_shard_map(t, conn);
+		break;
+	#else
+		__builtin_unreachable();
+	#endif
+	case CONN_STATE_BULK_IN:
+		state_bulk_in(t, conn);
+		break;
+	case CONN_STATE_COUNTER_IN:
+		state_counter_in(t, conn);
+		break;
+	case CONN_STATE_RETRY:
+		state_retry(t, conn);
+		break;
+	case CONN_STATE_OUT_BUFFER:
+		state_out_buffer(t, conn);
+		break;
+	case CONN_STATE_GET_RANGE_IN:
+		state_get_range_in(t, conn);
+		break;
+#ifdef CONFIG_ETAG
+	case CONN_STATE_ETAG_IN:
+		state_etag_in(t, conn);
+		break;
+	case CONN_STATE_GET_OUT_ETAG:
+		state_get_out_hit(t, conn);
+		break;
+	case CONN_STATE_OUT_ETAG:
+		state_out_etag(t, conn);
+		break;
+#endif
+	case CONN_STATE_SUB_OUT:
+		state_sub_out(t, conn);
+		break;
+#ifndef CONFIG_IO_URING
+	case CONN_STATE_MUX:
+		state_mux(t, conn);
+		break;
+	case CONN_STATE_MUX_BLOCKED:
+	case CONN_STATE_MUX_DONE:
+		__builtin_unreachable();
+#endif
+#ifndef CONFIG_RAFT
+	case CONN_STATE_OUT_STATS:
+		state_out_stats(t, conn);
+		break;
+#endif
+#if defined(CONFIG_LATENCY) && !defined(CONFIG_RAFT)
+	case CONN_STATE_OUT_LATENCY:
+		state_out_latency(t, conn);
 		break;
-	case CONN_STATE_GET_OUT_HIT:
-		state_get_out_hit(t, conn);
+#endif
+#ifndef CONFIG_RAFT
+	case CONN_STATE_OUT_TOP_KEYS:
+		state_out_top_keys(t, conn);
+		break;
+#endif
+#if defined(CONFIG_MRC) && !defined(CONFIG_RAFT)
+	case CONN_STATE_OUT_MRC:
+		state_out_mrc(t, conn);
 		break;
+#endif
 
 	case CONN_STATE_FREE:
+		if (conn_kv(conn))
+			conn_return_kv(t, conn);
 		conn_free(t, conn);
 		break;
 
@@ -882,26 +4160,108 @@ static void process_conn(struct thread *t, struct conn *conn)
 	case CONN_STATE_SET_IN_VALUE:
 		state_set_in_value(t, conn);
 		break;
+	case CONN_STATE_BULK_IN_VALUE:
+		state_bulk_in_value(t, conn);
+		break;
+	case CONN_STATE_CHUNK_IN_SIZE:
+	case CONN_STATE_CHUNK_IN:
+		state_chunk_in(t, conn);
+		break;
 
 	case CONN_STATE_GET_BLOCKED:
+	case CONN_STATE_ROUTE_BLOCKED:
+	case CONN_STATE_RETRY_BLOCKED:
+	case CONN_STATE_SUB_IDLE:
 		__builtin_unreachable();
 	}
 }
 
+#ifdef CONFIG_IO_URING
+/**
+ * conn_redrive - Submit the next request of @conn if it is not submitted yet
+ * 
+ * Note: epoll reports the next event by itself, but io_uring needs the next
+ * request being submitted, which the state does when it is processed
+ */
+static void conn_redrive(struct thread *t, struct conn *conn)
+{
+	if (conn->fd != -1 && !conn->inflight &&
+	    (conn->state & (EPOLLIN | EPOLLOUT)))
+		process_conn(t, conn);
+}
+#endif
+
+/* tag of dispatched connections whose commands are routed, see
+CONFIG_ROUTE */
+#define DISPATCH_ROUTE	8
+
 void thread_dispatch(uint32_t id, int fd)
 {
+	uint64_t tag = ((uint64_t)fd << 32) | 1;
+#ifdef CONFIG_ROUTE
+	if (id == THREAD_ID_ANY) {
+		/* Note: only the main thread dispatches to any thread */
+		static uint32_t next = 0;
+		id = next;
+		next = (next + 1) % CONFIG_THREAD_NR;
+		tag |= DISPATCH_ROUTE;
+	}
+#endif
 	struct thread *t = threads + id;
-	if (!epoll_add_out(t->epfd, fd, ((uint64_t)fd << 32) | 1))
+	if (!epoll_add_out(t->epfd, fd, tag))
 		close(fd);
 }
 
-static void thread_accept(struct thread *t, int fd)
+#ifdef CONFIG_THREAD_PORT
+/**
+ * thread_listen_accept - Accept new connections from the thread listener
+ * 
+ * Note: connections are distributed to ourselves the same way the main thread
+ * does, so they go through thread_accept() as well
+ */
+static void thread_listen_accept(struct thread *t)
+{
+	while (true) {
+		struct in6_addr peer;
+		int fd = accept2(t->listen_fd, &peer);
+		if (fd == -1)
+			return;
+
+		thread_dispatch(t - threads, fd);
+	}
+}
+#endif
+
+/**
+ * thread_accept - Serve the connection @fd dispatched to us
+ * @route: commands of @fd are routed, see CONFIG_ROUTE
+ */
+static void thread_accept(struct thread *t, int fd, bool route)
 {
+#ifdef CONFIG_IO_URING
+	/* from now on, @fd is only driven by io_uring, which parks blocking IO
+	in the kernel instead of failing with EAGAIN */
+	epoll_del(t->epfd, fd);
+	int flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+		close(fd);
+		return;
+	}
+#elif defined(CONFIG_ZEROCOPY)
+	int opt = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt))) {
+		close(fd);
+		return;
+	}
+#endif
+
 	struct conn *conn = conn_malloc(t, fd);
-	if (conn)
+	if (conn) {
+		conn->route = route;
 		epfd_weak_up_conn(t, conn);
-	else
+	} else {
 		close(fd);
+	}
 }
 
 static void clock_service(struct thread *t, int timerfd)
@@ -921,6 +4281,205 @@ static void clock_service(struct thread *t, int timerfd)
 		t->clock_death.first->prev_next = &t->clock_death.first;
 		hlist_head_init(&t->clock_probation);
 	}
+
+#ifdef CONFIG_REPLICA
+	replica_copies_shrink(t);
+#endif
+#ifdef CONFIG_NAMESPACE
+	namespace_sweep(t);
+#endif
+}
+
+#ifdef CONFIG_ROUTE
+/**
+ * route_cmd_run - Run the command of @conn outside of process_conn()
+ */
+static void route_cmd_run(struct thread *t, struct conn *conn)
+{
+	cmd_run(t, conn);
+#ifdef CONFIG_IO_URING
+	conn_redrive(t, conn);
+#endif
+}
+
+/**
+ * thread_route_pending - Route the conns on @t->route_pending again
+ */
+static void thread_route_pending(struct thread *t)
+{
+	if (list_empty(&t->route_pending))
+		return;
+
+	/* conns still blocked are added back to @t->route_pending */
+	struct list_head pending = t->route_pending;
+	list_fix(&pending);
+	list_head_init(&t->route_pending);
+	while (!list_empty(&pending)) {
+		struct conn *conn;
+		conn = list_first_entry(&pending, struct conn, interest);
+		list_del(&conn->interest);
+		conn->state = CONN_STATE_IN_CMD;
+		route_cmd_run(t, conn);
+	}
+}
+
+/**
+ * conn_route_in - Serve the connection routed to us by @msg
+ */
+static void conn_route_in(struct thread *t, const struct route_msg *msg)
+{
+	struct conn *conn = conn_malloc(t, msg->fd);
+	if (conn == NULL) {
+		close(msg->fd);
+		return;
+	}
+#ifndef CONFIG_IO_URING
+	if (!epoll_add(t->epfd, msg->fd, (uint64_t)conn)) {
+		conn_free(t, conn);
+		return;
+	}
+#endif
+
+	memcpy(conn->key - 1, msg->cmd, msg->n);
+	conn->route = true;
+	conn->state = CONN_STATE_IN_CMD;
+	conn->unio = CMD_SIZE_MAX - msg->n;
+	route_cmd_run(t, conn);
+}
+
+#ifdef CONFIG_SHARD
+/**
+ * thread_shard_move - Move the shard as the shard balancer asked
+ * @move: see (struct thread->shard_move)
+ * 
+ * Note: the new owner serves the shard at once, commands of the shard reaching
+ * us are routed to it from now on. Our kvs of the shard are dropped instead of
+ * moved, because their memory belongs to us, see shard_sweep().
+ */
+static void thread_shard_move(struct thread *t, uint64_t move)
+{
+	uint32_t shard = move;
+	uint32_t to = move >> 32;
+	/* already moved, being swept */
+	if (shard_thread(shard) != t)
+		return;
+
+	/* the kv locks of the shard are left to their holders, see
+	conn_unlock_key_for_success() */
+	__atomic_store_n(&shard_map[shard], to, __ATOMIC_RELEASE);
+	t->shard_sweep_bucket = 0;
+}
+
+/**
+ * shard_sweep - Drop the kvs of the shard we moved away
+ * 
+ * A sweep walks through the hash table after a move, SHARD_SWEEP buckets or
+ * migrated buckets a round, so a move never stalls the connections of the
+ * thread, and it finishes on an idle thread as well. The move is
+ * done when the sweep is, no other shard moves in the meantime, so the shard
+ * can not come back to us while we still have stale kvs of it.
+ */
+static void shard_sweep(struct thread *t)
+{
+	uint64_t move = __atomic_load_n(&t->shard_move, __ATOMIC_ACQUIRE);
+	if (move == SHARD_MOVE_NONE || shard_thread((uint32_t)move) == t)
+		return;
+
+	/* kv_free() may migrate other kvs, so collect them first, migration
+	fixes the list for us */
+	struct list_head drop;
+	list_head_init(&drop);
+	uint32_t shard = move;
+	for (int i = 0; i < SHARD_SWEEP; i++) {
+		struct hlist_head *bucket;
+		bucket = hash_bucket_at(&t->hash_table, t->shard_sweep_bucket);
+		if (bucket == NULL) {
+			/* a shrinking migration may move kvs to the swept
+			buckets, start over after it */
+			t->shard_sweep_bucket = 0;
+			if (t->hash_table.old_buckets) {
+				/* lookups may never come to finish it */
+				hash_migrate(&t->hash_table, &t->memory);
+				continue;
+			}
+			__atomic_store_n(&t->shard_move, SHARD_MOVE_NONE,
+							__ATOMIC_RELEASE);
+			move = SHARD_MOVE_NONE;
+			break;
+		}
+
+		struct hlist_node *curr;
+		hlist_for_each(curr, bucket) {
+			if (thread_range(curr))
+				continue;
+
+			struct kv *kv = container_of(curr, struct kv, hash_node);
+			if (key_shard(KV_KEY(kv)) == shard) {
+				list_del(&kv->lru);
+				list_add(&drop, &kv->lru);
+			}
+		}
+		t->shard_sweep_bucket++;
+	}
+
+	while (!list_empty(&drop)) {
+		struct kv *kv = list_first_entry(&drop, struct kv, lru);
+		kv_disable(t, kv);
+		if (kv_no_borrower(kv))
+			kv_free(t, kv);
+	}
+
+	/* go on next round, even if no event comes */
+	if (move != SHARD_MOVE_NONE)
+		eventfd_write(t->route_efd, 1);
+}
+#endif
+
+/**
+ * thread_route_receive - Serve the connections other threads routed to us
+ */
+static void thread_route_receive(struct thread *t)
+{
+	eventfd_t n;
+	eventfd_read(t->route_efd, &n);
+
+	for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
+		struct route_ring *ring = &route_rings[i][t - threads];
+		struct route_msg *msg;
+		while ((msg = route_ring_head(ring))) {
+			conn_route_in(t, msg);
+			route_ring_pop(ring);
+		}
+
+		/* pairs with the fence in conn_route() */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (READ_ONCE(ring->blocked)) {
+			WRITE_ONCE(ring->blocked, false);
+			eventfd_write(threads[i].route_efd, 1);
+		}
+	}
+
+#ifdef CONFIG_SHARD
+	uint64_t move = __atomic_load_n(&t->shard_move, __ATOMIC_ACQUIRE);
+	if (move != SHARD_MOVE_NONE)
+		thread_shard_move(t, move);
+#endif
+}
+#endif
+
+/**
+ * thread_fd_service - Serve the readable @fd, which is the clock timer or
+ * (@t->route_efd)
+ */
+static void thread_fd_service(struct thread *t, int fd)
+{
+#ifdef CONFIG_ROUTE
+	if (fd == t->route_efd) {
+		thread_route_receive(t);
+		return;
+	}
+#endif
+	clock_service(t, fd);
 }
 
 #define MAX_EVENTS ((sizeof(struct thread) - offsetof(struct thread, events)) / \
@@ -928,6 +4487,149 @@ static void clock_service(struct thread *t, int timerfd)
 
 static_assert(MAX_EVENTS >= THREAD_MAX_CONN);
 
+#ifdef CONFIG_IO_URING
+/**
+ * grab_dispatched_conns - Accept all connections the main thread distributed
+ * to us through @t->epfd
+ */
+static void grab_dispatched_conns(struct thread *t)
+{
+	struct epoll_event *events = t->events;
+	int n;
+	do {
+		n = epoll_wait(t->epfd, events, MAX_EVENTS, 0);
+		for (int i = 0; i < n; i++) {
+		#ifdef CONFIG_THREAD_PORT
+			if (events[i].data.u64 == 4) {
+				thread_listen_accept(t);
+				continue;
+			}
+		#endif
+			assert(events[i].data.u64 & 1);
+			thread_accept(t, events[i].data.u64 >> 32,
+					events[i].data.u64 & DISPATCH_ROUTE);
+		}
+	} while (n == MAX_EVENTS);
+}
+
+/**
+ * conn_complete - Process @conn after its io_uring request completed
+ * @res: result of the request
+ * @wake_up: the request is a NOP submitted by epfd_weak_up_conn()
+ */
+static void conn_complete(struct thread *t, struct conn *conn, int32_t res,
+								bool wake_up)
+{
+	assert(conn->inflight);
+	conn->inflight = false;
+	if (!wake_up) {
+		conn->res = res;
+		conn->res_ready = true;
+	}
+	process_conn(t, conn);
+	conn_redrive(t, conn);
+}
+
+#ifdef CONFIG_ZEROCOPY
+/**
+ * conn_zerocopy_notified - A zero copy send of @conn no longer refers to the
+ * memory
+ */
+static void conn_zerocopy_notified(struct thread *t, struct conn *conn)
+{
+	conn->zc_done++;
+	conn_zerocopy_release(t, conn);
+	/* conn_free() leaves this to us */
+	if (conn->fd == -1 && conn->zc_sent == conn->zc_done)
+		fixed_mem_cache_free(&t->conn_cache, conn);
+}
+#endif
+
+/**
+ * grab_uring_events - Submit requests and grab completions from io_uring
+ */
+static void grab_uring_events(struct thread *t)
+{
+	bool ok __attribute__((unused)) = uring_submit_and_wait(&t->ring, 1);
+	assert(ok);
+
+	struct io_uring_cqe *cqe;
+	while ((cqe = uring_peek_cqe(&t->ring))) {
+		uint64_t u64 = cqe->user_data;
+		int32_t res = cqe->res;
+		uint32_t flags = cqe->flags;
+		bool more = flags & IORING_CQE_F_MORE;
+		uring_cqe_seen(&t->ring);
+
+		if (u64 & 1) {
+			/* main thread distribute socket fd to us */
+			grab_dispatched_conns(t);
+			if (!more)
+				thread_poll(t, t->epfd, 1);
+		} else if (u64 & 2) {
+			/* this is a clock service or routed connections */
+			thread_fd_service(t, u64 >> 32);
+			if (!more)
+				thread_poll(t, u64 >> 32, 2);
+		} else {
+			struct conn *conn = (void *)(u64 & ~URING_WAKE_UP);
+		#ifdef CONFIG_ZEROCOPY
+			if (flags & IORING_CQE_F_NOTIF) {
+				conn_zerocopy_notified(t, conn);
+				continue;
+			}
+			/* a notification follows */
+			if (more)
+				conn->zc_sent++;
+		#endif
+			conn_complete(t, conn, res, u64 & URING_WAKE_UP);
+		}
+	}
+}
+#else
+#ifdef CONFIG_ZEROCOPY
+/**
+ * conn_read_errqueue - Read zero copy completions from the error queue of
+ * @conn
+ * 
+ * @return: true on only zero copy completions are read, false on there is
+ * nothing or a real error
+ */
+static bool conn_read_errqueue(struct thread *t, struct conn *conn)
+{
+	bool read = false;
+	while (true) {
+		unsigned char control[128];
+		struct msghdr msg = {};
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(conn->fd, &msg, MSG_ERRQUEUE) == -1)
+			break;
+
+		struct cmsghdr *cmsg;
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!(cmsg->cmsg_level == SOL_IPV6 &&
+			      cmsg->cmsg_type == IPV6_RECVERR) &&
+			    !(cmsg->cmsg_level == SOL_IP &&
+			      cmsg->cmsg_type == IP_RECVERR))
+				continue;
+
+			struct sock_extended_err *err = (void *)CMSG_DATA(cmsg);
+			if (err->ee_errno != 0 ||
+			    err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				return false;
+
+			/* [ee_info, ee_data] of sends are completed */
+			conn->zc_done += err->ee_data - err->ee_info + 1;
+			read = true;
+		}
+	}
+
+	conn_zerocopy_release(t, conn);
+	return read && errno == EWOULDBLOCK;
+}
+#endif
+
 /**
  * grab_epoll_events - Grab events from epoll
  */
@@ -940,28 +4642,58 @@ static void grab_epoll_events(struct thread *t)
 
 		if (events[i].data.u64 & 1) {
 			/* main thread distribute socket fd to us */
-			thread_accept(t, events[i].data.u64 >> 32);
+			thread_accept(t, events[i].data.u64 >> 32,
+					events[i].data.u64 & DISPATCH_ROUTE);
 		} else if (events[i].data.u64 & 2) {
-			/* this is a clock service */
-			clock_service(t, events[i].data.u64 >> 32);
+			/* this is a clock service or routed connections */
+			thread_fd_service(t, events[i].data.u64 >> 32);
+	#ifdef CONFIG_THREAD_PORT
+		} else if (events[i].data.u64 & 4) {
+			/* this is the thread listener */
+			thread_listen_accept(t);
+	#endif
 		} else {
 			struct conn *conn = events[i].data.ptr;
-			if (events[i].events & ~(EPOLLIN | EPOLLOUT)) {
-				debug_printf("events: %u\n", events[i].events);
+			uint32_t ev = events[i].events;
+		#ifdef CONFIG_ZEROCOPY
+			/* zero copy completions are reported as EPOLLERR */
+			if ((ev & (EPOLLERR | EPOLLHUP)) == EPOLLERR &&
+			    conn_read_errqueue(t, conn))
+				ev &= ~EPOLLERR;
+		#endif
+			if (ev & ~(EPOLLIN | EPOLLOUT)) {
+				debug_printf("events: %u\n", ev);
 				free_conn(t, conn);
-			} else if (events[i].events & conn->state) {
+			} else if (ev & conn->state) {
 				process_conn(t, conn);
 			}
 		}
 	}
 }
+#endif
 
 static void *loop_forever(void *ptr)
 {
 	struct thread *t = ptr;
 	while (true) {
 		debug_printf("--------------loop: %d--------------\n", t->epfd);
+	#ifdef CONFIG_REPLICA
+		qsbr_quiescent(t);
+	#endif
+	#ifdef CONFIG_IO_URING
+		grab_uring_events(t);
+	#else
 		grab_epoll_events(t);
+	#endif
+	#ifdef CONFIG_ROUTE
+		/* Note: not in the middle of events, they may refer to the
+		blocked conns */
+		thread_route_pending(t);
+	#endif
+	#ifdef CONFIG_SHARD
+		shard_sweep(t);
+	#endif
+		subscribers_flush(t);
 	}
 	__builtin_unreachable();
 }
@@ -981,22 +4713,136 @@ static bool thread_create_clock_service(struct thread *t)
 		return false;
 	}
 	
+#ifdef CONFIG_IO_URING
+	thread_poll(t, timerfd, 2);
+	return true;
+#else
 	if (epoll_add_in(t->epfd, timerfd, ((uint64_t)timerfd << 32) | 2))
 		return true;
 
 	close(timerfd);
 	return false;
+#endif
+}
+
+#ifdef CONFIG_ROUTE
+/**
+ * thread_route_init - Create (@t->route_efd) for receiving routed connections
+ */
+static bool thread_route_init(struct thread *t)
+{
+	list_head_init(&t->route_pending);
+#ifdef CONFIG_SHARD
+	t->shard_move = SHARD_MOVE_NONE;
+	t->shard_sweep_bucket = 0;
+	t->shard_map_readers = 0;
+#endif
+	t->route_efd = eventfd(0, EFD_NONBLOCK);
+	if (t->route_efd == -1)
+		return false;
+
+#ifdef CONFIG_IO_URING
+	thread_poll(t, t->route_efd, 2);
+	return true;
+#else
+	return epoll_add_in(t->epfd, t->route_efd,
+				((uint64_t)t->route_efd << 32) | 2);
+#endif
+}
+#endif
+
+#ifdef CONFIG_IO_URING
+#ifdef CONFIG_IO_URING_SQPOLL
+#define URING_SQPOLL true
+#else
+#define URING_SQPOLL false
+#endif
+
+/**
+ * thread_uring_init - Setup io_uring for @t, and register sparse files for
+ * (@t->__conns)
+ */
+static bool thread_uring_init(struct thread *t)
+{
+	if (!uring_init(&t->ring, THREAD_URING_ENTRIES, URING_SQPOLL))
+		return false;
+
+	/* borrow events as a temporary array, it is not used yet */
+	static_assert(sizeof(t->events) >= sizeof(int) * THREAD_MAX_CONN);
+	int *fds = (int *)t->events;
+	for (int i = 0; i < THREAD_MAX_CONN; i++)
+		fds[i] = -1;
+
+	if (!uring_register_files(&t->ring, fds, THREAD_MAX_CONN))
+		return false;
+
+	thread_poll(t, t->epfd, 1);
+	return true;
 }
+#endif
 
-static bool thread_init(struct thread *t)
+/**
+ * thread_init - Initialize @t
+ * @port: port of the thread listener, see CONFIG_THREAD_PORT
+ * 
+ * @return: true on success, false on failure
+ */
+static bool thread_init(struct thread *t, int port __attribute__((unused)))
 {
 #ifdef CONFIG_RAFT
 	t->__warmed_up = false;
+#endif
+#ifdef CONFIG_REPLICA
+	t->qsbr_seen = 0;
+	t->retired = NULL;
+	t->hot_sample = 0;
+	memset(t->hot_keys, 0, sizeof(t->hot_keys));
+	for (int i = 0; i < CONFIG_REPLICA_NR; i++)
+		kv_borrower_init(&t->replica_copies[i].borrower);
+#endif
+#ifdef CONFIG_NAMESPACE
+	t->swept_epoch = 0;
+	t->sweep_bucket = 0;
+#endif
+#ifdef CONFIG_ETAG
+	t->etag = etag_base + (t - threads);
+#endif
+	list_head_init(&t->subscribers);
+	t->sub_pending = false;
+#ifdef CONFIG_NAMESPACE
+	t->sub_epoch = 0;
+#endif
+	memset(&t->stats, 0, sizeof(t->stats));
+#ifndef CONFIG_RAFT
+	t->stats_readers = 0;
+#endif
+#ifdef CONFIG_LATENCY
+	memset(&t->latency, 0, sizeof(t->latency));
+#ifndef CONFIG_RAFT
+	t->latency_readers = 0;
+#endif
+#endif
+	memset(&t->topk, 0, sizeof(t->topk));
+	t->topk.window = now_ns();
+#ifndef CONFIG_RAFT
+	t->topk_readers = 0;
+#endif
+#ifdef CONFIG_MRC
+	mrc_init(&t->mrc);
+#ifndef CONFIG_RAFT
+	t->mrc_readers = 0;
+#endif
+#endif
+#ifdef CONFIG_TRACE
+	if (!trace_init(&t->trace, t - threads))
+		return false;
 #endif
 	memory_init(&t->memory, THREAD_MAX_MEM >> PAGE_SHIFT);
-	t->s_lru_size = 0;
-	list_head_init(&t->s_lru_head);
-	list_head_init(&t->m_lru_head);
+#ifndef CONFIG_IO_URING
+	t->landing = NULL;
+	t->landing_page = 0;
+#endif
+	s3fifo_init(&t->s3fifo);
 	hlist_head_init(&t->clock_probation);
 	hlist_head_init(&t->clock_death);
 	t->epfd = epoll_create1(0);
@@ -1005,26 +4851,150 @@ static bool thread_init(struct thread *t)
 	kv_cache_list_init(t->kv_cache_list);
 	fixed_mem_cache_init(&t->conn_cache, t->__conns, sizeof(struct conn),
 							THREAD_MAX_CONN);
+#ifdef CONFIG_IO_URING
+	if (!thread_uring_init(t))
+		return false;
+#endif
+#ifdef CONFIG_ROUTE
+	if (!thread_route_init(t))
+		return false;
+#endif
+#ifdef CONFIG_THREAD_PORT
+	t->listen_fd = listen_port(port, t->epfd, 4);
+	if (t->listen_fd == -1)
+		return false;
+#endif
 
 	return thread_create_clock_service(t) &&
 		hash_table_init(&t->hash_table, &t->memory);
 }
 
-static bool thread_run(struct thread *t)
+static bool thread_run(struct thread *t, int port)
 {
 	pthread_t tid;
-	return thread_init(t) && pthread_create(&tid, NULL, loop_forever, t) == 0;
+	return thread_init(t, port) &&
+		pthread_create(&tid, NULL, loop_forever, t) == 0;
+}
+
+#ifdef CONFIG_SHARD
+/**
+ * shard_balance - Ask the busiest thread to move a shard to the idlest thread
+ * if the load is skewed
+ * @delta: number of commands served for each shard since last time
+ */
+static void shard_balance(const uint64_t delta[CONFIG_SHARD_NR])
+{
+	static uint64_t load[CONFIG_THREAD_NR];
+	memset(load, 0, sizeof(load));
+	for (uint32_t i = 0; i < CONFIG_SHARD_NR; i++)
+		load[shard_thread(i) - threads] += delta[i];
+
+	uint32_t busy = 0, idle = 0;
+	for (uint32_t i = 1; i < CONFIG_THREAD_NR; i++) {
+		if (load[i] > load[busy])
+			busy = i;
+		if (load[i] < load[idle])
+			idle = i;
+	}
+	if (load[busy] * 100 <= load[idle] * (100 + CONFIG_SHARD_SKEW))
+		return;
+
+	/* moving a shard of load d turns the gap into |gap - 2d|, pick the
+	shard that closes the gap the most */
+	uint64_t gap = load[busy] - load[idle];
+	uint32_t shard = CONFIG_SHARD_NR;
+	uint64_t best = gap;
+	for (uint32_t i = 0; i < CONFIG_SHARD_NR; i++) {
+		if (shard_thread(i) != threads + busy || delta[i] == 0 ||
+		    delta[i] >= gap)
+			continue;
+
+		uint64_t new_gap = gap > 2 * delta[i] ? gap - 2 * delta[i] :
+							2 * delta[i] - gap;
+		if (new_gap < best) {
+			best = new_gap;
+			shard = i;
+		}
+	}
+	if (shard == CONFIG_SHARD_NR)
+		return;
+
+	debug_printf("shard balance: move %u from %u to %u\n", shard, busy, idle);
+	uint64_t move = ((uint64_t)idle << 32) | shard;
+	__atomic_store_n(&threads[busy].shard_move, move, __ATOMIC_RELEASE);
+	eventfd_write(threads[busy].route_efd, 1);
+}
+
+/**
+ * shard_balance_forever - Balance shards between threads every
+ * CONFIG_SHARD_BALANCE_INTERVAL milliseconds
+ */
+static void *shard_balance_forever(void *ptr __attribute__((unused)))
+{
+	static uint64_t last[CONFIG_SHARD_NR];
+	static uint64_t delta[CONFIG_SHARD_NR];
+	struct timespec interval;
+	interval.tv_sec = CONFIG_SHARD_BALANCE_INTERVAL / 1000;
+	interval.tv_nsec = (CONFIG_SHARD_BALANCE_INTERVAL % 1000) * 1000000;
+
+	while (true) {
+		nanosleep(&interval, NULL);
+
+		bool moving = false;
+		for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
+			uint64_t move = __atomic_load_n(&threads[i].shard_move,
+							__ATOMIC_ACQUIRE);
+			moving |= move != SHARD_MOVE_NONE;
+		}
+
+		for (uint32_t i = 0; i < CONFIG_SHARD_NR; i++) {
+			uint64_t n = 0;
+			for (uint32_t j = 0; j < CONFIG_THREAD_NR; j++)
+				n += READ_ONCE(threads[j].shard_load[i]);
+			delta[i] = n - last[i];
+			last[i] = n;
+		}
+
+		/* one shard moves at a time */
+		if (!moving)
+			shard_balance(delta);
+	}
+	__builtin_unreachable();
 }
+#endif
 
-bool threads_run()
+/**
+ * threads_run - Run all the threads
+ * @port: the first port of thread listeners, thread i listens on (@port + i),
+ * it is ignored unless CONFIG_THREAD_PORT
+ * 
+ * @return: true on success, false on failure
+ */
+bool threads_run(int port)
 {
 #ifdef DEBUG
 	kv_cache_idx_generate_print();
 #endif
 
+#ifdef CONFIG_SHARD
+	for (uint32_t i = 0; i < CONFIG_SHARD_NR; i++)
+		shard_map[i] = i / (CONFIG_SHARD_NR / CONFIG_THREAD_NR);
+#endif
+#ifdef CONFIG_ETAG
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	etag_base = now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+
 	for (uint32_t i = 0; i < CONFIG_THREAD_NR; i++) {
-		if (!thread_run(&threads[i]))
+		if (!thread_run(&threads[i], port + i))
 			return false;
 	}
+
+#ifdef CONFIG_SHARD
+	pthread_t tid;
+	return pthread_create(&tid, NULL, shard_balance_forever, NULL) == 0;
+#else
 	return true;
+#endif
 }
@@ -8,23 +8,107 @@
 #include "hash_table.h"
 #include "kv_cache.h"
 #include "fixed_mem_cache.h"
-
-#define KV_CACHE_LEN	75
+#include "uring.h"
+#include "list.h"
+#include "replica.h"
+#include "stats.h"
+#include "latency.h"
+#include "topk.h"
+#include "mrc.h"
+#include "trace.h"
+#include "s3fifo.h"
 
 #define THREAD_MAX_CONN	(CONFIG_MAX_CONN / CONFIG_THREAD_NR)
 #define THREAD_MAX_MEM	((uint64_t)CONFIG_MEM_LIMIT / CONFIG_THREAD_NR)
 
 static_assert(THREAD_MAX_CONN <= INT32_MAX);
+#ifdef CONFIG_IO_URING
+/* every conn has at most one request in flight, plus two polls */
+#define THREAD_URING_ENTRIES	(THREAD_MAX_CONN + 2)
+static_assert(THREAD_URING_ENTRIES <= 32768);
+#endif
+
+#ifdef CONFIG_ROUTE
+/* thread-id of connections whose commands are routed by the server */
+#define THREAD_ID_ANY	UINT32_MAX
+#endif
+
+/* number of integers in the reply of CMD-STATS, see threads_stats() */
+#define THREADS_STATS_NR	(1 + STAT_NR + 1 + 2 * KV_CACHE_LEN)
+
+#ifdef CONFIG_LATENCY
+/* number of integers in the reply of CMD-LATENCY, see threads_latency() */
+#define THREADS_LATENCY_NR	(1 + 1 + LAT_NR * LAT_BUCKET_NR)
+#endif
+
+#ifdef CONFIG_MRC
+/* number of integers in the reply of CMD-MRC, see threads_mrc() */
+#define THREADS_MRC_NR	(1 + 1 + 2 * MRC_POINT_NR)
+#endif
+
+#ifdef CONFIG_SHARD
+/* no shard is asked to move, see (struct thread->shard_move) */
+#define SHARD_MOVE_NONE	UINT64_MAX
+#endif
 
 /**
  * thread -
  * @epfd: the epoll file descriptor that manages IO events for this thread
+ * @ring: the io_uring that manages IO events for this thread, @epfd only
+ * receives dispatched connections in this case
  * @__warmed_up: used for cluster growth. we call thread is warmed up once we
  * reclaim memory from it, be aware of main thread will read it.
+ * @listen_fd: socket fd of the thread listener, see CONFIG_THREAD_PORT
+ * @route_efd: eventfd signaled when connections are routed to us
+ * @route_pending: conns wait here for routing, see CONN_STATE_ROUTE_BLOCKED
+ * @shard_move: the shard balancer asks us to move shard (low 32 bits) to
+ * thread (high 32 bits), or SHARD_MOVE_NONE, it is cleared once our kvs of the
+ * shard are dropped
+ * @shard_sweep_bucket: the next bucket to sweep, see shard_sweep()
+ * @shard_map_readers: number of conns writing @shard_map_out
+ * @shard_map_out: a snapshot of the shard map for CACHE_CMD_SHARD_MAP, it is
+ * refreshed when no one is writing it
+ * @shard_load: number of commands served for each shard, be aware of the shard
+ * balancer will read it
+ * @qsbr_seen: the QSBR epoch seen when we hold no replica, be aware of other
+ * threads will read it
+ * @retired: replicas retired by us, the newest first
+ * @hot_sample: number of GET hits, see HOT_KEY_SAMPLE
+ * @hot_keys: hot key candidates
+ * @replica_copies: replica_copies[i] copies the replica in slot i
+ * @swept_epoch: the flush epoch the last sweep is for, see namespace_sweep()
+ * @sweep_bucket: the next bucket to sweep, 0 if no sweep is going on
+ * @etag: the last etag generated by us, see thread_etag()
+ * @subscribers: events of keys changed by us are sent to them, see
+ * CACHE_CMD_SUBSCRIBE
+ * @sub_pending: events are added to @subscribers this round
+ * @sub_epoch: the flush epoch @subscribers are told about
+ * @stats: counters of the thread, be aware of other threads will read it
+ * @stats_readers: number of conns writing @stats_out
+ * @stats_out: a snapshot of threads_stats() for CACHE_CMD_STATS, it is
+ * refreshed when no one is writing it
+ * @latency: histograms of the thread, be aware of other threads will read it
+ * @latency_readers: number of conns writing @latency_out
+ * @latency_out: a snapshot of threads_latency() for CACHE_CMD_LATENCY, it is
+ * refreshed when no one is writing it
+ * @topk: the most sampled GET keys of the thread, be aware of other threads
+ * will read the published ones
+ * @topk_readers: number of conns writing @topk_out
+ * @topk_out_size: number of bytes in @topk_out
+ * @topk_out: a snapshot of threads_top_keys() for CACHE_CMD_TOP_KEYS, it is
+ * refreshed when no one is writing it
+ * @mrc: the simulation of the sampled keys of the thread, be aware of other
+ * threads will read the counters
+ * @mrc_readers: number of conns writing @mrc_out
+ * @mrc_out: a snapshot of threads_mrc() for CACHE_CMD_MRC, it is refreshed
+ * when no one is writing it
+ * @trace: the trace file of the thread
  * @memory: memory manager
- * @s_lru_size: number of enabled kv on s_lru
- * @s_lru_head: for S3-FIFO algorithm and enabled kv only
- * @m_lru_head: for S3-FIFO algorithm and enabled kv only
+ * @landing: arena that SET values land on before their size is known, the kv
+ * takes over the pages if it is page allocated
+ * @landing_page: number of pages left in @landing
+ * @s3fifo: the queues of the enabled kvs, be aware of other threads will read
+ * the sizes and the ratio
  * @hash_table: hash table used to index kv or conn
  * @kv_cache_list: the list of kv_cache manages memory for kv and concat_val
  * 
@@ -32,14 +116,80 @@ static_assert(THREAD_MAX_CONN <= INT32_MAX);
  */
 struct thread {
 	int epfd;
+#ifdef CONFIG_IO_URING
+	struct uring ring;
+#endif
 #ifdef CONFIG_RAFT
 	bool __warmed_up;
 #endif
+#ifdef CONFIG_THREAD_PORT
+	int listen_fd;
+#endif
+#ifdef CONFIG_ROUTE
+	int route_efd;
+	struct list_head route_pending;
+#endif
+#ifdef CONFIG_SHARD
+	uint64_t shard_move;
+	uint64_t shard_sweep_bucket;
+	uint32_t shard_map_readers;
+	uint32_t shard_map_out[1 + CONFIG_SHARD_NR];
+	uint64_t shard_load[CONFIG_SHARD_NR];
+#endif
+#ifdef CONFIG_REPLICA
+	uint64_t qsbr_seen;
+	struct replica *retired;
+	uint64_t hot_sample;
+	struct hot_key hot_keys[HOT_KEY_NR];
+	struct replica_copy replica_copies[CONFIG_REPLICA_NR];
+#endif
+#ifdef CONFIG_NAMESPACE
+	uint32_t swept_epoch;
+	uint64_t sweep_bucket;
+#endif
+#ifdef CONFIG_ETAG
+	uint64_t etag;
+#endif
+	struct list_head subscribers;
+	bool sub_pending;
+#ifdef CONFIG_NAMESPACE
+	uint32_t sub_epoch;
+#endif
+	struct stats stats;
+#ifndef CONFIG_RAFT
+	uint32_t stats_readers;
+	uint64_t stats_out[THREADS_STATS_NR];
+#endif
+#ifdef CONFIG_LATENCY
+	struct latency latency;
+#ifndef CONFIG_RAFT
+	uint32_t latency_readers;
+	uint64_t latency_out[THREADS_LATENCY_NR];
+#endif
+#endif
+	struct topk topk;
+#ifndef CONFIG_RAFT
+	uint32_t topk_readers;
+	uint64_t topk_out_size;
+	unsigned char topk_out[TOPK_OUT_SIZE];
+#endif
+#ifdef CONFIG_MRC
+	struct mrc mrc;
+#ifndef CONFIG_RAFT
+	uint32_t mrc_readers;
+	uint64_t mrc_out[THREADS_MRC_NR];
+#endif
+#endif
+#ifdef CONFIG_TRACE
+	struct trace trace;
+#endif
 
 	struct memory memory;
-	uint64_t s_lru_size;
-	struct list_head s_lru_head;
-	struct list_head m_lru_head;
+#ifndef CONFIG_IO_URING
+	unsigned char *landing;
+	uint64_t landing_page;
+#endif
+	struct s3fifo s3fifo;
 	struct hash_table hash_table;
 	struct hlist_head clock_probation;
 	struct hlist_head clock_death;
@@ -51,8 +201,30 @@ struct thread {
 	struct epoll_event events[THREAD_MAX_CONN];
 } __attribute__((aligned(CACHE_LINE_SIZE)));
 
-bool threads_run();
+bool threads_run(int port);
 void thread_dispatch(uint32_t id, int fd);
+void threads_stats(uint64_t out[THREADS_STATS_NR]);
+#ifdef CONFIG_LATENCY
+void threads_latency(uint64_t out[THREADS_LATENCY_NR]);
+void threads_latency_reset();
+#endif
+uint64_t threads_top_keys(unsigned char out[TOPK_OUT_SIZE]);
+void threads_small_ratio(uint32_t ratio);
+#ifdef CONFIG_MRC
+void threads_mrc(uint64_t out[THREADS_MRC_NR]);
+#endif
+
+/**
+ * thread_id_valid - Check if @id is a valid thread-id from client
+ */
+static inline bool thread_id_valid(uint32_t id)
+{
+#ifdef CONFIG_ROUTE
+	if (id == THREAD_ID_ANY)
+		return true;
+#endif
+	return id < CONFIG_THREAD_NR;
+}
 
 #ifdef CONFIG_RAFT
 bool threads_warmed_up();
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_TOPK_H
+#define __UMEM_CACHE_TOPK_H
+
+#include <stdint.h>
+#include "config.h"
+
+/* every this many GETs one is sampled for the top keys */
+#define TOPK_SAMPLE	16
+/* number of keys a thread tracks */
+#define TOPK_NR		16
+/* the tracked keys are published and restarted every this many nanoseconds */
+#define TOPK_WINDOW	1000000000ULL
+/* number of keys in the reply of CMD-TOP-KEYS */
+#define TOPK_OUT_NR	16
+/* size of the reply of CMD-TOP-KEYS (at most) */
+#define TOPK_OUT_SIZE	(8 + TOPK_OUT_NR * (8 + 4 + 1 + CONFIG_KEY_SIZE_MAX))
+
+/**
+ * topk_key - A tracked key
+ * @n: number of times it is sampled in this window, or its estimated GETs per
+ * second after published
+ * @key: the key
+ */
+struct topk_key {
+	uint64_t n;
+	unsigned char key[1 + CONFIG_KEY_SIZE_MAX];
+};
+
+/**
+ * topk - The most sampled GET keys of a thread, counted by the Space-Saving
+ * algorithm
+ * @sample: number of GETs, see TOPK_SAMPLE
+ * @window: when this window started (in nanoseconds)
+ * @keys: keys tracked in this window
+ * @seq: odd while @published is being written, see topk_publish()
+ * @published_at: when @published is published (in nanoseconds)
+ * @published_nr: number of keys in @published
+ * @published: keys of the last window, other threads read them
+ */
+struct topk {
+	uint64_t sample;
+	uint64_t window;
+	struct topk_key keys[TOPK_NR];
+	uint32_t seq __attribute__((aligned(CACHE_LINE_SIZE)));
+	uint64_t published_at;
+	uint32_t published_nr;
+	struct topk_key published[TOPK_NR];
+};
+
+#endif
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include "trace.h"
+#include "hash_table.h"
+#include "config.h"
+
+#define TRACE_FILE_SIZE	\
+	(sizeof(struct trace_head) + CONFIG_TRACE_NR * sizeof(struct trace_record))
+
+/**
+ * trace_init - Create the trace file of thread @thread_id and map it
+ * 
+ * Note: the file of the last run is overwritten
+ */
+bool trace_init(struct trace *trace, uint32_t thread_id)
+{
+	char path[sizeof(TRACE_FILE) + 11];
+	sprintf(path, TRACE_FILE ".%u", thread_id);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return false;
+
+	void *p = MAP_FAILED;
+	if (ftruncate(fd, TRACE_FILE_SIZE) == 0)
+		p = mmap(NULL, TRACE_FILE_SIZE, PROT_READ | PROT_WRITE,
+							MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+
+	trace->head = p;
+	trace->records = (struct trace_record *)(trace->head + 1);
+	trace->head->magic = TRACE_MAGIC;
+	trace->head->thread_id = thread_id;
+	trace->head->record_size = sizeof(struct trace_record);
+	trace->head->record_nr = CONFIG_TRACE_NR;
+	trace->head->head = 0;
+	return true;
+}
+
+/**
+ * trace_add - Add a record of @key to @trace, see (struct trace_record)
+ * 
+ * Note: the head is published after the record, so a reader of a running
+ * server sees complete records
+ */
+void trace_add(struct trace *trace, uint64_t time, enum trace_op op,
+	enum trace_outcome outcome, const unsigned char *key, uint64_t val_size)
+{
+	uint64_t head = trace->head->head;
+	struct trace_record *r = &trace->records[head & (CONFIG_TRACE_NR - 1)];
+	r->time = time;
+	r->key_hash = key_hash(key);
+	r->val_size = val_size;
+	r->op = op;
+	r->outcome = outcome;
+	r->key_size = key[0];
+	__atomic_store_n(&trace->head->head, head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_TRACE_H
+#define __UMEM_CACHE_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+/* the trace file of thread i is named (TRACE_FILE ".i") */
+#define TRACE_FILE	"umem-cache-trace"
+#define TRACE_MAGIC	0x3145434152544355ULL	/* "UCTRACE1" */
+
+enum trace_op {
+	/* a GET of CMD-GET-OR-SET or CMD-MUX */
+	TRACE_GET,
+	/* a value stored by CMD-GET-OR-SET after the GET missed */
+	TRACE_FILL,
+	/* a value stored by other commands */
+	TRACE_SET,
+	TRACE_DEL,
+} __attribute__((__packed__));
+
+enum trace_outcome {
+	TRACE_HIT,
+	TRACE_MISS,
+	/* a GET waiting for a locked key */
+	TRACE_BLOCKED,
+} __attribute__((__packed__));
+
+/**
+ * trace_head - Head of a trace file, the records follow it
+ * @magic: TRACE_MAGIC
+ * @thread_id: the thread writes the file
+ * @record_size: sizeof(struct trace_record)
+ * @record_nr: number of records the file holds, power of 2
+ * @head: number of records ever written, record i is at (i % @record_nr), the
+ * older ones are overwritten
+ * 
+ * Note: the file is in the byte order of the machine, it is read on the same
+ * machine
+ */
+struct trace_head {
+	uint64_t magic;
+	uint32_t thread_id;
+	uint32_t record_size;
+	uint64_t record_nr;
+	uint64_t head;
+} __attribute__((aligned(64)));
+
+/**
+ * trace_record - A command traced
+ * @time: when it is done (CLOCK_MONOTONIC in nanoseconds)
+ * @key_hash: hash of the key, the key itself is not traced
+ * @val_size: size of the value, 0 if it is unknown
+ * @op: see enum trace_op
+ * @outcome: see enum trace_outcome, TRACE_HIT if not a GET
+ * @key_size: size of the key
+ */
+struct trace_record {
+	uint64_t time;
+	uint64_t key_hash;
+	uint64_t val_size;
+	enum trace_op op;
+	enum trace_outcome outcome;
+	uint8_t key_size;
+} __attribute__((aligned(8)));
+
+static_assert(sizeof(struct trace_record) == 32);
+
+/* a key made up by trace_make_key() is at least this many bytes */
+#define TRACE_KEY_SIZE_MIN	8
+
+bool trace_load(const char *path, struct trace_record **records, uint64_t *nr);
+bool trace_prepare(struct trace_record *records, uint64_t nr);
+void trace_make_key(const struct trace_record *r, unsigned char *key);
+
+#ifdef CONFIG_TRACE
+
+/**
+ * trace - The trace file of a thread mapped into memory
+ * @head: the file
+ * @records: records of the file
+ */
+struct trace {
+	struct trace_head *head;
+	struct trace_record *records;
+};
+
+bool trace_init(struct trace *trace, uint32_t thread_id);
+void trace_add(struct trace *trace, uint64_t time, enum trace_op op,
+	enum trace_outcome outcome, const unsigned char *key, uint64_t val_size);
+
+#endif
+
+#endif
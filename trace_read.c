@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+// Note: reading the trace files for the tools, see replay.c and sim.c
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+/**
+ * trace_load - Append the records of trace file @path to @records
+ * @nr: number of @records, updated
+ *
+ * @return: true on success, false on failure
+ */
+bool trace_load(const char *path, struct trace_record **records, uint64_t *nr)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1)
+		return false;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return false;
+	}
+
+	struct trace_head *head = mmap(NULL, st.st_size, PROT_READ,
+							MAP_SHARED, fd, 0);
+	close(fd);
+	if (head == MAP_FAILED)
+		return false;
+	if ((uint64_t)st.st_size < sizeof(*head) ||
+	    head->magic != TRACE_MAGIC ||
+	    head->record_size != sizeof(struct trace_record) ||
+	    head->record_nr == 0 ||
+	    (head->record_nr & (head->record_nr - 1)) != 0 ||
+	    (uint64_t)st.st_size < sizeof(*head) +
+				head->record_nr * sizeof(struct trace_record)) {
+		munmap(head, st.st_size);
+		return false;
+	}
+
+	/* the file may be still written, the head is read once */
+	uint64_t end = __atomic_load_n(&head->head, __ATOMIC_ACQUIRE);
+	uint64_t n = end < head->record_nr ? end : head->record_nr;
+	struct trace_record *new = realloc(*records,
+					(*nr + n + 1) * sizeof(*new));
+	if (new == NULL) {
+		munmap(head, st.st_size);
+		return false;
+	}
+
+	struct trace_record *src = (struct trace_record *)(head + 1);
+	for (uint64_t i = end - n; i < end; i++)
+		new[(*nr)++] = src[i & (head->record_nr - 1)];
+	munmap(head, st.st_size);
+	*records = new;
+	return true;
+}
+
+static int record_cmp(const void *a, const void *b)
+{
+	const struct trace_record *x = a, *y = b;
+	return (x->time > y->time) - (x->time < y->time);
+}
+
+/**
+ * size_slot - Find the slot of @hash in @table of (@mask + 1) slots
+ */
+static uint64_t size_slot(uint64_t (*table)[2], uint64_t mask, uint64_t hash)
+{
+	uint64_t i = hash & mask;
+	while (table[i][1] != 0 && table[i][0] != hash)
+		i = (i + 1) & mask;
+	return i;
+}
+
+/**
+ * trace_prepare - Sort @records of all the threads by time, and make up the
+ * value sizes the GETs did not see
+ *
+ * @return: true on success, false on out of memory
+ *
+ * Note: a GET that is not a hit takes the size of the next value of its key, or
+ * the last one if there is no next one.
+ */
+bool trace_prepare(struct trace_record *records, uint64_t nr)
+{
+	qsort(records, nr, sizeof(*records), record_cmp);
+
+	uint64_t slot_nr = 1;
+	while (slot_nr < nr * 2)
+		slot_nr <<= 1;
+	uint64_t (*table)[2] = malloc(slot_nr * sizeof(*table));
+	if (table == NULL)
+		return false;
+
+	for (int pass = 0; pass < 2; pass++) {
+		/* slot is (hash, size + 1) */
+		memset(table, 0, slot_nr * sizeof(*table));
+		for (uint64_t j = 0; j < nr; j++) {
+			uint64_t i = pass == 0 ? nr - 1 - j : j;
+			struct trace_record *r = &records[i];
+			if (r->op == TRACE_DEL)
+				continue;
+
+			uint64_t s = size_slot(table, slot_nr - 1, r->key_hash);
+			if (r->val_size != 0 || r->op != TRACE_GET) {
+				table[s][0] = r->key_hash;
+				table[s][1] = r->val_size + 1;
+			} else if (table[s][1] != 0) {
+				r->val_size = table[s][1] - 1;
+			}
+		}
+	}
+	free(table);
+	return true;
+}
+
+/**
+ * trace_make_key - Make up the key of @r in @key
+ *
+ * Note: keys are not traced, so a key is made up of the hash of the traced one,
+ * which is at least TRACE_KEY_SIZE_MIN bytes to keep the keys apart.
+ */
+void trace_make_key(const struct trace_record *r, unsigned char *key)
+{
+	key[0] = r->key_size < TRACE_KEY_SIZE_MIN ? TRACE_KEY_SIZE_MIN :
+								r->key_size;
+	memset(key + 1, 0, key[0]);
+	memcpy(key + 1, &r->key_hash, sizeof(r->key_hash));
+}
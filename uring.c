@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+// Note: we talk to the kernel directly instead of depending on liburing, only
+// the few operations required by thread.c are implemented.
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "uring.h"
+#include "rwonce.h"
+
+/* milliseconds the kernel polling thread spins before it goes to sleep */
+#define SQ_THREAD_IDLE	1000
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+								NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, const void *arg,
+							unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void *ring_mmap(int fd, size_t size, off_t offset)
+{
+	int prot = PROT_READ | PROT_WRITE;
+	int flags = MAP_SHARED | MAP_POPULATE;
+	void *ptr = mmap(NULL, size, prot, flags, fd, offset);
+	if (ptr == MAP_FAILED)
+		return NULL;
+	return ptr;
+}
+
+static void uring_deinit(struct uring *r)
+{
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_size);
+	if (r->cq_ring && r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_size);
+	if (r->sq_ring)
+		munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+}
+
+static bool uring_mmap(struct uring *r, const struct io_uring_params *p)
+{
+	r->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	r->cq_ring_size = p->cq_off.cqes +
+				p->cq_entries * sizeof(struct io_uring_cqe);
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_size > r->sq_ring_size)
+			r->sq_ring_size = r->cq_ring_size;
+		r->cq_ring_size = r->sq_ring_size;
+	}
+
+	r->sq_ring = ring_mmap(r->fd, r->sq_ring_size, IORING_OFF_SQ_RING);
+	if (r->sq_ring == NULL)
+		return false;
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ring = r->sq_ring;
+	else
+		r->cq_ring = ring_mmap(r->fd, r->cq_ring_size, IORING_OFF_CQ_RING);
+	if (r->cq_ring == NULL)
+		return false;
+
+	r->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = ring_mmap(r->fd, r->sqes_size, IORING_OFF_SQES);
+	return r->sqes;
+}
+
+/**
+ * uring_init - Setup io_uring instance @r
+ * @entries: minimum number of submission queue entries
+ * @sqpoll: let a kernel thread poll the submission queue
+ * 
+ * @return: true on success, false on failure
+ */
+bool uring_init(struct uring *r, unsigned int entries, bool sqpoll)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	if (sqpoll) {
+		p.flags = IORING_SETUP_SQPOLL;
+		p.sq_thread_idle = SQ_THREAD_IDLE;
+	}
+
+	r->fd = io_uring_setup(entries, &p);
+	if (r->fd == -1)
+		return false;
+
+	r->sq_ring = NULL;
+	r->cq_ring = NULL;
+	r->sqes = NULL;
+	if (!uring_mmap(r, &p)) {
+		uring_deinit(r);
+		return false;
+	}
+
+	char *sq = r->sq_ring;
+	r->sq_head  = (unsigned int *)(sq + p.sq_off.head);
+	r->sq_tail  = (unsigned int *)(sq + p.sq_off.tail);
+	r->sq_mask  = *(unsigned int *)(sq + p.sq_off.ring_mask);
+	r->sq_flags = (unsigned int *)(sq + p.sq_off.flags);
+	r->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	r->sqe_tail = *r->sq_tail;
+
+	char *cq = r->cq_ring;
+	r->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	r->cq_mask = *(unsigned int *)(cq + p.cq_off.ring_mask);
+	r->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	r->sqpoll = sqpoll;
+	return true;
+}
+
+/**
+ * uring_get_sqe - Get a free submission queue entry from @r
+ * 
+ * @return: the cleared entry, or NULL if the submission queue is full
+ */
+struct io_uring_sqe *uring_get_sqe(struct uring *r)
+{
+	unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	if (r->sqe_tail - head > r->sq_mask)
+		return NULL;
+
+	unsigned int i = r->sqe_tail & r->sq_mask;
+	r->sq_array[i] = i;
+	r->sqe_tail++;
+
+	struct io_uring_sqe *sqe = &r->sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+/**
+ * uring_submit_and_wait - Submit entries got from uring_get_sqe() and wait
+ * for at least @wait_nr completions
+ * 
+ * @return: true on success, false on failure
+ * 
+ * Note: it is not a failure if it is interrupted by a signal before @wait_nr
+ * completions arrived
+ */
+bool uring_submit_and_wait(struct uring *r, unsigned int wait_nr)
+{
+	unsigned int to_submit = r->sqe_tail - *r->sq_tail;
+	__atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+
+	unsigned int flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+	if (r->sqpoll) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (READ_ONCE(*r->sq_flags) & IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+		to_submit = 0;
+	}
+
+	if (to_submit == 0 && flags == 0)
+		return true;
+
+	int ret = io_uring_enter(r->fd, to_submit, wait_nr, flags);
+	return ret >= 0 || errno == EINTR || errno == EBUSY;
+}
+
+/**
+ * uring_register_files - Register @n files @fds to @r
+ * 
+ * Note: -1 in @fds is a sparse slot, which can be filled by uring_update_file()
+ */
+bool uring_register_files(struct uring *r, const int *fds, unsigned int n)
+{
+	return io_uring_register(r->fd, IORING_REGISTER_FILES, fds, n) == 0;
+}
+
+/**
+ * uring_update_file - Replace registered file of @slot with @fd
+ * @fd: -1 to clear the @slot
+ */
+bool uring_update_file(struct uring *r, unsigned int slot, int fd)
+{
+	struct io_uring_files_update update;
+	memset(&update, 0, sizeof(update));
+	update.offset = slot;
+	update.fds = (uint64_t)(uintptr_t)&fd;
+	return io_uring_register(r->fd, IORING_REGISTER_FILES_UPDATE,
+							&update, 1) == 1;
+}
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2026, Shu De Zheng <imchuncai@gmail.com>. All Rights Reserved.
+
+#ifndef __UMEM_CACHE_URING_H
+#define __UMEM_CACHE_URING_H
+
+#ifdef CONFIG_IO_URING
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * uring - A minimal io_uring instance
+ * @fd: the io_uring file descriptor
+ * @sqe_tail: local tail of the submission queue, published by uring_submit_and_wait()
+ * @sq_*: pointers into the mmap-ed submission queue ring
+ * @cq_*: pointers into the mmap-ed completion queue ring
+ * @sq_ring: the mmap-ed submission queue ring
+ * @sq_ring_size: size of @sq_ring (in bytes)
+ * @cq_ring: the mmap-ed completion queue ring, may equal to @sq_ring
+ * @cq_ring_size: size of @cq_ring (in bytes)
+ * @sqes_size: size of @sqes (in bytes)
+ * @sqpoll: the submission queue is polled by a kernel thread
+ */
+struct uring {
+	int fd;
+	unsigned int sqe_tail;
+
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int sq_mask;
+	unsigned int *sq_flags;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	bool sqpoll;
+};
+
+bool uring_init(struct uring *r, unsigned int entries, bool sqpoll);
+struct io_uring_sqe *uring_get_sqe(struct uring *r);
+bool uring_submit_and_wait(struct uring *r, unsigned int wait_nr);
+bool uring_register_files(struct uring *r, const int *fds, unsigned int n);
+bool uring_update_file(struct uring *r, unsigned int slot, int fd);
+
+/**
+ * uring_peek_cqe - Get the next completion of @r
+ * 
+ * @return: the completion, or NULL if there is none
+ */
+static inline struct io_uring_cqe *uring_peek_cqe(struct uring *r)
+{
+	unsigned int head = *r->cq_head;
+	if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &r->cqes[head & r->cq_mask];
+}
+
+/**
+ * uring_cqe_seen - Hand the completion got from uring_peek_cqe() back to @r
+ */
+static inline void uring_cqe_seen(struct uring *r)
+{
+	__atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
+
+#endif